@@ -0,0 +1,164 @@
+/*!
+	Project: gr2pack/libopengrn
+	File: gr2pack.c
+	Bundles many GR2 files in a pack and lists the content of packs
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libopengrn/pack.h"
+#include "../libopengrn/debug.h"
+
+/*!
+	Writes the pack to a FILE
+*/
+static bool WriteFile(void* context, const void* data, size_t len)
+{
+	return fwrite(data, len, 1, (FILE*)context) == 1;
+}
+
+/*!
+	Reads a whole file
+	@param path Path of the file
+	@param len Output length of the file
+	@return the content of the file, NULL in case of an error
+*/
+static uint8_t* ReadFile(const char* path, size_t* len)
+{
+	FILE* fp = fopen(path, "rb");
+	uint8_t* data;
+	long size;
+
+	if (!fp)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+
+	data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+
+	if (!data || size < 0 || (size && fread(data, (size_t)size, 1, fp) != 1))
+	{
+		fclose(fp);
+		free(data);
+		return NULL;
+	}
+
+	fclose(fp);
+	*len = (size_t)size;
+	return data;
+}
+
+/*!
+	Lists the files of a pack
+	@param path Path of the pack
+	@return the exit code
+*/
+static int ListPack(const char* path)
+{
+	TGr2Pack pack;
+
+	if (!Gr2Pack_Open(&pack, path))
+	{
+		printf("cannot open pack %s\n", path);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < pack.count; i++)
+	{
+		const TGr2PackEntry* entry = &pack.entries[i];
+
+		if (entry->nameOffset > pack.namesSize || entry->nameLength > pack.namesSize - entry->nameOffset)
+			continue;
+
+		printf("%s %llu %.*s\n", entry->kind == GR2_PACK_IMAGE ? "image" : "file ", (unsigned long long)entry->size, (int)entry->nameLength, pack.names + entry->nameOffset);
+	}
+
+	Gr2Pack_Close(&pack);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	TGr2PackWriter writer;
+	TGr2Stream stream;
+	uint32_t kind = GR2_PACK_FILE;
+	FILE* fp;
+	bool success = true;
+
+	DumpMemLeak();
+
+	if (argc == 3 && !strcmp(argv[1], "-l"))
+		return ListPack(argv[2]);
+
+	if (argc > 1 && !strcmp(argv[1], "-i"))
+	{
+		kind = GR2_PACK_IMAGE;
+		argv++;
+		argc--;
+	}
+
+	if (argc < 3)
+	{
+		printf("usage: gr2pack [-i] <pack> <files...>\n\tstores the files as they are, or decompressed with -i\n       gr2pack -l <pack>\n\tlists the files of a pack\n");
+		return 1;
+	}
+
+	if (!Gr2PackWriter_Init(&writer))
+	{
+		Gr2PackWriter_Free(&writer);
+		printf("out of memory\n");
+		return 1;
+	}
+
+	for (int i = 2; i < argc && success; i++)
+	{
+		size_t len;
+		uint8_t* data = ReadFile(argv[i], &len);
+
+		if (!data)
+		{
+			printf("cannot read %s\n", argv[i]);
+			success = false;
+			break;
+		}
+
+		success = Gr2PackWriter_Add(&writer, argv[i], data, len, kind);
+		free(data);
+
+		if (!success)
+			printf("cannot add %s\n", argv[i]);
+	}
+
+	if (success)
+	{
+		fp = fopen(argv[1], "wb");
+
+		if (!fp)
+		{
+			printf("cannot create %s\n", argv[1]);
+			success = false;
+		}
+		else
+		{
+			stream.context = fp;
+			stream.write = WriteFile;
+			stream.seek = NULL;
+
+			success = Gr2PackWriter_Write(&writer, &stream);
+			success = !fclose(fp) && success;
+
+			if (!success)
+				printf("cannot write %s\n", argv[1]);
+		}
+	}
+
+	Gr2PackWriter_Free(&writer);
+	return success ? 0 : 1;
+}
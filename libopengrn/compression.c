@@ -25,6 +25,21 @@ int Compression_GetExtraLen(uint32_t nType)
 	return (nType == COMPRESSION_TYPE_OODLE0 || nType == COMPRESSION_TYPE_OODLE1) ? 4 : 0;
 }
 
+bool Compression_Encode(uint32_t type, const uint8_t* data, uint32_t length, uint8_t** compressedData, uint32_t* compressedLength)
+{
+	*compressedData = NULL;
+	*compressedLength = 0;
+
+	switch (type)
+	{
+	case COMPRESSION_TYPE_LZ:
+		return Compression_Lz(data, length, compressedData, compressedLength);
+	default:
+		/* only the decoders of the Oodle and Bitknit formats are known */
+		return false;
+	}
+}
+
 /*!
     Decompresses data with algorithm Oodle-1
     @param compressedData the compressed data to decompress
@@ -24,6 +24,7 @@ enum ECompressionTypes
 	COMPRESSION_TYPE_OODLE1,
 	COMPRESSION_TYPE_BITKNIT1,
 	COMPRESSION_TYPE_BITKNIT2,
+	COMPRESSION_TYPE_LZ = 0x100, /* byte aligned LZ private to libopengrn (see lz.c), files with it are not readable by Granny */
 };
 
 /*!
@@ -33,6 +34,17 @@ enum ECompressionTypes
 */
 extern int Compression_GetExtraLen(uint32_t nType);
 
+/*!
+	Compresses the data of a sector
+	@param type the compression type (one of ECompressionTypes)
+	@param data the data to compress
+	@param length length of the data
+	@param compressedData output buffer allocated with malloc, must be freed by the caller
+	@param compressedLength output length of the compressed data
+	@return true if the data was compressed, false if the type has no encoder or the allocation failed
+*/
+extern bool Compression_Encode(uint32_t type, const uint8_t* data, uint32_t length, uint8_t** compressedData, uint32_t* compressedLength);
+
 /*!
 	Decompresses data with algorithm Oodle-1
 	@param compressedData the compressed data to decompress
@@ -51,3 +63,24 @@ extern bool Compression_UnOodle1(uint8_t* compressedData,
                                            uint32_t oodleStop1,
                                            uint32_t oodleStop2,
 	                                       bool endianessMismatch);
+
+/*!
+	Compresses data with the byte aligned LZ of COMPRESSION_TYPE_LZ
+	@param data the data to compress
+	@param length length of the data
+	@param compressedData output buffer allocated with malloc, must be freed by the caller
+	@param compressedLength output length of the compressed data
+	@return true if the data was compressed, false if the allocation failed
+*/
+extern bool Compression_Lz(const uint8_t* data, uint32_t length, uint8_t** compressedData, uint32_t* compressedLength);
+
+/*!
+	Decompresses data with the byte aligned LZ of COMPRESSION_TYPE_LZ
+	@param compressedData the compressed data to decompress
+	@param compressedLength length of the compressed data
+	@param decompressedData A buffer which will store the decompressed data
+	@param decompressedLength length of the decompressed data
+	@return true if the decompression succeeded, false if the data is malformed or doesn't have the length
+	@note Needs no extra bytes after the buffers, nothing is read or written outside of them
+*/
+extern bool Compression_UnLz(const uint8_t* compressedData, uint32_t compressedLength, uint8_t* decompressedData, uint32_t decompressedLength);
@@ -0,0 +1,434 @@
+/*!
+	Project: libopengrn
+	File: convert.c
+	Conversion of the numeric member types to float
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "convert.h"
+#include "platform.h"
+#include "typeinfo.h"
+
+#include <float.h>
+#include <string.h>
+
+#ifdef OG_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef OG_X86
+#include <immintrin.h>
+#endif
+
+/*!
+	Converts a half float to float
+
+	The exponent and mantissa are moved in place and rescaled with a multiplication,
+	which also normalizes the denormals, inf and nan only need the exponent set
+	@param h The half float
+	@return the float value
+*/
+static float Convert_Half(uint16_t h)
+{
+	union { uint32_t u; float f; } v, magic;
+	uint32_t expmant = h & 0x7fff;
+
+	magic.u = (254 - 15) << 23;
+	v.u = expmant << 13;
+	v.f *= magic.f;
+
+	if (expmant > 0x7bff) /* inf or nan */
+		v.u |= 255 << 23;
+
+	v.u |= (uint32_t)(h & 0x8000) << 16;
+	return v.f;
+}
+
+/*!
+	Converts a float to half float, rounding to the nearest even
+	@param value The float
+	@return the half float
+*/
+static uint16_t Convert_ToHalf(float value)
+{
+	union { uint32_t u; float f; } v, denormal;
+	uint32_t sign;
+	uint16_t h;
+
+	denormal.u = ((127 - 15) + (23 - 10) + 1) << 23;
+	v.f = value;
+	sign = v.u & 0x80000000u;
+	v.u ^= sign;
+
+	if (v.u >= 0x47800000u) /* too big for a half, inf or nan */
+		h = v.u > 0x7f800000u ? 0x7e00 : 0x7c00;
+	else if (v.u < (113u << 23)) /* denormal or zero, the addition rounds the mantissa */
+	{
+		v.f += denormal.f;
+		h = (uint16_t)(v.u - denormal.u);
+	}
+	else
+	{
+		uint32_t odd = (v.u >> 13) & 1;
+
+		v.u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+		h = (uint16_t)(v.u >> 13);
+	}
+
+	return h | (uint16_t)(sign >> 16);
+}
+
+#ifdef OG_SSE2
+static inline __m128i Convert_LoadU8(const uint8_t* p)
+{
+	int32_t v;
+	__m128i x;
+
+	memcpy(&v, p, sizeof(v));
+	x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128());
+	return _mm_unpacklo_epi16(x, _mm_setzero_si128());
+}
+
+static inline __m128i Convert_LoadI8(const uint8_t* p)
+{
+	int32_t v;
+	__m128i x;
+
+	memcpy(&v, p, sizeof(v));
+	x = _mm_cvtsi32_si128(v);
+	x = _mm_unpacklo_epi8(x, x);
+	return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 24);
+}
+
+static inline __m128i Convert_LoadU16(const uint8_t* p)
+{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+}
+
+static inline __m128i Convert_LoadI16(const uint8_t* p)
+{
+	__m128i x = _mm_loadl_epi64((const __m128i*)p);
+
+	return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+}
+
+/*!
+	Converts 4 half floats to float, same as Convert_Half
+	@param h The half floats, one in the low bits of each lane
+	@return the float values
+*/
+static inline __m128 Convert_Half4(__m128i h)
+{
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+	const __m128i infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+	__m128 v = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+
+	v = _mm_or_ps(v, _mm_castsi128_ps(_mm_and_si128(infnan, _mm_set1_epi32(255 << 23))));
+	return _mm_or_ps(v, _mm_castsi128_ps(_mm_slli_epi32(_mm_xor_si128(h, expmant), 16)));
+}
+
+/*!
+	Stores the first components of 4 converted values
+	@param dst First float of the row
+	@param v The converted values
+	@param components Number of floats to store (2, 3 or 4)
+*/
+static inline void Convert_StoreRow(float* dst, __m128 v, uint32_t components)
+{
+	if (components == 4)
+	{
+		_mm_storeu_ps(dst, v);
+		return;
+	}
+
+	_mm_storel_pi((__m64*)dst, v);
+
+	if (components == 3)
+		_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+/*!
+	Converts the rows with 2, 3 and 4 components with SSE2: positions, normals and texture
+	coordinates are 2 or 3 wide, weights, indices, tangents and colors 4 wide. Narrow rows still
+	read 4 values, which end inside the next row, so their last row is left to the scalar loop
+	@param value Expression that converts the 4 values at src to a __m128
+*/
+#define CONVERT_SIMD_ROWS(value) \
+	if (components >= 2 && components <= 4) \
+	{ \
+		size_t rows = components == 4 || !count ? count : count - 1; \
+		for (size_t i = 0; i < rows; i++, src += srcStride, dst += dstStride) \
+			Convert_StoreRow(dst, value, components); \
+		count -= rows; \
+	}
+
+/*!
+	Converts the rows of an integer type with SSE2 (see CONVERT_SIMD_ROWS)
+*/
+#define CONVERT_SIMD(load, scale, minimum) \
+	{ \
+		const __m128 s = _mm_set1_ps(scale), m = _mm_set1_ps(minimum); \
+		CONVERT_SIMD_ROWS(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(load(src)), s), m)) \
+	}
+#else
+#define CONVERT_SIMD_ROWS(value)
+#define CONVERT_SIMD(load, scale, minimum)
+#endif
+
+/*!
+	Defines the conversion of an integer type
+	@param name Name of the conversion
+	@param ctype C type of the values
+	@param load SSE2 load of 4 values into 4 int32 lanes
+	@param scale Scale applied to the values
+	@param minimum Smallest converted value (-1 for the binormals, where both -128 and -127 are -1)
+*/
+#define CONVERT_INTEGER(name, ctype, load, scale, minimum) \
+static void Convert_##name(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count) \
+{ \
+	CONVERT_SIMD(load, scale, minimum) \
+	for (size_t i = 0; i < count; i++, src += srcStride, dst += dstStride) \
+	{ \
+		for (uint32_t c = 0; c < components; c++) \
+		{ \
+			ctype v; \
+			float f; \
+			memcpy(&v, src + c * sizeof(ctype), sizeof(ctype)); \
+			f = (float)v * (scale); \
+			dst[c] = f < (minimum) ? (minimum) : f; \
+		} \
+	} \
+}
+
+CONVERT_INTEGER(Int8, int8_t, Convert_LoadI8, 1.0f, -FLT_MAX)
+CONVERT_INTEGER(Uint8, uint8_t, Convert_LoadU8, 1.0f, 0.0f)
+CONVERT_INTEGER(BinormalInt8, int8_t, Convert_LoadI8, 1.0f / 127.0f, -1.0f)
+CONVERT_INTEGER(NormalUint8, uint8_t, Convert_LoadU8, 1.0f / 255.0f, 0.0f)
+CONVERT_INTEGER(Int16, int16_t, Convert_LoadI16, 1.0f, -FLT_MAX)
+CONVERT_INTEGER(Uint16, uint16_t, Convert_LoadU16, 1.0f, 0.0f)
+CONVERT_INTEGER(BinormalInt16, int16_t, Convert_LoadI16, 1.0f / 32767.0f, -1.0f)
+CONVERT_INTEGER(NormalUint16, uint16_t, Convert_LoadU16, 1.0f / 65535.0f, 0.0f)
+
+static void Convert_Int32(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count)
+{
+	for (size_t i = 0; i < count; i++, src += srcStride, dst += dstStride)
+	{
+		for (uint32_t c = 0; c < components; c++)
+		{
+			int32_t v;
+			memcpy(&v, src + c * sizeof(v), sizeof(v));
+			dst[c] = (float)v;
+		}
+	}
+}
+
+static void Convert_Uint32(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count)
+{
+	for (size_t i = 0; i < count; i++, src += srcStride, dst += dstStride)
+	{
+		for (uint32_t c = 0; c < components; c++)
+		{
+			uint32_t v;
+			memcpy(&v, src + c * sizeof(v), sizeof(v));
+			dst[c] = (float)v;
+		}
+	}
+}
+
+static void Convert_Real32(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count)
+{
+	CONVERT_SIMD_ROWS(_mm_loadu_ps((const float*)src))
+
+	for (size_t i = 0; i < count; i++, src += srcStride, dst += dstStride)
+		memcpy(dst, src, components * sizeof(float));
+}
+
+static void Convert_Real16(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count)
+{
+	if (srcStride == components * sizeof(uint16_t) && dstStride == components)
+	{
+		/* packed rows, convert them as one array */
+		Convert_HalfToFloat((const uint16_t*)src, dst, components * count);
+		return;
+	}
+
+	CONVERT_SIMD_ROWS(Convert_Half4(Convert_LoadU16(src)))
+
+	for (size_t i = 0; i < count; i++, src += srcStride, dst += dstStride)
+	{
+		for (uint32_t c = 0; c < components; c++)
+		{
+			uint16_t h;
+			memcpy(&h, src + c * sizeof(h), sizeof(h));
+			dst[c] = Convert_Half(h);
+		}
+	}
+}
+
+#ifdef OG_X86
+OG_TARGET("avx,f16c") static void Convert_HalfToFloatF16C(const uint16_t* src, float* dst, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+
+	for (; i < count; i++)
+		dst[i] = _cvtsh_ss(src[i]);
+}
+
+OG_TARGET("avx,f16c") static void Convert_FloatToHalfF16C(const float* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+
+	for (; i < count; i++)
+		dst[i] = _cvtss_sh(src[i], _MM_FROUND_TO_NEAREST_INT);
+}
+#endif
+
+OG_DLLAPI void Convert_HalfToFloat(const uint16_t* src, float* dst, size_t count)
+{
+	size_t i = 0;
+
+#ifdef OG_X86
+	if (Platform_GetCpuFeatures() & PLATFORM_CPU_F16C)
+	{
+		Convert_HalfToFloatF16C(src, dst, count);
+		return;
+	}
+#endif
+
+#ifdef OG_SSE2
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, Convert_Half4(Convert_LoadU16((const uint8_t*)(src + i))));
+#endif
+
+	for (; i < count; i++)
+		dst[i] = Convert_Half(src[i]);
+}
+
+OG_DLLAPI void Convert_FloatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+#ifdef OG_X86
+	if (Platform_GetCpuFeatures() & PLATFORM_CPU_F16C)
+	{
+		Convert_FloatToHalfF16C(src, dst, count);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < count; i++)
+		dst[i] = Convert_ToHalf(src[i]);
+}
+
+/*!
+	Gets the half floats of an element
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element
+	@param count Output number of half floats
+	@return pointer to the half floats or NULL if the element is not a half float array
+*/
+static uint16_t* Convert_GetReal16(TGr2* gr2, const TElementGeneric* elem, size_t* count)
+{
+	TLayoutChildren children;
+
+	*count = 0;
+
+	if (elem->rawInfo.type == TYPEID_REAL16)
+	{
+		*count = elem->size;
+		return ((const TElementUint16*)elem)->value;
+	}
+
+	if (!elem->member || !gr2->data || !LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, elem->member, elem->data, &children))
+		return NULL;
+
+	if (!children.layout || !children.count || children.references)
+		return NULL;
+
+	for (uint32_t i = 0; i < children.layout->count; i++)
+	{
+		if (children.layout->members[i].info.type != TYPEID_REAL16)
+			return NULL;
+	}
+
+	/* the structures are only half floats, so they are one contiguous array */
+	*count = (size_t)children.count * (children.layout->stride / sizeof(uint16_t));
+	return (uint16_t*)children.base;
+}
+
+OG_DLLAPI size_t Element_GetReal16Count(TGr2* gr2, const TElementGeneric* elem)
+{
+	size_t count;
+
+	Convert_GetReal16(gr2, elem, &count);
+	return count;
+}
+
+OG_DLLAPI bool Element_GetReal16Array(TGr2* gr2, const TElementGeneric* elem, float* out)
+{
+	size_t count;
+	const uint16_t* values = Convert_GetReal16(gr2, elem, &count);
+
+	if (!values)
+		return false;
+
+	Convert_HalfToFloat(values, out, count);
+	return true;
+}
+
+OG_DLLAPI bool Element_SetReal16Array(TGr2* gr2, TElementGeneric* elem, const float* values)
+{
+	size_t count;
+	uint16_t* dst = Convert_GetReal16(gr2, elem, &count);
+
+	if (!dst)
+		return false;
+
+	Convert_FloatToHalf(values, dst, count);
+
+	/* values stored in the loaded data are written again by Gr2_ComposeIncremental */
+	if (gr2->dirtySectors && (const uint8_t*)dst >= gr2->data && (const uint8_t*)dst < gr2->data + gr2->dataSize)
+		Gr2_MarkDirty(gr2, dst, count * sizeof(uint16_t));
+
+	return true;
+}
+
+OG_DLLAPI TConvertToFloatFunc Convert_GetToFloat(uint32_t type)
+{
+	switch (type)
+	{
+	case TYPEID_REAL32:
+		return Convert_Real32;
+	case TYPEID_INT8:
+		return Convert_Int8;
+	case TYPEID_UINT8:
+		return Convert_Uint8;
+	case TYPEID_BINORMALINT8:
+		return Convert_BinormalInt8;
+	case TYPEID_NORMALUINT8:
+		return Convert_NormalUint8;
+	case TYPEID_INT16:
+		return Convert_Int16;
+	case TYPEID_UINT16:
+		return Convert_Uint16;
+	case TYPEID_BINORMALINT16:
+		return Convert_BinormalInt16;
+	case TYPEID_NORMALUINT16:
+		return Convert_NormalUint16;
+	case TYPEID_INT32:
+		return Convert_Int32;
+	case TYPEID_UINT32:
+		return Convert_Uint32;
+	case TYPEID_REAL16:
+		return Convert_Real16;
+	default:
+		return NULL;
+	}
+}
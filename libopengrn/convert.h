@@ -0,0 +1,93 @@
+/*!
+	Project: libopengrn
+	File: convert.h
+	Conversion of the numeric member types to float
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "dllapi.h"
+#include "gr2.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Converts rows of values to float
+	@param src First value of the first row
+	@param srcStride Distance in bytes between two rows of src
+	@param dst First float of the first row
+	@param dstStride Distance in floats between two rows of dst
+	@param components Number of values of each row
+	@param count Number of rows
+*/
+typedef void (*TConvertToFloatFunc)(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride, uint32_t components, size_t count);
+
+/*!
+	Gets the float conversion of a member type
+
+	The normalized types are mapped to [0, 1] (NORMALUINT8, NORMALUINT16) and
+	[-1, 1] (BINORMALINT8, BINORMALINT16), the other integers are converted as they are
+	@param type Type of the values (one of TypeIDs)
+	@return the conversion or NULL if the type is not numeric
+*/
+extern OG_DLLAPI TConvertToFloatFunc Convert_GetToFloat(uint32_t type);
+
+/*!
+	Converts an array of half floats to float
+	@param src The half floats
+	@param dst Output floats
+	@param count Number of values
+	@note Uses F16C when the cpu supports it
+*/
+extern OG_DLLAPI void Convert_HalfToFloat(const uint16_t* src, float* dst, size_t count);
+
+/*!
+	Converts an array of floats to half float, rounding to the nearest even
+	@param src The floats
+	@param dst Output half floats
+	@param count Number of values
+	@note Uses F16C when the cpu supports it
+*/
+extern OG_DLLAPI void Convert_FloatToHalf(const float* src, uint16_t* dst, size_t count);
+
+/*!
+	Gets the number of half floats of a TYPEID_REAL16 element, or of an array
+	whose structures contain only TYPEID_REAL16 members
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element
+	@return the number of half floats, 0 if the element is not a half float array
+*/
+extern OG_DLLAPI size_t Element_GetReal16Count(TGr2* gr2, const TElementGeneric* elem);
+
+/*!
+	Converts the half floats of an element to float
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element (see Element_GetReal16Count)
+	@param out Output floats, must have room for Element_GetReal16Count values
+	@return true if the values were converted, otherwise false
+*/
+extern OG_DLLAPI bool Element_GetReal16Array(TGr2* gr2, const TElementGeneric* elem, float* out);
+
+/*!
+	Stores floats into the half floats of an element
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element (see Element_GetReal16Count)
+	@param values The floats, must have Element_GetReal16Count values
+	@return true if the values were stored, otherwise false
+	@note The element must have a value buffer (the file data or a buffer set by the program),
+		the sectors of values inside the file data are marked with Gr2_MarkDirty
+*/
+extern OG_DLLAPI bool Element_SetReal16Array(TGr2* gr2, TElementGeneric* elem, const float* values);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,3 +13,22 @@
 #include <string.h>
 
 extern uint32_t CRC32(const uint8_t* data, size_t len);
+
+/*!
+	Continues a CRC32 with more data, so a stream can be checksummed while it's written
+	@param crc CRC32 of the previous data (0 for the first call)
+	@param data The data to add
+	@param len Length of the data
+	@return the CRC32 of the previous data followed by the new one
+*/
+extern uint32_t CRC32_Update(uint32_t crc, const uint8_t* data, size_t len);
+
+/*!
+	Combines the CRC32 of two consecutive blocks, so blocks checksummed separately (e.g. on
+	different threads) give the CRC32 of the whole data
+	@param crc1 CRC32 of the first block
+	@param crc2 CRC32 of the second block
+	@param len2 Length of the second block
+	@return the CRC32 of the first block followed by the second one
+*/
+extern uint32_t CRC32_Combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
@@ -0,0 +1,1002 @@
+/*!
+	Project: libopengrn
+	File: curve.c
+	Animation curve decoding and sampling
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "curve.h"
+#include "pathindex.h"
+#include "transform.h"
+#include "platform.h"
+#include "debug.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OG_SSE2
+#include <emmintrin.h>
+#endif
+
+/*!
+	Number of knots a cursor walks forward before it searches the knot again
+*/
+#define CURVE_CURSOR_STEPS 4
+
+/*!
+	Highest degree of the B-splines that can be evaluated (cubic)
+*/
+#define CURVE_MAX_DEGREE 3
+
+/*!
+	Type of the packed knots and controls of each format
+*/
+static const uint32_t curveValueTypes[CURVE_FORMAT_COUNT] = {
+	TYPEID_REAL32, TYPEID_REAL32, TYPEID_REAL32, TYPEID_REAL32, TYPEID_REAL32, TYPEID_REAL32, // Da*32f, D3/D4Constant32f
+	TYPEID_UINT16, TYPEID_UINT8, // DaK16uC16u, DaK8uC8u
+	TYPEID_UINT16, TYPEID_UINT8, // D4nK16uC15u, D4nK8uC7u
+	TYPEID_UINT16, TYPEID_UINT8, // D3K16uC16u, D3K8uC8u
+	TYPEID_UINT16, TYPEID_UINT16, TYPEID_UINT8, TYPEID_UINT8, // D9I1K16uC16u, D9I3K16uC16u, D9I1K8uC8u, D9I3K8uC8u
+	TYPEID_REAL32, TYPEID_UINT16, TYPEID_UINT8, // D3I1K32fC32f, D3I1K16uC16u, D3I1K8uC8u
+};
+
+/*!
+	Scale/offset table of the D4n formats, indexed by the 4-bit entries of the selector
+*/
+static const float curveQuatScales[16] = {
+	1.4142135f, 0.70710677f, 0.35355338f, 0.35355338f, 0.35355338f, 0.17677669f, 0.17677669f, 0.17677669f,
+	-1.4142135f, -0.70710677f, -0.35355338f, -0.35355338f, -0.35355338f, -0.17677669f, -0.17677669f, -0.17677669f,
+};
+
+static const float curveQuatOffsets[16] = {
+	-0.70710677f, -0.35355338f, -0.53033006f, -0.17677669f, 0.17677669f, -0.17677669f, -0.088388346f, 0.0f,
+	0.70710677f, 0.35355338f, 0.53033006f, 0.17677669f, -0.17677669f, 0.17677669f, 0.088388346f, -0.0f,
+};
+
+/*!
+	Gets the size of a packed value type
+	@param type TYPEID_REAL32, TYPEID_UINT16 or TYPEID_UINT8
+	@return the size in bytes
+*/
+static uint32_t Curve_GetValueSize(uint32_t type)
+{
+	return type == TYPEID_REAL32 ? 4 : type == TYPEID_UINT16 ? 2 : 1;
+}
+
+/*!
+	Reads a packed value as float
+	@param data Pointer to the first packed value
+	@param type Type of the values
+	@param index Index of the value
+	@return the value
+*/
+static float Curve_ReadValue(const uint8_t* data, uint32_t type, size_t index)
+{
+	float f;
+	uint16_t u;
+
+	switch (type)
+	{
+	case TYPEID_REAL32:
+		memcpy(&f, data + index * 4, sizeof(f));
+		return f;
+
+	case TYPEID_UINT16:
+		memcpy(&u, data + index * 2, sizeof(u));
+		return (float)u;
+
+	default:
+		return (float)data[index];
+	}
+}
+
+/*!
+	Reads a packed value as integer
+	@param data Pointer to the first packed value
+	@param type TYPEID_UINT16 or TYPEID_UINT8
+	@param index Index of the value
+	@return the value
+*/
+static uint32_t Curve_ReadInteger(const uint8_t* data, uint32_t type, size_t index)
+{
+	uint16_t u;
+
+	if (type == TYPEID_UINT8)
+		return data[index];
+
+	memcpy(&u, data + index * 2, sizeof(u));
+	return u;
+}
+
+/*!
+	Gets the data of an inline member of a curve
+	@param layout Layout of the curve
+	@param base Data of the curve
+	@param name Name of the member
+	@param type Expected type of the member
+	@param count Expected number of values
+	@return the data of the member or NULL if the member does not exist or has another type
+*/
+static const uint8_t* Curve_GetField(const TTypeLayout* layout, const uint8_t* base, const char* name, uint32_t type, uint32_t count)
+{
+	int32_t index = Layout_FindMember((TTypeLayout*)layout, name, strlen(name));
+
+	if (index < 0 || layout->members[index].info.type != type || layout->members[index].count != count)
+		return NULL;
+
+	return base + layout->members[index].offset;
+}
+
+/*!
+	Gets the values of an array member of a curve
+	@param gr2 The Gr2 structure
+	@param layout Layout of the curve
+	@param base Data of the curve
+	@param name Name of the member
+	@param type Expected type of the values
+	@param values Output values
+	@param count Output number of values
+	@return true if the array was resolved, otherwise false
+*/
+static bool Curve_GetArray(TGr2* gr2, const TTypeLayout* layout, const uint8_t* base, const char* name, uint32_t type, const uint8_t** values, uint32_t* count)
+{
+	int32_t index = Layout_FindMember((TTypeLayout*)layout, name, strlen(name));
+	TLayoutChildren children;
+
+	*values = NULL;
+	*count = 0;
+
+	if (index < 0 || layout->members[index].info.type != TYPEID_REFERENCETOARRAY)
+		return false;
+
+	if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, &layout->members[index], base + layout->members[index].offset, &children))
+		return false;
+
+	if (!children.count)
+		return true;
+
+	if (children.layout->count != 1 || children.layout->members[0].info.type != type || children.layout->stride != Curve_GetValueSize(type))
+	{
+		dbg_printf("curve array %s has an unexpected type", name);
+		return false;
+	}
+
+	*values = children.base;
+	*count = children.count;
+	return true;
+}
+
+/*!
+	Decodes the knot scale stored as the upper 16 bits of a float
+	@param layout Layout of the curve
+	@param base Data of the curve
+	@param curve The curve to update
+	@return true if the member exists, otherwise false
+*/
+static bool Curve_GetKnotScaleTrunc(const TTypeLayout* layout, const uint8_t* base, TGr2Curve* curve)
+{
+	const uint8_t* field = Curve_GetField(layout, base, "OneOverKnotScaleTrunc", TYPEID_UINT16, 1);
+	uint16_t trunc;
+	uint32_t bits;
+	float oneOverKnotScale;
+
+	if (!field)
+		return false;
+
+	memcpy(&trunc, field, sizeof(trunc));
+	bits = (uint32_t)trunc << 16;
+	memcpy(&oneOverKnotScale, &bits, sizeof(oneOverKnotScale));
+
+	curve->knotScale = oneOverKnotScale != 0.0f ? 1.0f / oneOverKnotScale : 0.0f;
+	return true;
+}
+
+/*!
+	Sets a curve to the identity of a dimension
+	@param curve The curve
+	@param dimension Number of floats of the value
+*/
+static void Curve_SetIdentity(TGr2Curve* curve, uint32_t dimension)
+{
+	memset(curve, 0, sizeof(TGr2Curve));
+	curve->format = CURVE_DAIDENTITY;
+	curve->dimension = dimension;
+}
+
+/*!
+	Binds the packed members of a curve format
+	@param gr2 The Gr2 structure
+	@param layout Layout of the curve data
+	@param base Data of the curve
+	@param curve The curve, format and degree already set
+	@return true if the members were bound, otherwise false
+*/
+static bool Curve_BindFormat(TGr2* gr2, const TTypeLayout* layout, const uint8_t* base, TGr2Curve* curve)
+{
+	const uint32_t type = curveValueTypes[curve->format];
+	const uint8_t *field, *values, *scaleOffsets;
+	uint32_t count, knotCount;
+	int16_t dimension;
+	float oneOverKnotScale;
+
+	if (curve->degree > CURVE_MAX_DEGREE)
+	{
+		dbg_printf("curve degree %u is not supported", curve->degree);
+		return false;
+	}
+
+	curve->knotScale = 1.0f;
+
+	switch (curve->format)
+	{
+	case CURVE_DAKEYFRAMES32F:
+		if (!(field = Curve_GetField(layout, base, "Dimension", TYPEID_INT16, 1)) || !Curve_GetArray(gr2, layout, base, "Controls", type, &values, &count))
+			return false;
+
+		memcpy(&dimension, field, sizeof(dimension));
+
+		if (dimension <= 0)
+			return false;
+
+		curve->dimension = curve->components = (uint32_t)dimension;
+		curve->knotCount = count / (uint32_t)dimension;
+		curve->controls = values;
+		return true;
+
+	case CURVE_DAK32FC32F:
+		if (!Curve_GetArray(gr2, layout, base, "Knots", type, &curve->knots, &knotCount) || !Curve_GetArray(gr2, layout, base, "Controls", type, &values, &count))
+			return false;
+
+		if (!knotCount)
+			return true;
+
+		curve->dimension = curve->components = count / knotCount;
+		curve->knotCount = curve->components ? knotCount : 0;
+		curve->controls = values;
+		return true;
+
+	case CURVE_DAIDENTITY:
+		if (!(field = Curve_GetField(layout, base, "Dimension", TYPEID_INT16, 1)))
+			return false;
+
+		memcpy(&dimension, field, sizeof(dimension));
+		curve->dimension = dimension > 0 ? (uint32_t)dimension : 0;
+		return true;
+
+	case CURVE_DACONSTANT32F:
+		if (!Curve_GetArray(gr2, layout, base, "Controls", type, &values, &count))
+			return false;
+
+		curve->dimension = curve->components = count;
+		curve->knotCount = count ? 1 : 0;
+		curve->controls = values;
+		return true;
+
+	case CURVE_D3CONSTANT32F:
+	case CURVE_D4CONSTANT32F:
+		count = curve->format == CURVE_D3CONSTANT32F ? 3 : 4;
+
+		if (!(curve->controls = Curve_GetField(layout, base, "Controls", type, count)))
+			return false;
+
+		curve->dimension = curve->components = count;
+		curve->knotCount = 1;
+		return true;
+
+	case CURVE_DAK16UC16U:
+	case CURVE_DAK8UC8U:
+		if (!Curve_GetKnotScaleTrunc(layout, base, curve) || !Curve_GetArray(gr2, layout, base, "ControlScaleOffsets", TYPEID_REAL32, &scaleOffsets, &count)
+			|| !Curve_GetArray(gr2, layout, base, "KnotsControls", type, &values, &knotCount))
+			return false;
+
+		/* the scales of all the components come first, then the offsets */
+		curve->dimension = curve->components = count / 2;
+		curve->knotCount = knotCount / (curve->components + 1);
+		curve->scales = (const float*)scaleOffsets;
+		curve->offsets = curve->scales + curve->components;
+		break;
+
+	case CURVE_D4NK16UC15U:
+	case CURVE_D4NK8UC7U:
+		if (!(field = Curve_GetField(layout, base, "ScaleOffsetTableEntries", TYPEID_UINT16, 1)))
+			return false;
+
+		memcpy(&curve->selector, field, sizeof(curve->selector));
+
+		if (!(field = Curve_GetField(layout, base, "OneOverKnotScale", TYPEID_REAL32, 1)) || !Curve_GetArray(gr2, layout, base, "KnotsControls", type, &values, &knotCount))
+			return false;
+
+		memcpy(&oneOverKnotScale, field, sizeof(oneOverKnotScale));
+		curve->knotScale = oneOverKnotScale != 0.0f ? 1.0f / oneOverKnotScale : 0.0f;
+		curve->dimension = 4;
+		curve->components = 3;
+		curve->knotCount = knotCount / 4;
+		break;
+
+	case CURVE_D3K16UC16U:
+	case CURVE_D3K8UC8U:
+	case CURVE_D9I3K16UC16U:
+	case CURVE_D9I3K8UC8U:
+		if (!Curve_GetKnotScaleTrunc(layout, base, curve) || !(field = Curve_GetField(layout, base, "ControlScales", TYPEID_REAL32, 3))
+			|| !(curve->offsets = (const float*)Curve_GetField(layout, base, "ControlOffsets", TYPEID_REAL32, 3))
+			|| !Curve_GetArray(gr2, layout, base, "KnotsControls", type, &values, &knotCount))
+			return false;
+
+		curve->scales = (const float*)field;
+		curve->dimension = curve->format == CURVE_D3K16UC16U || curve->format == CURVE_D3K8UC8U ? 3 : 9;
+		curve->components = 3;
+		curve->knotCount = knotCount / 4;
+		break;
+
+	case CURVE_D9I1K16UC16U:
+	case CURVE_D9I1K8UC8U:
+		if (!Curve_GetKnotScaleTrunc(layout, base, curve) || !(field = Curve_GetField(layout, base, "ControlScale", TYPEID_REAL32, 1))
+			|| !(curve->offsets = (const float*)Curve_GetField(layout, base, "ControlOffset", TYPEID_REAL32, 1))
+			|| !Curve_GetArray(gr2, layout, base, "KnotsControls", type, &values, &knotCount))
+			return false;
+
+		curve->scales = (const float*)field;
+		curve->dimension = 9;
+		curve->components = 1;
+		curve->knotCount = knotCount / 2;
+		break;
+
+	case CURVE_D3I1K32FC32F:
+	case CURVE_D3I1K16UC16U:
+	case CURVE_D3I1K8UC8U:
+		if ((curve->format != CURVE_D3I1K32FC32F && !Curve_GetKnotScaleTrunc(layout, base, curve))
+			|| !(field = Curve_GetField(layout, base, "ControlScales", TYPEID_REAL32, 3))
+			|| !(curve->offsets = (const float*)Curve_GetField(layout, base, "ControlOffsets", TYPEID_REAL32, 3))
+			|| !Curve_GetArray(gr2, layout, base, "KnotsControls", type, &values, &knotCount))
+			return false;
+
+		/* a single control spread on the three axes */
+		curve->scales = (const float*)field;
+		curve->dimension = 3;
+		curve->components = 1;
+		curve->knotCount = knotCount / 2;
+		break;
+
+	default:
+		return false;
+	}
+
+	/* the knots of the packed formats are followed by the controls */
+	curve->knots = values;
+	curve->controls = values + (size_t)curve->knotCount * Curve_GetValueSize(type);
+	return true;
+}
+
+/*!
+	Binds a curve to the data of a CurveData member
+	@param gr2 The Gr2 structure
+	@param member The CurveData member (variant reference)
+	@param data Data of the member
+	@param curve Output curve
+	@return true if the curve was bound, otherwise false
+*/
+static bool Curve_Bind(TGr2* gr2, const TTypeMember* member, const uint8_t* data, TGr2Curve* curve)
+{
+	TLayoutChildren children;
+	const TTypeLayout* header;
+	const uint8_t *format, *degree;
+	int32_t headerMember;
+
+	memset(curve, 0, sizeof(TGr2Curve));
+
+	if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, member, data, &children) || !children.count || children.references)
+		return false;
+
+	headerMember = Layout_FindMember((TTypeLayout*)children.layout, "CurveDataHeader", 15);
+
+	if (headerMember < 0 || children.layout->members[headerMember].info.type != TYPEID_INLINE || !children.layout->members[headerMember].inlineLayout)
+	{
+		dbg_printf("curve without CurveDataHeader");
+		return false;
+	}
+
+	header = children.layout->members[headerMember].inlineLayout;
+	format = Curve_GetField(header, children.base + children.layout->members[headerMember].offset, "Format", TYPEID_UINT8, 1);
+	degree = Curve_GetField(header, children.base + children.layout->members[headerMember].offset, "Degree", TYPEID_UINT8, 1);
+
+	if (!format || !degree || *format >= CURVE_FORMAT_COUNT)
+	{
+		dbg_printf("unknown curve format");
+		return false;
+	}
+
+	curve->format = *format;
+	curve->degree = *degree;
+
+	if (!Curve_BindFormat(gr2, children.layout, children.base, curve))
+	{
+		dbg_printf("malformed curve of format %u", *format);
+		memset(curve, 0, sizeof(TGr2Curve));
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+	Binds a curve member of a transform track, the old curves without CurveData are bound as DaK32fC32f
+	@param gr2 The Gr2 structure
+	@param layout Layout of the track
+	@param base Data of the track
+	@param name Name of the curve member
+	@param dimension Dimension of the curve
+	@param curve Output curve, the identity if the member does not exist or is empty
+	@return true if the curve was bound, otherwise false
+*/
+static bool Curve_BindTrack(TGr2* gr2, const TTypeLayout* layout, const uint8_t* base, const char* name, uint32_t dimension, TGr2Curve* curve)
+{
+	int32_t index = Layout_FindMember((TTypeLayout*)layout, name, strlen(name));
+	const TTypeLayout* inner;
+	const uint8_t *data, *field;
+	int32_t curveData, degree;
+
+	Curve_SetIdentity(curve, dimension);
+
+	if (index < 0 || layout->members[index].info.type != TYPEID_INLINE || !layout->members[index].inlineLayout)
+		return true;
+
+	inner = layout->members[index].inlineLayout;
+	data = base + layout->members[index].offset;
+	curveData = Layout_FindMember((TTypeLayout*)inner, "CurveData", 9);
+
+	if (curveData >= 0)
+	{
+		if (!LayoutCache_ReadPtr(&gr2->layouts, &gr2->virtual_ptr, data + inner->members[curveData].offset))
+			return true;
+
+		if (!Curve_Bind(gr2, &inner->members[curveData], data + inner->members[curveData].offset, curve))
+			return false;
+	}
+	else
+	{
+		if (!(field = Curve_GetField(inner, data, "Degree", TYPEID_INT32, 1)))
+			return true;
+
+		memcpy(&degree, field, sizeof(degree));
+		curve->format = CURVE_DAK32FC32F;
+		curve->degree = degree > 0 ? (uint8_t)degree : 0;
+
+		if (!Curve_BindFormat(gr2, inner, data, curve))
+			return false;
+	}
+
+	if (curve->format == CURVE_DAIDENTITY || !curve->knotCount)
+	{
+		Curve_SetIdentity(curve, dimension);
+		return true;
+	}
+
+	if (curve->dimension != dimension)
+	{
+		dbg_printf("curve %s has %u floats instead of %u", name, curve->dimension, dimension);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+	Gets a knot of a curve
+	@param curve The curve
+	@param index Index of the knot
+	@return the time of the knot
+*/
+static float Curve_GetKnot(const TGr2Curve* curve, uint32_t index)
+{
+	if (!curve->knots)
+		return (float)index;
+
+	return Curve_ReadValue(curve->knots, curveValueTypes[curve->format], index) * curve->knotScale;
+}
+
+/*!
+	Decodes a component of a control with the generic layout (one packed value per component)
+	@param curve The curve
+	@param index Index of the control
+	@param component Index of the component
+	@return the value of the component
+*/
+static float Curve_GetComponent(const TGr2Curve* curve, uint32_t index, uint32_t component)
+{
+	float value = Curve_ReadValue(curve->controls, curveValueTypes[curve->format], (size_t)index * curve->components + component);
+
+	return curve->scales ? value * curve->scales[component] + curve->offsets[component] : value;
+}
+
+/*!
+	Decodes a control of a curve
+	@param curve The curve
+	@param index Index of the control
+	@param out Output value (curve->dimension floats)
+*/
+static void Curve_GetControl(const TGr2Curve* curve, uint32_t index, float* out)
+{
+	const uint32_t type = curveValueTypes[curve->format];
+	const size_t first = (size_t)index * curve->components;
+	float v[3];
+
+	switch (curve->format)
+	{
+	case CURVE_D4NK16UC15U:
+	case CURVE_D4NK8UC7U:
+	{
+		/* the three smallest components are stored, the missing one is rebuilt from the unit length with the index in the high bits of b and c and the sign in the high bit of a */
+		const uint32_t bits = type == TYPEID_UINT16 ? 15 : 7, mask = (1u << bits) - 1;
+		const float unit = 1.0f / (float)mask;
+		uint32_t a = Curve_ReadInteger(curve->controls, type, first);
+		uint32_t b = Curve_ReadInteger(curve->controls, type, first + 1);
+		uint32_t c = Curve_ReadInteger(curve->controls, type, first + 2);
+		uint32_t missing = ((b >> bits) << 1) | (c >> bits);
+		uint32_t packed[3] = { a & mask, b & mask, c & mask };
+		float sum = 0.0f, w;
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			uint32_t component = (missing + 1 + i) & 3;
+			uint32_t entry = (curve->selector >> (component * 4)) & 0x0f;
+
+			out[component] = (float)packed[i] * curveQuatScales[entry] * unit + curveQuatOffsets[entry];
+			sum += out[component] * out[component];
+		}
+
+		w = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+		out[missing] = a >> bits ? -w : w;
+		return;
+	}
+
+	case CURVE_D9I1K16UC16U:
+	case CURVE_D9I1K8UC8U:
+	case CURVE_D9I3K16UC16U:
+	case CURVE_D9I3K8UC8U:
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			uint32_t component = curve->components == 1 ? 0 : i;
+			v[i] = Curve_ReadValue(curve->controls, type, first + component) * curve->scales[component] + curve->offsets[component];
+		}
+
+		/* diagonal scale matrix */
+		memset(out, 0, sizeof(float) * 9);
+		out[0] = v[0];
+		out[4] = v[1];
+		out[8] = v[2];
+		return;
+
+	case CURVE_D3I1K32FC32F:
+	case CURVE_D3I1K16UC16U:
+	case CURVE_D3I1K8UC8U:
+		v[0] = Curve_ReadValue(curve->controls, type, first);
+
+		for (uint32_t i = 0; i < 3; i++)
+			out[i] = v[0] * curve->scales[i] + curve->offsets[i];
+		return;
+
+	default:
+		for (uint32_t i = 0; i < curve->components; i++)
+			out[i] = Curve_GetComponent(curve, index, i);
+		return;
+	}
+}
+
+/*!
+	Finds the knot interval of a time
+	@param curve The curve
+	@param time The time
+	@return the last knot that is not after the time (0 if the time is before the first knot or the curve has no knots)
+*/
+static uint32_t Curve_FindKnot(const TGr2Curve* curve, float time)
+{
+	uint32_t low = 0, high = curve->knotCount;
+
+	/* first knot after the time */
+	while (low < high)
+	{
+		uint32_t mid = low + (high - low) / 2;
+
+		if (Curve_GetKnot(curve, mid) <= time)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low ? low - 1 : 0;
+}
+
+/*!
+	Moves a cached knot interval to a time, the interval is walked forward for small
+	steps and searched again only when the time goes back or jumps ahead
+	@param curve The curve
+	@param knot The cached knot interval, updated with the interval of the time
+	@param time The time
+	@return the knot interval of the time (see Curve_FindKnot)
+*/
+static uint32_t Curve_AdvanceKnot(const TGr2Curve* curve, uint32_t* knot, float time)
+{
+	uint32_t current = *knot;
+
+	if (current < curve->knotCount && (!current || Curve_GetKnot(curve, current) <= time))
+	{
+		for (uint32_t step = 0; step < CURVE_CURSOR_STEPS; step++, current++)
+		{
+			if (current + 1 >= curve->knotCount || Curve_GetKnot(curve, current + 1) > time)
+				return *knot = current;
+		}
+	}
+
+	return *knot = Curve_FindKnot(curve, time);
+}
+
+/*!
+	Gets a knot of a curve with an index that can be outside of the knots, the knots before the
+	first one and after the last one continue with the spacing of the first and last interval
+	@param curve The curve, with at least two knots
+	@param index Index of the knot
+	@return the time of the knot
+*/
+static float Curve_GetKnotExtended(const TGr2Curve* curve, int64_t index)
+{
+	const int64_t last = (int64_t)curve->knotCount - 1;
+	float first, end;
+
+	if (index >= 0 && index <= last)
+		return Curve_GetKnot(curve, (uint32_t)index);
+
+	if (index < 0)
+	{
+		first = Curve_GetKnot(curve, 0);
+		return first + (float)index * (Curve_GetKnot(curve, 1) - first);
+	}
+
+	end = Curve_GetKnot(curve, (uint32_t)last);
+	return end + (float)(index - last) * (end - Curve_GetKnot(curve, (uint32_t)last - 1));
+}
+
+/*!
+	Blends the controls of a knot interval with the de Boor algorithm
+
+	Like Granny, the knot interval i blends the controls i + 1 - degree to i + 1 with the knots
+	i + 1 - degree to i + degree, so degree 1 is the linear interpolation of the controls i and i + 1
+	@param curve The curve
+	@param knot Knot interval of the time
+	@param time The time, inside the interval
+	@param points The degree + 1 controls, overwritten; the value ends in the last one
+	@param dimension Number of floats of each control
+*/
+static void Curve_DeBoor(const TGr2Curve* curve, uint32_t knot, float time, float* points, uint32_t dimension)
+{
+	const int64_t degree = curve->degree;
+
+	for (int64_t s = 1; s <= degree; s++)
+	{
+		for (int64_t r = degree; r >= s; r--)
+		{
+			float k0 = Curve_GetKnotExtended(curve, (int64_t)knot + r - degree);
+			float k1 = Curve_GetKnotExtended(curve, (int64_t)knot + r + 1 - s);
+			float a = k1 > k0 ? (time - k0) / (k1 - k0) : 0.0f;
+			float* current = points + (size_t)r * dimension;
+			const float* previous = current - dimension;
+
+			for (uint32_t c = 0; c < dimension; c++)
+				current[c] = previous[c] + (current[c] - previous[c]) * a;
+		}
+	}
+}
+
+/*!
+	Samples a curve at a knot interval
+	@param curve The curve
+	@param knot Knot interval (see Curve_FindKnot)
+	@param time The time
+	@param out Output value
+	@param quaternion true if the values are quaternions, every control is flipped to the hemisphere of the previous one
+*/
+static void Curve_Evaluate(const TGr2Curve* curve, uint32_t knot, float time, float* out, bool quaternion)
+{
+	float points[(CURVE_MAX_DEGREE + 1) * 9];
+	const uint32_t degree = curve->degree, last = curve->knotCount - 1;
+	float first, end;
+
+	if (curve->format == CURVE_DAIDENTITY || !curve->knotCount)
+	{
+		memset(out, 0, sizeof(float) * curve->dimension);
+
+		if (curve->dimension == 4)
+			out[3] = 1.0f;
+		else if (curve->dimension == 9)
+			out[0] = out[4] = out[8] = 1.0f;
+		return;
+	}
+
+	if (!degree || !last)
+	{
+		if (curve->dimension > 9)
+		{
+			/* only the generic formats have more components, they are decoded one at a time */
+			for (uint32_t i = 0; i < curve->dimension; i++)
+				out[i] = Curve_GetComponent(curve, knot, i);
+		}
+		else
+			Curve_GetControl(curve, knot, out);
+		return;
+	}
+
+	/* the time is clamped to the knots, the last knot is the end of the last interval */
+	first = Curve_GetKnot(curve, 0);
+	end = Curve_GetKnot(curve, last);
+
+	if (time <= first)
+	{
+		time = first;
+		knot = 0;
+	}
+	else if (time >= end || knot >= last)
+	{
+		time = end;
+		knot = last - 1;
+	}
+
+	if (curve->dimension > 9)
+	{
+		float values[CURVE_MAX_DEGREE + 1];
+
+		for (uint32_t i = 0; i < curve->dimension; i++)
+		{
+			for (uint32_t r = 0; r <= degree; r++)
+			{
+				int64_t control = (int64_t)knot + 1 - degree + r;
+
+				values[r] = Curve_GetComponent(curve, control < 0 ? 0 : control > last ? last : (uint32_t)control, i);
+			}
+
+			Curve_DeBoor(curve, knot, time, values, 1);
+			out[i] = values[degree];
+		}
+		return;
+	}
+
+	/* the controls before the first one and after the last one are the end controls */
+	for (uint32_t r = 0; r <= degree; r++)
+	{
+		int64_t control = (int64_t)knot + 1 - degree + r;
+		float* point = points + (size_t)r * curve->dimension;
+		const float* previous = point - curve->dimension;
+		float dot = 0.0f;
+
+		Curve_GetControl(curve, control < 0 ? 0 : control > last ? last : (uint32_t)control, point);
+
+		if (!quaternion || !r)
+			continue;
+
+		for (uint32_t i = 0; i < 4; i++)
+			dot += previous[i] * point[i];
+
+		if (dot < 0.0f)
+		{
+			for (uint32_t i = 0; i < 4; i++)
+				point[i] = -point[i];
+		}
+	}
+
+	Curve_DeBoor(curve, knot, time, points, curve->dimension);
+	memcpy(out, points + (size_t)degree * curve->dimension, sizeof(float) * curve->dimension);
+}
+
+OG_DLLAPI bool Gr2_GetCurve(TGr2* gr2, const TElementGeneric* elem, TGr2Curve* curve)
+{
+	if (!elem->member || !gr2->data || elem->member->info.type != TYPEID_VARIANTREFERENCE)
+	{
+		memset(curve, 0, sizeof(TGr2Curve));
+		return false;
+	}
+
+	return Curve_Bind(gr2, elem->member, elem->data, curve);
+}
+
+OG_DLLAPI void Curve_Sample(const TGr2Curve* curve, float time, float* out)
+{
+	Curve_Evaluate(curve, Curve_FindKnot(curve, time), time, out, false);
+}
+
+OG_DLLAPI void Curve_SampleCursor(const TGr2Curve* curve, uint32_t* knot, float time, float* out)
+{
+	Curve_Evaluate(curve, Curve_AdvanceKnot(curve, knot, time), time, out, false);
+}
+
+OG_DLLAPI bool Gr2_GetTrackGroup(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2TrackGroup* group)
+{
+	const TElementGeneric* name = Element_FindChild(gr2, elem, "Name", index);
+	const TElementGeneric* tracks = Element_FindChild(gr2, elem, "TransformTracks", index);
+	TLayoutChildren children;
+	TTypeLayout* layout;
+	int32_t nameMember;
+
+	memset(group, 0, sizeof(TGr2TrackGroup));
+
+	if (!tracks || !tracks->member || !gr2->data)
+		return false;
+
+	if (name && name->rawInfo.type == TYPEID_STRING)
+		group->name = ((const TElementString*)name)->value;
+
+	if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, tracks->member, tracks->data, &children))
+		return false;
+
+	if (!children.layout || !children.count)
+		return true;
+
+	layout = (TTypeLayout*)children.layout;
+	nameMember = Layout_FindMember(layout, "Name", 4);
+
+	if (nameMember >= 0 && layout->members[nameMember].info.type != TYPEID_STRING)
+		nameMember = -1;
+
+	group->tracks = (TGr2TransformTrack*)calloc(children.count, sizeof(TGr2TransformTrack));
+
+	if (!group->tracks)
+		return false;
+
+	group->trackCount = children.count;
+
+	for (uint32_t i = 0; i < children.count; i++)
+	{
+		const uint8_t* track = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &children, i);
+		TGr2TransformTrack* out = &group->tracks[i];
+
+		if (!track)
+		{
+			dbg_printf("empty transform track %u", i);
+			goto fail;
+		}
+
+		if (nameMember >= 0)
+			out->name = (const char*)LayoutCache_ReadPtr(&gr2->layouts, &gr2->virtual_ptr, track + layout->members[nameMember].offset);
+
+		if (!Curve_BindTrack(gr2, layout, track, "PositionCurve", 3, &out->position)
+			|| !Curve_BindTrack(gr2, layout, track, "OrientationCurve", 4, &out->orientation)
+			|| !Curve_BindTrack(gr2, layout, track, "ScaleShearCurve", 9, &out->scaleShear))
+		{
+			dbg_printf("bad curve in transform track %u", i);
+			goto fail;
+		}
+	}
+
+	return true;
+
+fail:
+	TrackGroup_Free(group);
+	return false;
+}
+
+OG_DLLAPI void TrackGroup_Free(TGr2TrackGroup* group)
+{
+	free(group->tracks);
+	memset(group, 0, sizeof(TGr2TrackGroup));
+}
+
+/*!
+	Normalizes the orientations of a pose
+	@param pose The transformations
+	@param count Number of transformations
+*/
+static void TrackGroup_Normalize(TTransformation* pose, uint32_t count)
+{
+	uint32_t i = 0;
+
+#ifdef OG_SSE2
+	/* four orientations at a time in SoA form */
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(pose[i].rotation), y = _mm_loadu_ps(pose[i + 1].rotation);
+		__m128 z = _mm_loadu_ps(pose[i + 2].rotation), w = _mm_loadu_ps(pose[i + 3].rotation);
+		__m128 length, valid;
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+		length = _mm_or_ps(_mm_and_ps(valid, _mm_sqrt_ps(length)), _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+
+		x = _mm_div_ps(x, length);
+		y = _mm_div_ps(y, length);
+		z = _mm_div_ps(z, length);
+		w = _mm_div_ps(w, length);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_storeu_ps(pose[i].rotation, x);
+		_mm_storeu_ps(pose[i + 1].rotation, y);
+		_mm_storeu_ps(pose[i + 2].rotation, z);
+		_mm_storeu_ps(pose[i + 3].rotation, w);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		float* q = pose[i].rotation;
+		float length = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+
+		if (length > 0.0f)
+		{
+			length = sqrtf(length);
+
+			for (uint32_t c = 0; c < 4; c++)
+				q[c] /= length;
+		}
+	}
+}
+
+/*!
+	Samples all the tracks of a track group
+	@param group The track group
+	@param time Time of the sample
+	@param pose Output transformations
+	@param knots Cached knot intervals (three for each track) or NULL to search every knot
+*/
+static void TrackGroup_SampleKnots(const TGr2TrackGroup* group, float time, TTransformation* pose, uint32_t* knots)
+{
+	for (uint32_t i = 0; i < group->trackCount; i++)
+	{
+		const TGr2TransformTrack* track = &group->tracks[i];
+		TTransformation* out = &pose[i];
+
+		out->flags = 0;
+
+		if (track->position.format != CURVE_DAIDENTITY && track->position.knotCount)
+			out->flags |= TRANSFORM_HAS_POSITION;
+
+		if (track->orientation.format != CURVE_DAIDENTITY && track->orientation.knotCount)
+			out->flags |= TRANSFORM_HAS_ORIENTATION;
+
+		if (track->scaleShear.format != CURVE_DAIDENTITY && track->scaleShear.knotCount)
+			out->flags |= TRANSFORM_HAS_SCALESHEAR;
+
+		if (knots)
+		{
+			uint32_t* cached = knots + (size_t)i * 3;
+
+			Curve_Evaluate(&track->position, Curve_AdvanceKnot(&track->position, &cached[0], time), time, out->translation, false);
+			Curve_Evaluate(&track->orientation, Curve_AdvanceKnot(&track->orientation, &cached[1], time), time, out->rotation, true);
+			Curve_Evaluate(&track->scaleShear, Curve_AdvanceKnot(&track->scaleShear, &cached[2], time), time, &out->scaleShear[0][0], false);
+		}
+		else
+		{
+			Curve_Evaluate(&track->position, Curve_FindKnot(&track->position, time), time, out->translation, false);
+			Curve_Evaluate(&track->orientation, Curve_FindKnot(&track->orientation, time), time, out->rotation, true);
+			Curve_Evaluate(&track->scaleShear, Curve_FindKnot(&track->scaleShear, time), time, &out->scaleShear[0][0], false);
+		}
+	}
+
+	TrackGroup_Normalize(pose, group->trackCount);
+}
+
+OG_DLLAPI void TrackGroup_Sample(const TGr2TrackGroup* group, float time, TTransformation* pose)
+{
+	TrackGroup_SampleKnots(group, time, pose, NULL);
+}
+
+OG_DLLAPI bool TrackCursor_Init(TGr2TrackCursor* cursor, const TGr2TrackGroup* group)
+{
+	cursor->group = group;
+	cursor->knots = (uint32_t*)calloc((size_t)group->trackCount * 3 + 1, sizeof(uint32_t));
+
+	return cursor->knots != NULL;
+}
+
+OG_DLLAPI void TrackCursor_Free(TGr2TrackCursor* cursor)
+{
+	free(cursor->knots);
+	cursor->knots = NULL;
+	cursor->group = NULL;
+}
+
+OG_DLLAPI void TrackCursor_Sample(TGr2TrackCursor* cursor, float time, TTransformation* pose)
+{
+	TrackGroup_SampleKnots(cursor->group, time, pose, cursor->knots);
+}
@@ -0,0 +1,173 @@
+/*!
+	Project: libopengrn
+	File: curve.h
+	Animation curve decoding and sampling
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Packed curve formats (Format of the CurveDataHeader)
+*/
+enum ECurveFormats
+{
+	CURVE_DAKEYFRAMES32F = 0,
+	CURVE_DAK32FC32F = 1,
+	CURVE_DAIDENTITY = 2,
+	CURVE_DACONSTANT32F = 3,
+	CURVE_D3CONSTANT32F = 4,
+	CURVE_D4CONSTANT32F = 5,
+	CURVE_DAK16UC16U = 6,
+	CURVE_DAK8UC8U = 7,
+	CURVE_D4NK16UC15U = 8,
+	CURVE_D4NK8UC7U = 9,
+	CURVE_D3K16UC16U = 10,
+	CURVE_D3K8UC8U = 11,
+	CURVE_D9I1K16UC16U = 12,
+	CURVE_D9I3K16UC16U = 13,
+	CURVE_D9I1K8UC8U = 14,
+	CURVE_D9I3K8UC8U = 15,
+	CURVE_D3I1K32FC32F = 16,
+	CURVE_D3I1K16UC16U = 17,
+	CURVE_D3I1K8UC8U = 18,
+	CURVE_FORMAT_COUNT,
+};
+
+/*!
+	A curve bound to it's packed data inside the file, nothing is decoded in advance
+*/
+typedef struct SGr2Curve
+{
+	uint8_t format; /* one of ECurveFormats */
+	uint8_t degree; /* degree of the curve */
+	uint16_t selector; /* scale/offset table entries of the D4n formats */
+	uint32_t dimension; /* number of floats of a sampled value */
+	uint32_t components; /* number of packed values of each control */
+	uint32_t knotCount; /* number of knots (and controls) */
+	const uint8_t* knots; /* packed knots, NULL when the knots are the control indices */
+	const uint8_t* controls; /* packed controls */
+	const float* scales; /* dequantization scale of each component, NULL if the controls are not quantized */
+	const float* offsets; /* dequantization offset of each component */
+	float knotScale; /* multiplier from packed knots to time */
+} TGr2Curve;
+
+/*!
+	Transformation curves of a bone
+*/
+typedef struct SGr2TransformTrack
+{
+	const char* name; /* name of the bone */
+	TGr2Curve position; /* translation curve (3 floats) */
+	TGr2Curve orientation; /* rotation curve (4 floats, X,Y,Z,W quaternion) */
+	TGr2Curve scaleShear; /* scale/shear curve (9 floats, 3x3 matrix) */
+} TGr2TransformTrack;
+
+/*!
+	Transform tracks of a track group
+*/
+typedef struct SGr2TrackGroup
+{
+	const char* name; /* name of the track group */
+	uint32_t trackCount; /* number of tracks */
+	TGr2TransformTrack* tracks; /* transform tracks in file order */
+} TGr2TrackGroup;
+
+/*!
+	Sampling state of a track group, caches the knot interval of every curve so
+	sampling at increasing times doesn't search the knots again
+*/
+typedef struct SGr2TrackCursor
+{
+	const TGr2TrackGroup* group; /* the sampled track group */
+	uint32_t* knots; /* last knot interval of the position, orientation and scale/shear curves of each track */
+} TGr2TrackCursor;
+
+/*!
+	Binds a curve to it's packed data
+	@param gr2 The Gr2 structure that contains the curve
+	@param elem The CurveData element of the curve (e.g. "TransformTracks[0].PositionCurve.CurveData")
+	@param curve Output curve
+	@return true if the curve was bound, false if the format is unknown, the degree is above 3 or the data is malformed
+*/
+extern OG_DLLAPI bool Gr2_GetCurve(TGr2* gr2, const TElementGeneric* elem, TGr2Curve* curve);
+
+/*!
+	Samples a curve
+	@param curve The curve
+	@param time Time of the sample, clamped to the first and the last knot
+	@param out Output value (curve->dimension floats)
+	@note Degree 0 curves are stepped, degrees 1 to 3 are evaluated as B-splines (degree 1 is the linear interpolation of the knots)
+*/
+extern OG_DLLAPI void Curve_Sample(const TGr2Curve* curve, float time, float* out);
+
+/*!
+	Samples a curve starting the knot search from a cached knot interval
+	@param curve The curve
+	@param knot Cached knot interval (0 for the first sample), updated with the interval of the time
+	@param time Time of the sample (see Curve_Sample)
+	@param out Output value (curve->dimension floats)
+	@note Moving forward by a few knots is O(1), seeking falls back to a binary search
+*/
+extern OG_DLLAPI void Curve_SampleCursor(const TGr2Curve* curve, uint32_t* knot, float time, float* out);
+
+/*!
+	Extracts the transform tracks of a track group
+	@param gr2 The Gr2 structure that contains the track group
+	@param elem Element that contains the track group (e.g. "Animations[0].TrackGroups")
+	@param index Index of the track group inside the element (0 for references)
+	@param group Output track group, must be freed with TrackGroup_Free
+	@return true if the track group was extracted, otherwise false
+	@note The curves are read from the file data, with GR2_LOAD_LAZY they don't need to be expanded
+*/
+extern OG_DLLAPI bool Gr2_GetTrackGroup(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2TrackGroup* group);
+
+/*!
+	Frees the tracks of a track group
+	@param group The track group to free
+*/
+extern OG_DLLAPI void TrackGroup_Free(TGr2TrackGroup* group);
+
+/*!
+	Samples all the tracks of a track group
+	@param group The track group
+	@param time Time of the sample
+	@param pose Output transformations (one for each track), ready for Transform_BuildMatrices4x4
+	@note The orientations are normalized four tracks at a time, identity curves clear the flag of their part
+*/
+extern OG_DLLAPI void TrackGroup_Sample(const TGr2TrackGroup* group, float time, TTransformation* pose);
+
+/*!
+	Initializes a sampling cursor of a track group
+	@param cursor The cursor to initialize, must be freed with TrackCursor_Free
+	@param group The track group, must stay valid while the cursor is used
+	@return true if the cursor was initialized, otherwise false
+*/
+extern OG_DLLAPI bool TrackCursor_Init(TGr2TrackCursor* cursor, const TGr2TrackGroup* group);
+
+/*!
+	Frees a sampling cursor
+	@param cursor The cursor to free
+*/
+extern OG_DLLAPI void TrackCursor_Free(TGr2TrackCursor* cursor);
+
+/*!
+	Samples all the tracks of a track group from the knot intervals of the previous sample
+	@param cursor The cursor
+	@param time Time of the sample
+	@param pose Output transformations (see TrackGroup_Sample)
+	@note The result is the same as TrackGroup_Sample, a cursor must not be shared between threads
+*/
+extern OG_DLLAPI void TrackCursor_Sample(TGr2TrackCursor* cursor, float time, TTransformation* pose);
+
+#ifdef __cplusplus
+}
+#endif
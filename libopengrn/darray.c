@@ -78,11 +78,20 @@ bool OG_DLLAPI DArray_Add(TDArray* a, void* element)
 
 	if ((a->count + 1) > a->reserved)
 	{
-		if (!DArray_Resize(a, a->count + 1))
+		if (!DArray_Resize(a, a->reserved * 2))
 			return false;
 	}
 
 	memcpy(a->data + (a->count * a->elementSize), element, a->elementSize);
 	a->count++;
 	return true;
-}
\ No newline at end of file
+}
+
+bool OG_DLLAPI DArray_Pop(TDArray* a)
+{
+	if (!a->count)
+		return false;
+
+	a->count--;
+	return true;
+}
@@ -35,6 +35,8 @@ extern OG_DLLAPI bool DArray_Add(TDArray *a, void *element);
 
 extern OG_DLLAPI void *DArray_Get(TDArray *a, size_t idx);
 
+extern OG_DLLAPI bool DArray_Pop(TDArray *a);
+
 #ifdef __cplusplus
 }
 #endif
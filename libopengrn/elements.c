@@ -75,7 +75,7 @@ void OG_DLLAPI Element_Free(TElementGeneric** elem)
 }
 
 
-TElementGeneric* Element_CreateFromTypeInfo(TDArray* vptr, TNodeTypeInfo* info)
+TElementGeneric* Element_CreateFromTypeInfo(TVirtualPtrTable* vptr, TNodeTypeInfo* info)
 {
 	TElementGeneric* elem;
 
@@ -175,6 +175,9 @@ TElementGeneric* Element_CreateFromTypeInfo(TDArray* vptr, TNodeTypeInfo* info)
 		return NULL;
 
 	elem->rawInfo = *info;
+	elem->member = NULL;
+	elem->data = NULL;
+	elem->expanded = true;
 
 	if (info->nameOffset)
 		elem->name = decode_ptr(vptr, info->nameOffset);
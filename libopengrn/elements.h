@@ -11,6 +11,8 @@
 
 #include "darray.h"
 #include "structures.h"
+#include "layout.h"
+#include "typeinfo.h"
 
 /*!
 	Gr2 generic element
@@ -21,6 +23,9 @@ typedef struct SElementGeneric
 	const char* name; //! Node name
 	TDArray children; //! Dynamic array that stores the pointers of the children
 	uint32_t size; /// Size of the element array (which is also used in the number of array elements), in case of string this will determine the length
+	const TTypeMember* member; //! Compiled member of the element, NULL if the element was not loaded from a file
+	const uint8_t* data; //! Pointer to the data of the element inside the file data
+	bool expanded; //! false if the children were not parsed yet (see Element_GetChildren)
 } TElementGeneric;
 
 /*!
@@ -123,7 +128,44 @@ typedef struct SElementArray
 	void** data;
 } TElementArray;
 
-extern TElementGeneric* Element_CreateFromTypeInfo(TDArray* vptr, TNodeTypeInfo* info);
-extern bool Element_Parse(TDArray* vptr, const uint8_t* type, const uint8_t* data, bool is64, TDArray* global, TElementGeneric* parent, uint64_t* rootOffset);
+/*!
+	Element parsers of 32-bit files indexed by type id
+*/
+extern const TElementParseFunc ELEMENT_PARSE_32[TYPEID_MAX];
+
+/*!
+	Element parsers of 64-bit files indexed by type id
+*/
+extern const TElementParseFunc ELEMENT_PARSE_64[TYPEID_MAX];
+
+extern TElementGeneric* Element_CreateFromTypeInfo(TVirtualPtrTable* vptr, TNodeTypeInfo* info);
+/*!
+	Parses the structures of a layout into elements
+	@param vptr Virtual pointer table
+	@param cache Compiled layout cache
+	@param layout Layout of the structure to parse
+	@param data Data of the structure to parse
+	@param global Array that receives all the parsed elements
+	@param parent Element that receives the parsed members
+	@param maxDepth Maximum nesting of references, arrays and inline members (at least 1)
+	@param lazy Set this to true to parse only the members of the structure, the children of the
+		members are parsed with Element_Expand
+	@return true if the parsing succeeded, otherwise false and the parent and global array are left as they were
+	@note The parser uses an heap allocated work stack, so it's safe to run on threads with a small stack
+*/
+extern bool Element_Parse(TVirtualPtrTable* vptr, TLayoutCache* cache, const TTypeLayout* layout, const uint8_t* data, TDArray* global, TElementGeneric* parent, uint32_t maxDepth, bool lazy);
+
+/*!
+	Parses the children of an element that was loaded lazily
+	@param vptr Virtual pointer table
+	@param cache Compiled layout cache
+	@param elem The element to expand
+	@param global Array that receives all the parsed elements
+	@param maxDepth Maximum nesting of references, arrays and inline members
+	@param lazy Set this to true to parse only the direct children of the element
+	@return true if the parsing succeeded (or the element was already expanded), otherwise false and
+		the element is left unexpanded, without the children and the entries of global parsed so far
+*/
+extern bool Element_Expand(TVirtualPtrTable* vptr, TLayoutCache* cache, TElementGeneric* elem, TDArray* global, uint32_t maxDepth, bool lazy);
 extern void Element_Free(TElementGeneric** elem);
 extern bool Element_New(uint32_t type, const char* name, TElementGeneric** out);
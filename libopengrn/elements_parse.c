@@ -14,279 +14,344 @@
 
 #include <stdlib.h>
 
-#define TYPE_ELEMENT(type, ctype) ((type*)elem)->value = (ctype*)(data + ofs); \
-								  ofs += sizeof(ctype) * elem->size;
+/*!
+	Defines a parser for a primitive element, the value points directly to the data
+	@param name Name of the parser
+	@param type Element structure
+	@param ctype Type of the value
+*/
+#define TYPE_ELEMENT(name, type, ctype) \
+	static bool Element_Parse##name(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data) \
+	{ \
+		(void)vptr; \
+		((type*)elem)->value = (ctype*)data; \
+		return true; \
+	}
 
-bool Element_ParsePrimitive(TDArray* vptr, TElementGeneric* elem, const uint8_t* data, uint64_t* offset, bool b64)
+TYPE_ELEMENT(Int8, TElementInt8, int8_t)
+TYPE_ELEMENT(Uint8, TElementUint8, uint8_t)
+TYPE_ELEMENT(Int16, TElementInt16, int16_t)
+TYPE_ELEMENT(Uint16, TElementUint16, uint16_t)
+TYPE_ELEMENT(Int32, TElementInt32, int32_t)
+TYPE_ELEMENT(Uint32, TElementUint32, uint32_t)
+TYPE_ELEMENT(Float, TElementFloat, float)
+TYPE_ELEMENT(Transform, TElementTransform, TTransformation)
+
+static bool Element_ParseNone(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
 {
-	uint32_t ofs = *offset;
+	(void)vptr;
+	(void)elem;
+	(void)data;
+	return true;
+}
+
+#define ELEMENT_BITS 32
+#include "elements_parse_bits.h"
+#undef ELEMENT_BITS
+
+#define ELEMENT_BITS 64
+#include "elements_parse_bits.h"
+#undef ELEMENT_BITS
+
+/*!
+	A pending list of structures on the parse work stack
+*/
+typedef struct SParseFrame
+{
+	const TTypeLayout* layout; /* layout of the structures */
+	const uint8_t* base; /* first structure, or array of pointers when references is true */
+	TElementGeneric* elem; /* element that receives the parsed members */
+	uint32_t count; /* number of structures to parse */
+	uint32_t index; /* structure being parsed */
+	uint32_t member; /* next member of the structure to parse */
+	bool references; /* base is an array of pointers to the structures */
+} TParseFrame;
+
+/*!
+	Gets the structures that contains the children of an element
+	@param vptr Virtual pointer table
+	@param cache Compiled layout cache
+	@param member Compiled member of the element
+	@param elem The element that contains the children
+	@param data Pointer to the data of the element
+	@param frame Output frame that describes the children
+	@return true if the children were resolved, otherwise false (frame->count is 0 if the element has no children)
+*/
+static bool Element_GetChildFrame(TVirtualPtrTable* vptr, TLayoutCache* cache, const TTypeMember* member, TElementGeneric* elem, const uint8_t* data, TParseFrame* frame)
+{
+	TElementArray* ref = (TElementArray*)elem;
+	const uint8_t* type = member->childType;
+
+	frame->elem = elem;
+	frame->count = 0;
+	frame->index = 0;
+	frame->member = 0;
+	frame->references = false;
+	frame->layout = NULL;
+	frame->base = NULL;
 
 	switch (elem->rawInfo.type)
 	{
-	default:
-		dbg_printf("unknown type: %d\n", elem->rawInfo.type);
-		break;
-
 	case TYPEID_INLINE: // 1
-	case TYPEID_NONE: // 0
+		frame->layout = member->inlineLayout;
+		frame->base = data;
+		frame->count = member->count;
 		return true;
 
-	case TYPEID_INT16: // 15
-	case TYPEID_BINORMALINT16: // 17
-		TYPE_ELEMENT(TElementInt16, int16_t);
+	case TYPEID_REFERENCE: // 2
+		frame->base = (const uint8_t*)((TElementReference*)elem)->reference;
+		frame->count = 1;
 		break;
 
-	case TYPEID_UINT16: // 16
-	case TYPEID_NORMALUINT16: // 18
-	case TYPEID_REAL16: // 21
-		TYPE_ELEMENT(TElementUint16, uint16_t);
+	case TYPEID_VARIANTREFERENCE: // 5
+		/* the type of a variant is stored inside the data */
+		type = ref->offset ? decode_ptr(vptr, ref->offset) : NULL;
+		frame->base = (const uint8_t*)ref->data;
+		frame->count = 1;
 		break;
 
-	case TYPEID_INT32: // 19
-		TYPE_ELEMENT(TElementInt32, int32_t);
+	case TYPEID_REFERENCETOVARIANTARRAY: // 7
+		type = ref->offset ? decode_ptr(vptr, ref->offset) : NULL;
+		/* fallthrough */
+	case TYPEID_REFERENCETOARRAY: // 3
+		frame->base = (const uint8_t*)ref->data;
+		frame->count = ref->base.size;
 		break;
 
-	case TYPEID_UINT32: // 20
-		TYPE_ELEMENT(TElementUint32, uint32_t);
+	case TYPEID_ARRAYOFREFERENCES: // 4
+		frame->base = (const uint8_t*)ref->data;
+		frame->count = ref->base.size;
+		frame->references = true;
 		break;
 
-	case TYPEID_INT8: // 11
-	case TYPEID_BINORMALINT8: // 13
-		TYPE_ELEMENT(TElementInt8, int8_t);
-		break;
+	default:
+		return true;
+	}
 
-	case TYPEID_UINT8: // 12
-	case TYPEID_NORMALUINT8: // 14
-		TYPE_ELEMENT(TElementUint8, uint8_t);
-		break;
+	if (!frame->base || !type || !frame->count)
+	{
+		frame->count = 0;
+		return true;
+	}
 
-	case TYPEID_REAL32: // 10
-		TYPE_ELEMENT(TElementFloat, float);
-		break;
+	frame->layout = LayoutCache_Get(cache, vptr, type);
+	return frame->layout != NULL;
+}
 
-	case TYPEID_TRANSFORM: // 9
-		TYPE_ELEMENT(TElementTransform, TTransformation);
-		break;
+/*!
+	Attaches a parsed element to it's parent
+	@param global Array that contains all the parsed elements
+	@param parent The parent element
+	@param elem The element to attach
+	@return true if the element was attached, otherwise false
+*/
+static bool Element_Attach(TDArray* global, TElementGeneric* parent, TElementGeneric* elem)
+{
+	// global element array, to get all elements via a list
+	if (!DArray_Add(global, &elem))
+		return false;
 
-	case TYPEID_REFERENCE: // 2
-	case TYPEID_EMPTYREFERENCE: // 22
-		if (b64)
-		{
-			((TElementReference*)elem)->reference = decode_ptr(vptr, *(uint64_t*)(data + ofs));
-			ofs += 8;
-		}
-		else
-		{
-			((TElementReference*)elem)->reference = decode_ptr(vptr , *(uint32_t*)(data + ofs));
-			ofs += 4;
-		}
+	return DArray_Add(&parent->children, &elem);
+}
 
-		break;
+/*!
+	Parses the structures of a frame into elements
+	@param vptr Virtual pointer table
+	@param cache Compiled layout cache
+	@param first The structures to parse
+	@param global Array that receives all the parsed elements
+	@param maxDepth Maximum nesting of the parsing
+	@param lazy Set this to true to parse only the members of the structures, without their children
+	@return true if the parsing succeeded, otherwise false
+*/
+static bool Element_ParseFrame(TVirtualPtrTable* vptr, TLayoutCache* cache, const TParseFrame* first, TDArray* global, uint32_t maxDepth, bool lazy)
+{
+	TDArray stack;
+	TParseFrame frame, *top;
+	TElementGeneric* newElement;
+	size_t globalCount = global->count, childCount = first->elem->children.count;
+	bool success = false;
 
-	case TYPEID_STRING: // 8
+	dbg_printf("enter element parse %p %p parent %s", first->layout->type, first->base, first->elem->name);
+
+	if (!maxDepth)
 	{
-		char* ptr;
+		dbg_printf("maximum parse depth is 0");
+		return false;
+	}
 
-		if (b64)
-		{
-			((TElementString*)elem)->value = (char*)decode_ptr(vptr, *(uint64_t*)(data + ofs));
-			ofs += 8;
-		}
-		else
-		{
-			((TElementString*)elem)->value = (char*)decode_ptr(vptr, *(uint32_t*)(data + ofs));
-			ofs += 4;
-		}
+	if (!DArray_Init(&stack, sizeof(TParseFrame), maxDepth < 16 ? maxDepth : 16))
+		return false;
 
-		break;
-	}
+	if (!DArray_Add(&stack, (void*)first))
+		goto end;
 
-	case TYPEID_REFERENCETOARRAY: // 3
-		elem->size = *(uint32_t*)(data + ofs);
-		ofs += 4;
+	while (stack.count)
+	{
+		const TTypeMember* member;
+		const uint8_t* current;
 
-		if (b64)
+		top = (TParseFrame*)DArray_Get(&stack, stack.count - 1);
+
+		if (top->member == top->layout->count)
 		{
-			((TElementArray*)elem)->data = decode_ptr(vptr, *(uint64_t*)(data + ofs));
-			ofs += 8;
+			top->member = 0;
+			top->index++;
 		}
-		else
+
+		if (top->index == top->count)
 		{
-			((TElementArray*)elem)->data = decode_ptr(vptr , *(uint32_t*)(data + ofs));
-			ofs += 4;
-		}
+			/* all the structures are parsed, the element can be attached to it's parent */
+			newElement = top->elem;
+			DArray_Pop(&stack);
 
-		break;
+			if (stack.count)
+			{
+				top = (TParseFrame*)DArray_Get(&stack, stack.count - 1);
 
-	case TYPEID_REFERENCETOVARIANTARRAY: // 7
-		if (b64)
-		{
-			((TElementArray*)elem)->offset = *(uint64_t*)(data + ofs);
-			ofs += 8;
-			elem->size = *(uint32_t*)(data + ofs);
-			ofs += 4;
-			((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(uint64_t*)(data + ofs));;
-			ofs += 8;
-		}
-		else
-		{
-			((TElementArray*)elem)->offset = *(uint32_t*)(data + ofs);
-			ofs += 4;
-			elem->size = *(uint32_t*)(data + ofs);
-			ofs += 4;
-			((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(uint32_t*)(data + ofs));
-			ofs += 4;
-		}
+				if (!Element_Attach(global, top->elem, newElement))
+				{
+					Element_Free(&newElement);
+					goto end;
+				}
+			}
 
-		break;
+			continue;
+		}
 
-	case TYPEID_VARIANTREFERENCE: // 5
-		if (b64)
+		if (top->references)
 		{
-			((TElementArray*)elem)->offset = *(uint64_t*)(data + ofs);
-			ofs += 8;
-			((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(uint64_t*)(data + ofs));
-			ofs += 8;
+			current = ((const uint8_t* const*)top->base)[top->index];
+
+			if (!current)
+			{
+				top->member = top->layout->count;
+				continue;
+			}
 		}
 		else
-		{
-			((TElementArray*)elem)->offset = *(uint32_t*)(data + ofs);
-			ofs += 4;
-			((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(uint32_t*)(data + ofs));
-			ofs += 4;
-		}
+			current = top->base + (top->index * top->layout->stride);
 
-		break;
+		member = &top->layout->members[top->member++];
 
-	case TYPEID_ARRAYOFREFERENCES: // 4
-		elem->size = *(uint32_t*)(data + ofs);
-		ofs += 4;
+		newElement = Element_CreateFromTypeInfo(vptr, (TNodeTypeInfo*)&member->info);
+		if (!newElement)
+			goto end;
 
-        ((TElementArray*)elem)->data = malloc(sizeof(void*) * elem->size);
+		newElement->member = member;
+		newElement->data = current + member->offset;
 
-		if (b64)
+		if (!member->parse(vptr, newElement, newElement->data))
 		{
-			((TElementArray*)elem)->offset = (uint64_t)decode_ptr(vptr, *(uint64_t*)(data + ofs));
-			ofs += 8;
-		}
-		else
-		{
-			((TElementArray*)elem)->offset = (uint64_t)decode_ptr(vptr, *(uint32_t*)(data + ofs));
-			ofs += 4;
+			dbg_printf("cannot parse element %p %p %zu", top->layout->type, current, member->info.nameOffset);
+			Element_Free(&newElement);
+			goto end;
 		}
 
-		for (uint32_t i = 0; i < elem->size; i++)
-		{
-			TElementArray* e2 = (TElementArray*)elem;
+#ifdef _DEBUG
+		dbg_printf2("parsed %s type %u offset %u datasize %u values", newElement->name, member->info.type, member->offset, newElement->size);
+		dbg_printelement(newElement);
+		dbg_printf3("\n");
+#endif // _DEBUG
 
-			if (b64)
+		if (member->recurse && lazy)
+			newElement->expanded = false; /* parsed on the first access (see Element_Expand) */
+		else if (member->recurse)
+		{
+			if (!Element_GetChildFrame(vptr, cache, member, newElement, newElement->data, &frame))
 			{
-				((TElementArray*)e2)->data[i] = decode_ptr(vptr, *(uint64_t*)(e2->offset + (i * 8)));
+				Element_Free(&newElement);
+				goto end;
 			}
-			else
+
+			if (frame.count)
 			{
-				((TElementArray*)e2)->data[i] = decode_ptr(vptr, *(uint32_t*)(e2->offset + (i*4)));
+				if (stack.count >= maxDepth)
+				{
+					dbg_printf("maximum parse depth %u reached", maxDepth);
+					Element_Free(&newElement);
+					goto end;
+				}
+
+				/* the element is attached once all it's children are parsed */
+				if (!DArray_Add(&stack, &frame))
+				{
+					Element_Free(&newElement);
+					goto end;
+				}
+
+				continue;
 			}
 		}
 
-		break;
+		if (!Element_Attach(global, top->elem, newElement))
+		{
+			Element_Free(&newElement);
+			goto end;
+		}
 	}
 
-	*offset = ofs;
-	return true;
-}
-
+	success = true;
 
-static bool Element_ParseNode(TDArray* vptr, TElementGeneric* elem, bool is64, TDArray* global, const uint8_t* data, uint64_t* rootOffset)
-{
-	// Parse current element
-	uint64_t newRootOffset = 0;
-	const uint8_t* typeRoot = (uint8_t*)decode_ptr(vptr, elem->rawInfo.childrenOffset);
-
-	if (!typeRoot)
-		return true;
-
-	if (elem->rawInfo.type == TYPEID_REFERENCE || elem->rawInfo.type == TYPEID_EMPTYREFERENCE || elem->rawInfo.type == TYPEID_VARIANTREFERENCE)
+end:
+	if (!success)
 	{
-		TElementReference* ref = (TElementReference*)elem;
-		if (!ref->reference)
-			return true;
+		/* the global array must not keep the elements freed below, the parent gets back it's children */
+		global->count = globalCount;
 
-		return Element_Parse(vptr, typeRoot, (const uint8_t*)ref->reference + ref->offset, is64, global, elem, &newRootOffset);
-	}
-	else if (elem->rawInfo.type == TYPEID_REFERENCETOARRAY || elem->rawInfo.type == TYPEID_REFERENCETOVARIANTARRAY)
-	{
-		TElementArray* ref = (TElementArray*)elem;
+		for (size_t i = childCount; i < first->elem->children.count; i++)
+			Element_Free((TElementGeneric**)DArray_Get(&first->elem->children, i));
 
-		for (uint32_t i = 0; i < ref->base.size; i++)
-		{
-			if(!Element_Parse(vptr, typeRoot, (const uint8_t *) ref->data + ref->offset, is64, global, elem, &newRootOffset))
-				return false;
-		}
+		first->elem->children.count = childCount;
 	}
-	else if (elem->rawInfo.type == TYPEID_ARRAYOFREFERENCES)
-	{
-		TElementArray* ref = (TElementArray*)elem;
-
-		for (uint32_t i = 0; i < ref->base.size; i++)
-		{
-			newRootOffset = 0;
 
-			if (!ref->data[i])
-				return true;
-
-			if (!Element_Parse(vptr, typeRoot, (const uint8_t*)ref->data[i], is64, global, elem, &newRootOffset))
-				return false;
-		}
-	}
-	else if (elem->rawInfo.type == TYPEID_INLINE)
+	/* free the elements that were not attached yet, the first frame is the caller's parent */
+	while (stack.count > 1)
 	{
-		return Element_Parse(vptr, typeRoot, data, is64, global, elem, rootOffset);
+		top = (TParseFrame*)DArray_Get(&stack, stack.count - 1);
+		Element_Free(&top->elem);
+		DArray_Pop(&stack);
 	}
 
-	return true;
+	DArray_Free(&stack);
+	return success;
 }
 
-bool Element_Parse(TDArray* vptr, const uint8_t* type, const uint8_t* data, bool is64, TDArray* global, TElementGeneric* parent, uint64_t* rootOffset)
+bool Element_Parse(TVirtualPtrTable* vptr, TLayoutCache* cache, const TTypeLayout* layout, const uint8_t* data, TDArray* global, TElementGeneric* parent, uint32_t maxDepth, bool lazy)
 {
-	uint64_t offset = 0;
-	TNodeTypeInfo elem;
-	TElementGeneric* newElement;
+	TParseFrame frame;
 
-	dbg_printf("enter element parse %p %p parent %s", type, data, parent->name);
+	frame.layout = layout;
+	frame.base = data;
+	frame.elem = parent;
+	frame.count = 1;
+	frame.index = 0;
+	frame.member = 0;
+	frame.references = false;
 
-	while (TypeInfo_Parse(type, &elem, is64, &offset))
-	{
+	return Element_ParseFrame(vptr, cache, &frame, global, maxDepth, lazy);
+}
 
-		newElement = Element_CreateFromTypeInfo(vptr, &elem);
-		if (!newElement)
-			return false;
+bool Element_Expand(TVirtualPtrTable* vptr, TLayoutCache* cache, TElementGeneric* elem, TDArray* global, uint32_t maxDepth, bool lazy)
+{
+	TParseFrame frame;
 
-		if (!Element_ParsePrimitive(vptr, newElement, data, rootOffset, is64))
-		{
-			dbg_printf("cannot parse element %p %p %zu", type, data, elem.nameOffset);
-			Element_Free(&newElement);
-			return false;
-		}
+	if (elem->expanded)
+		return true;
 
-#ifdef _DEBUG
-		dbg_printf2("parsed %s type %u offset %I64u root %I64u datasize %u values", newElement->name, elem.type, offset, *rootOffset, newElement->size);
-		dbg_printelement(newElement);
-		dbg_printf3("\n");
-#endif // _DEBUG
+	if (!elem->member || !Element_GetChildFrame(vptr, cache, elem->member, elem, elem->data, &frame))
+		return false;
 
-		if (elem.type >= TYPEID_INLINE && elem.type <= TYPEID_REFERENCETOVARIANTARRAY && elem.type != TYPEID_REMOVED)
-		{
-			if (!Element_ParseNode(vptr, newElement, is64, global, data, rootOffset))
-				return false;
-		}
+	elem->expanded = true;
 
-		// global element array, to get all elements via a list
-		if (!DArray_Add(global, &newElement))
-			return false;
+	if (!frame.count)
+		return true;
 
-		if (!DArray_Add(&parent->children, &newElement))
-			return false;
+	if (!Element_ParseFrame(vptr, cache, &frame, global, maxDepth, lazy))
+	{
+		/* the parser took the new children out of global and the element, it can be expanded again */
+		elem->expanded = false;
+		return false;
 	}
 
 	return true;
@@ -0,0 +1,111 @@
+/*!
+	Project: libopengrn
+	File: elements_parse_bits.h
+	Pointer size specialized element parsers
+
+	This file is included by elements_parse.c once for every pointer size,
+	ELEMENT_BITS must be defined to 32 or 64 before the inclusion
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#if ELEMENT_BITS == 64
+#define ELEMENT_PTR uint64_t
+#else
+#define ELEMENT_PTR uint32_t
+#endif
+
+#define ELEMENT_FUNC_NAME2(name, bits) name##bits
+#define ELEMENT_FUNC_NAME(name, bits) ELEMENT_FUNC_NAME2(name, bits)
+#define ELEMENT_FUNC(name) ELEMENT_FUNC_NAME(name, ELEMENT_BITS)
+
+static bool ELEMENT_FUNC(Element_ParseReference)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	((TElementReference*)elem)->reference = decode_ptr(vptr, *(ELEMENT_PTR*)data);
+	return true;
+}
+
+static bool ELEMENT_FUNC(Element_ParseString)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	((TElementString*)elem)->value = (char*)decode_ptr(vptr, *(ELEMENT_PTR*)data);
+	return true;
+}
+
+static bool ELEMENT_FUNC(Element_ParseReferenceToArray)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	elem->size = *(uint32_t*)data;
+	((TElementArray*)elem)->data = decode_ptr(vptr, *(ELEMENT_PTR*)(data + 4));
+	return true;
+}
+
+static bool ELEMENT_FUNC(Element_ParseReferenceToVariantArray)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	((TElementArray*)elem)->offset = *(ELEMENT_PTR*)data;
+	elem->size = *(uint32_t*)(data + sizeof(ELEMENT_PTR));
+	((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(ELEMENT_PTR*)(data + sizeof(ELEMENT_PTR) + 4));
+	return true;
+}
+
+static bool ELEMENT_FUNC(Element_ParseVariantReference)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	((TElementArray*)elem)->offset = *(ELEMENT_PTR*)data;
+	((TElementArray*)elem)->data = (void**)decode_ptr(vptr, *(ELEMENT_PTR*)(data + sizeof(ELEMENT_PTR)));
+	return true;
+}
+
+static bool ELEMENT_FUNC(Element_ParseArrayOfReferences)(TVirtualPtrTable* vptr, TElementGeneric* elem, const uint8_t* data)
+{
+	TElementArray* e2 = (TElementArray*)elem;
+	const ELEMENT_PTR* refs;
+
+	elem->size = *(uint32_t*)data;
+	e2->data = malloc(sizeof(void*) * (elem->size ? elem->size : 1));
+
+	if (!e2->data)
+		return false;
+
+	e2->offset = (uint64_t)decode_ptr(vptr, *(ELEMENT_PTR*)(data + 4));
+	refs = (const ELEMENT_PTR*)e2->offset;
+
+	for (uint32_t i = 0; i < elem->size; i++)
+		e2->data[i] = refs ? decode_ptr(vptr, refs[i]) : NULL;
+
+	return true;
+}
+
+/*!
+	Element parsers indexed by type id
+*/
+const TElementParseFunc ELEMENT_FUNC(ELEMENT_PARSE_)[TYPEID_MAX] =
+{
+	Element_ParseNone, // TYPEID_NONE
+	Element_ParseNone, // TYPEID_INLINE
+	ELEMENT_FUNC(Element_ParseReference), // TYPEID_REFERENCE
+	ELEMENT_FUNC(Element_ParseReferenceToArray), // TYPEID_REFERENCETOARRAY
+	ELEMENT_FUNC(Element_ParseArrayOfReferences), // TYPEID_ARRAYOFREFERENCES
+	ELEMENT_FUNC(Element_ParseVariantReference), // TYPEID_VARIANTREFERENCE
+	Element_ParseNone, // TYPEID_REMOVED
+	ELEMENT_FUNC(Element_ParseReferenceToVariantArray), // TYPEID_REFERENCETOVARIANTARRAY
+	ELEMENT_FUNC(Element_ParseString), // TYPEID_STRING
+	Element_ParseTransform, // TYPEID_TRANSFORM
+	Element_ParseFloat, // TYPEID_REAL32
+	Element_ParseInt8, // TYPEID_INT8
+	Element_ParseUint8, // TYPEID_UINT8
+	Element_ParseInt8, // TYPEID_BINORMALINT8
+	Element_ParseUint8, // TYPEID_NORMALUINT8
+	Element_ParseInt16, // TYPEID_INT16
+	Element_ParseUint16, // TYPEID_UINT16
+	Element_ParseInt16, // TYPEID_BINORMALINT16
+	Element_ParseUint16, // TYPEID_NORMALUINT16
+	Element_ParseInt32, // TYPEID_INT32
+	Element_ParseUint32, // TYPEID_UINT32
+	Element_ParseUint16, // TYPEID_REAL16
+	ELEMENT_FUNC(Element_ParseReference), // TYPEID_EMPTYREFERENCE
+};
+
+#undef ELEMENT_FUNC
+#undef ELEMENT_FUNC_NAME
+#undef ELEMENT_FUNC_NAME2
+#undef ELEMENT_PTR
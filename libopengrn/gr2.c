@@ -13,13 +13,19 @@
 #include "magic.h"
 #include "typeinfo.h"
 #include "elements.h"
+#include "platform.h"
+#include "virtual_ptr.h"
 #include <stdlib.h>
 
 OG_DLLAPI bool Gr2_Init(TGr2* gr2)
 {
 	memset(gr2, 0, sizeof(TGr2));
+	gr2->maxDepth = GR2_DEFAULT_MAX_DEPTH;
 
-	if (!DArray_Init(&gr2->virtual_ptr, sizeof(void*), 100))
+	if (!DArray_Init(&gr2->virtual_ptr.pointers, sizeof(void*), 100))
+		return false;
+
+	if (!LayoutCache_Init(&gr2->layouts))
 		return false;
 
 	if (!Element_New(TYPEID_INLINE, "Root", &gr2->root))
@@ -47,8 +53,18 @@ OG_DLLAPI void Gr2_Free(TGr2* gr2)
 
 	if (gr2->data)
 	{
-		free(gr2->data);
+		if (!gr2->externalData)
+			free(gr2->data);
+
 		gr2->data = NULL;
+		gr2->externalData = false;
+	}
+
+	if (gr2->mapping)
+	{
+		Platform_UnmapFile(gr2->mapping, gr2->mappingSize);
+		gr2->mapping = NULL;
+		gr2->mappingSize = 0;
 	}
 
 	if (gr2->sectors)
@@ -57,9 +73,19 @@ OG_DLLAPI void Gr2_Free(TGr2* gr2)
 		gr2->sectors = NULL;
 	}
 
+	if (gr2->dirtySectors)
+	{
+		free(gr2->dirtySectors);
+		gr2->dirtySectors = NULL;
+	}
+
 	gr2->dataSize = 0;
 
-	DArray_Free(&gr2->virtual_ptr);
+	DArray_Free(&gr2->virtual_ptr.pointers);
+	memset(&gr2->virtual_ptr, 0, sizeof(gr2->virtual_ptr));
+	LayoutCache_Free(&gr2->layouts);
+	HashTable_Free(&gr2->pathIndex);
+	DArray_Free(&gr2->pathEntries);
 }
 
 void OG_DLLAPI Gr2_SetDefaultInfo(TGr2* gr2, bool is64, bool isBe, uint32_t fileFormat)
@@ -98,6 +124,29 @@ void OG_DLLAPI Gr2_SetDefaultInfo(TGr2* gr2, bool is64, bool isBe, uint32_t file
 	memset(gr2->fileInfo.extra, 0, sizeof(gr2->fileInfo.extra));
 }
 
+OG_DLLAPI bool Gr2_MarkDirty(TGr2* gr2, const void* data, size_t len)
+{
+	size_t first, last;
+
+	if (!gr2->data || !gr2->dirtySectors || (const uint8_t*)data < gr2->data || (uintptr_t)data - (uintptr_t)gr2->data > gr2->dataSize ||
+		len > gr2->dataSize - ((uintptr_t)data - (uintptr_t)gr2->data))
+	{
+		dbg_printf("range %p is not inside the loaded data", data);
+		return false;
+	}
+
+	first = (const uint8_t*)data - gr2->data;
+	last = first + len;
+
+	for (uint32_t i = 0; i < gr2->fileInfo.sectorCount; i++)
+	{
+		if (first < gr2->sectorOffsets[i] + gr2->sectors[i].decompressLen && last > gr2->sectorOffsets[i])
+			gr2->dirtySectors[i] = true;
+	}
+
+	return true;
+}
+
 TElementGeneric* OG_DLLAPI Gr2_AddElement(TGr2* gr2, uint8_t type, const char* name, TElementGeneric* root)
 {
 	TElementGeneric* g;
@@ -122,3 +171,31 @@ TElementGeneric* OG_DLLAPI Gr2_AddElement(TGr2* gr2, uint8_t type, const char* n
 
 	return g;
 }
+
+OG_DLLAPI TDArray* Element_GetChildren(TGr2* gr2, TElementGeneric* elem)
+{
+	bool lazy = gr2->loadMode == GR2_LOAD_LAZY;
+
+	if (elem->expanded || !gr2->data)
+		return &elem->children;
+
+	if (elem == gr2->root)
+	{
+		const TTypeLayout* layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+
+		if (!layout)
+			return NULL;
+
+		/* on failure the root and gr2->elements are left as they were, the next call parses again */
+		if (!Element_Parse(&gr2->virtual_ptr, &gr2->layouts, layout, gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position, &gr2->elements, elem, gr2->maxDepth, lazy))
+			return NULL;
+
+		elem->expanded = true;
+		return &elem->children;
+	}
+
+	if (!Element_Expand(&gr2->virtual_ptr, &gr2->layouts, elem, &gr2->elements, gr2->maxDepth, lazy))
+		return NULL;
+
+	return &elem->children;
+}
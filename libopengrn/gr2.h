@@ -13,11 +13,58 @@
 #include "elements.h"
 #include "structures.h"
 #include "darray.h"
+#include "layout.h"
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+/*!
+	Default maximum nesting of the elements when parsing a file
+*/
+#define GR2_DEFAULT_MAX_DEPTH 128
+
+/*!
+	What Gr2_Load builds after the data is loaded
+*/
+enum EGr2LoadModes
+{
+	GR2_LOAD_ELEMENTS, /* parse the whole element tree (default) */
+	GR2_LOAD_DATA, /* only load and fix the data (see Gr2_Visit) */
+	GR2_LOAD_LAZY, /* parse only the members of the root, the other elements are parsed by Element_GetChildren */
+};
+
+/*!
+	How Gr2_Compose distributes the data between the sectors
+*/
+enum EGr2WriteLayouts
+{
+	GR2_WRITE_LAYOUT_KEEP, /* the loaded data stays in it's sector, new data goes to the first one (default) */
+	GR2_WRITE_LAYOUT_CLUSTER, /* types, strings and structures in GR2_SECTOR_METADATA, big arrays without pointers in GR2_SECTOR_BULK */
+};
+
+/*!
+	Sector of the files written with GR2_WRITE_LAYOUT_CLUSTER that holds the type tree, the strings and the
+	structures (skeletons, ArtToolInfo, mesh headers...), enough to walk the file without the bulk data
+*/
+#define GR2_SECTOR_METADATA 0
+
+/*!
+	Sector of the files written with GR2_WRITE_LAYOUT_CLUSTER that holds the vertex, index and curve arrays,
+	aligned to 16 bytes
+*/
+#define GR2_SECTOR_BULK 1
+
+/*!
+	Destination of a file written by Gr2_Compose
+*/
+typedef struct SGr2Stream
+{
+	void* context; /* user data passed to the callbacks */
+	bool (*write)(void* context, const void* data, size_t len); /* appends the bytes, returns false in case of an error */
+	bool (*seek)(void* context, uint64_t position); /* moves the write position (from the start of the file), NULL if the stream cannot seek */
+} TGr2Stream;
+
 /*!
 	The main container of all the Granny2 informations	
 */
@@ -29,12 +76,27 @@ typedef struct SGr2
 	THeader header; /* gr2 header */
 	TFileInfo fileInfo; /* gr2 file info */
 	TSector* sectors; /* gr2 sectors info */
+	bool* dirtySectors; /* sectors modified since the file was loaded or saved (see Gr2_MarkDirty) */
 
 	uint8_t* data; /* full decompressed data of the file */
 	size_t* sectorOffsets; /* offsets of gr2 sectors */
 	size_t dataSize; /* full size of the data */
+	bool externalData; /* data points inside an image (see Gr2_LoadImage) and it's not freed */
+	void* mapping; /* file mapped by Gr2_LoadImageFile, unmapped by Gr2_Free */
+	size_t mappingSize; /* length of the mapped file */
+
+	TVirtualPtrTable virtual_ptr; /* virtual pointers of the data */
+	TLayoutCache layouts; /* compiled layouts of the type nodes */
+	THashTable pathIndex; /* path hash -> entry of pathEntries + 1, empty until Gr2_BuildIndex is called */
+	TDArray pathEntries; /* indexed elements with their container, to check the full path of a hash hit */
 
-	TDArray virtual_ptr; /* virtual pointer array node */
+	uint32_t maxDepth; /* maximum nesting of the elements when parsing (GR2_DEFAULT_MAX_DEPTH by default) */
+	uint8_t loadMode; /* what is built by Gr2_Load (one of EGr2LoadModes) */
+	bool relativePointers; /* Gr2_Load fixes the pointers up to offsets inside data instead of virtual pointers (see Gr2_Load) */
+	uint32_t writeCompression; /* compression of the sectors written by Gr2_Compose (one of ECompressionTypes, COMPRESSION_TYPE_NONE by default) */
+	uint32_t writeThreads; /* maximum number of threads that encode the sectors in Gr2_Compose, 0 for one per cpu */
+	uint8_t writeLayout; /* distribution of the data between the sectors in Gr2_Compose (one of EGr2WriteLayouts) */
+	bool writeDeduplicate; /* write identical strings, arrays and type nodes once in Gr2_Compose, the copies share them once loaded */
 
 	TElementGeneric* root; /* root element */
 	TDArray elements; /* all elements of the gr2 (sizeof(TNodeTypeInfo)) */
@@ -59,10 +121,123 @@ extern void OG_DLLAPI Gr2_Free(TGr2* gr2);
 	@param len Length of the data
 	@param gr2 The structure to store the data
 	@return true if the load succedded, otherwise false
+	@note With relativePointers the pointers of the data are the offset of the pointed data plus one
+		and there is no virtual pointer array, the data is the same in every process so it can be
+		written with Gr2_ComposeImage to a shared memory segment or file and used by many processes
+		at once with Gr2_LoadImage, which then writes nothing. The data must be smaller than 4 GB
 */
 extern bool OG_DLLAPI Gr2_Load(const uint8_t* src, size_t len, TGr2* gr2);
 
-extern bool OG_DLLAPI Gr2_Compose(TGr2* gr2);
+/*!
+	Writes the data of a Gr2 structure as a Granny2 file
+
+	The structures, arrays, strings and type nodes reachable from the root and type references of
+	the file info are laid out in one walk, then the sectors and their fixup tables are streamed
+	from the data without building the image of the file; the CRC32 is computed while writing.
+	Data shared by more pointers is written once (identical data too with writeDeduplicate),
+	objects keep the sector they were loaded from (new buffers go in the first sector) unless
+	writeLayout clusters them, and the byte order is the one of the platform
+	@param gr2 The Gr2 structure to write, only the data is used so it can be loaded with any mode
+	@param stream Destination of the file
+	@return true if the file was written, otherwise false
+	@note The sectors are compressed with writeCompression on up to writeThreads threads, each sector
+		is encoded on it's own so the output doesn't depend on the number of threads; sectors that do
+		not shrink (or without an encoder for the type) are stored uncompressed. Without compression
+		the sectors are streamed in a single pass and the CRC32 is written back with a seek; streams
+		that cannot seek get the sectors checksummed on the threads before they are written
+	@note The marshalling tables are written empty, so the file can only be read with the byte order
+		of the platform that wrote it; data loaded from a file with the other byte order is rejected
+*/
+extern bool OG_DLLAPI Gr2_Compose(TGr2* gr2, const TGr2Stream* stream);
+
+/*!
+	Writes the data of a Gr2 structure to a file descriptor (see Gr2_Compose)
+	@param gr2 The Gr2 structure to write
+	@param fd The file descriptor, the file starts at the current position
+	@return true if the file was written, otherwise false
+*/
+extern bool OG_DLLAPI Gr2_ComposeFd(TGr2* gr2, int fd);
+
+/*!
+	Writes the loaded data of a Gr2 structure as an image cache
+
+	An image is the data as it is after Gr2_Load (decompressed, in the byte order of the platform and
+	with the pointers fixed up to virtual pointers) followed by the data offset of every virtual
+	pointer, so Gr2_LoadImage uses the data in place and only rebuilds the virtual pointer array,
+	without the CRC32, decompression, byte swapping and fixups of a Granny2 file. Data loaded with
+	relativePointers has no relocations, the image is used as it is
+	@param gr2 The Gr2 structure, loaded with any mode
+	@param stream Destination of the image
+	@return true if the image was written, false if a pointer leads outside the loaded data
+	@note Images are caches bound to the library version and to the platform byte order, not a
+		replacement of the Granny2 files. The file info of the source file is kept in the image, so
+		fileInfo.crc32 and fileInfo.totalSize tell if the image is older than it's source
+*/
+extern bool OG_DLLAPI Gr2_ComposeImage(TGr2* gr2, const TGr2Stream* stream);
+
+/*!
+	Loads an image written by Gr2_ComposeImage without copying it's data
+	@param image The image, must stay valid until Gr2_Free; the data is written only by the edits of the caller
+	@param len Length of the image
+	@param gr2 The structure to store the data, the elements are built as loadMode says
+	@return true if the load succeeded, false if the image is malformed or from another version or byte order
+*/
+extern bool OG_DLLAPI Gr2_LoadImage(const uint8_t* image, size_t len, TGr2* gr2);
+
+/*!
+	Maps an image file and loads it (see Gr2_LoadImage), the file is unmapped by Gr2_Free
+	@param path Path of the image
+	@param gr2 The structure to store the data
+	@return true if the load succeeded, otherwise false
+	@note The mapping is copy on write, untouched pages are shared by the processes that map the same image
+*/
+extern bool OG_DLLAPI Gr2_LoadImageFile(const char* path, TGr2* gr2);
+
+/*!
+	Marks the sectors that contain a range of the loaded data as modified
+	@param gr2 The Gr2 structure
+	@param data Start of the modified data (e.g. the data of an element)
+	@param len Length of the modified data
+	@return true if the range is inside the loaded data, otherwise false
+	@note The setters of the library (e.g. Element_SetReal16Array) mark their writes, data changed
+		through the element values or the pointers of the loaded data must be marked by the program
+*/
+extern bool OG_DLLAPI Gr2_MarkDirty(TGr2* gr2, const void* data, size_t len);
+
+/*!
+	Writes a loaded file again, re-encoding only the sectors marked with Gr2_MarkDirty
+
+	The other sectors, the fixup and the marshalling tables are copied from the original file as they
+	are, only the offsets after a sector that changed length move. When every modified sector is
+	uncompressed the layout doesn't change and the CRC32 is updated from the old and new bytes of
+	those sectors, without reading the rest of the file
+	@param gr2 The Gr2 structure, loaded from original
+	@param original The file the structure was loaded from (or the last file written by this function)
+	@param len Length of the original file
+	@param stream Destination of the file
+	@return true if the file was written, false if the file doesn't match the structure or a pointer
+		of a modified sector was changed
+	@note Only values edited in place are supported, data moved to new buffers requires Gr2_Compose.
+		The modified sectors are encoded with their original compression when an encoder exists,
+		otherwise they are stored. After the save the structure describes the written file and the
+		sectors are clean again
+*/
+extern bool OG_DLLAPI Gr2_ComposeIncremental(TGr2* gr2, const uint8_t* original, size_t len, const TGr2Stream* stream);
+
+/*!
+	Writes a loaded file again with the sectors of a compression re-encoded in another one, e.g.
+	COMPRESSION_TYPE_OODLE1 to COMPRESSION_TYPE_LZ for local caches that decode at memory speed
+	@param gr2 The Gr2 structure, loaded from original
+	@param original The file the structure was loaded from (or the last file written by Gr2_ComposeIncremental)
+	@param len Length of the original file
+	@param from Compression of the sectors to transcode (one of ECompressionTypes)
+	@param to Compression of the transcoded sectors, COMPRESSION_TYPE_NONE to store them
+	@param stream Destination of the file
+	@return true if the file was written, otherwise false
+	@note Works like Gr2_ComposeIncremental, the sectors marked with Gr2_MarkDirty are written as well.
+		A transcoded sector that doesn't shrink is stored
+*/
+extern bool OG_DLLAPI Gr2_Transcode(TGr2* gr2, const uint8_t* original, size_t len, uint32_t from, uint32_t to, const TGr2Stream* stream);
 
 /*!
 	Sets the default information of a Gr2 structure, usefull when creating a new file
@@ -83,6 +258,16 @@ extern void OG_DLLAPI Gr2_SetDefaultInfo(TGr2* gr2, bool is64, bool isBe, uint32
 */
 extern TElementGeneric* OG_DLLAPI Gr2_AddElement(TGr2* gr2, uint8_t type, const char* name, TElementGeneric* root);
 
+/*!
+	Gets the children of an element, parsing them if the file was loaded lazily
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element
+	@return the children of the element (sizeof(TElementGeneric*)) or NULL if the parsing failed
+	@note When the file is loaded with GR2_LOAD_LAZY only the direct children are parsed, with
+		any other mode all the children are parsed
+*/
+extern OG_DLLAPI TDArray* Element_GetChildren(TGr2* gr2, TElementGeneric* elem);
+
 #ifdef __cplusplus
 }
 #endif
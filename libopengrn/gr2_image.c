@@ -0,0 +1,257 @@
+/*!
+	Project: libopengrn
+	File: gr2_image.c
+	Image cache of the loaded data
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "gr2_read.h"
+#include "debug.h"
+#include "platform.h"
+#include "virtual_ptr.h"
+
+#include <stdlib.h>
+
+/*!
+	Magic of the image files ("OGIM")
+*/
+#define IMAGE_MAGIC 0x4D49474F
+
+/*!
+	Version of the image format, images of other versions are not loaded
+*/
+#define IMAGE_VERSION 2
+
+/*!
+	Alignment of the data inside the image
+*/
+#define IMAGE_ALIGNMENT 16
+
+/*!
+	Relocation of the virtual pointers that are NULL
+*/
+#define IMAGE_NULL_OFFSET UINT64_MAX
+
+/*!
+	Header of an image, followed by the sector table, the data and the relocations
+*/
+typedef struct SImageHeader
+{
+	uint32_t magic; /* IMAGE_MAGIC */
+	uint32_t version; /* IMAGE_VERSION */
+	uint32_t bitsSize; /* bits size of the source file */
+	uint32_t bigEndian; /* 1 if the data is big endian */
+	uint32_t relative; /* 1 if the pointers of the data are offsets (see TGr2.relativePointers), there are no relocations */
+	THeader header; /* header of the source file */
+	TFileInfo fileInfo; /* file info of the source file */
+	uint64_t sectorsOffset; /* position of the sector table (fileInfo.sectorCount entries) */
+	uint64_t dataOffset; /* position of the data, aligned to IMAGE_ALIGNMENT */
+	uint64_t dataSize; /* size of the data */
+	uint64_t relocationOffset; /* position of the data offset of every virtual pointer (uint64_t each) */
+	uint64_t relocationCount; /* number of virtual pointers */
+} TImageHeader;
+
+/*!
+	Writes bytes to a stream
+	@param stream The stream
+	@param data The bytes to write
+	@param len Number of bytes
+	@return true if the bytes were written, otherwise false
+*/
+static bool Image_Write(const TGr2Stream* stream, const void* data, size_t len)
+{
+	return !len || stream->write(stream->context, data, len);
+}
+
+OG_DLLAPI bool Gr2_ComposeImage(TGr2* gr2, const TGr2Stream* stream)
+{
+	static const uint8_t padding[IMAGE_ALIGNMENT] = { 0 };
+	TImageHeader header;
+	uint64_t* relocations;
+	bool success;
+
+	if (!stream || !stream->write || !gr2->data || !gr2->sectors || !gr2->sectorOffsets)
+		return false;
+
+	if (gr2->mismatchEndianness)
+	{
+		dbg_printf("the data was loaded with the byte order of the file");
+		return false;
+	}
+
+	relocations = (uint64_t*)malloc(sizeof(uint64_t) * (gr2->virtual_ptr.pointers.count ? gr2->virtual_ptr.pointers.count : 1));
+
+	if (!relocations)
+	{
+		dbg_printf("memory allocation fail!!!");
+		return false;
+	}
+
+	for (size_t i = 0; !is_relative_ptr(&gr2->virtual_ptr) && i < gr2->virtual_ptr.pointers.count; i++)
+	{
+		const uint8_t* ptr = *(const uint8_t**)DArray_Get(&gr2->virtual_ptr.pointers, i);
+
+		if (!ptr)
+			relocations[i] = IMAGE_NULL_OFFSET;
+		else if (ptr >= gr2->data && ptr <= gr2->data + gr2->dataSize)
+			relocations[i] = (uint64_t)(ptr - gr2->data);
+		else
+		{
+			dbg_printf("virtual pointer %zu is outside the loaded data", i + 1);
+			free(relocations);
+			return false;
+		}
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = IMAGE_MAGIC;
+	header.version = IMAGE_VERSION;
+	header.bitsSize = gr2->bitsSize;
+	header.bigEndian = Platform_IsBigEndian() ? 1 : 0;
+	header.relative = is_relative_ptr(&gr2->virtual_ptr) ? 1 : 0;
+	header.header = gr2->header;
+	header.fileInfo = gr2->fileInfo;
+	header.sectorsOffset = sizeof(TImageHeader);
+	header.dataOffset = header.sectorsOffset + (uint64_t)sizeof(TSector) * gr2->fileInfo.sectorCount;
+	header.dataOffset = (header.dataOffset + IMAGE_ALIGNMENT - 1) & ~(uint64_t)(IMAGE_ALIGNMENT - 1);
+	header.dataSize = gr2->dataSize;
+	header.relocationOffset = (header.dataOffset + header.dataSize + IMAGE_ALIGNMENT - 1) & ~(uint64_t)(IMAGE_ALIGNMENT - 1);
+	header.relocationCount = header.relative ? 0 : gr2->virtual_ptr.pointers.count;
+
+	success = Image_Write(stream, &header, sizeof(header)) &&
+		Image_Write(stream, gr2->sectors, sizeof(TSector) * gr2->fileInfo.sectorCount) &&
+		Image_Write(stream, padding, (size_t)(header.dataOffset - header.sectorsOffset - sizeof(TSector) * gr2->fileInfo.sectorCount)) &&
+		Image_Write(stream, gr2->data, gr2->dataSize) &&
+		Image_Write(stream, padding, (size_t)(header.relocationOffset - header.dataOffset - header.dataSize)) &&
+		Image_Write(stream, relocations, sizeof(uint64_t) * (size_t)header.relocationCount);
+
+	if (!success)
+	{
+		dbg_printf("cannot write the image");
+	}
+
+	free(relocations);
+	return success;
+}
+
+OG_DLLAPI bool Gr2_LoadImage(const uint8_t* image, size_t len, TGr2* gr2)
+{
+	TImageHeader header;
+	const uint8_t* relocations;
+	uint64_t total = 0;
+
+	if (len < sizeof(TImageHeader))
+	{
+		dbg_printf("image %zu is too small to have a header", len);
+		return false;
+	}
+
+	memcpy(&header, image, sizeof(header));
+
+	if (header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION || header.bigEndian != (Platform_IsBigEndian() ? 1u : 0u))
+	{
+		dbg_printf("not an image of version %u for this platform", IMAGE_VERSION);
+		return false;
+	}
+
+	if ((header.bitsSize != 32 && header.bitsSize != 64) || header.sectorsOffset > len || header.fileInfo.sectorCount > (len - header.sectorsOffset) / sizeof(TSector) ||
+		header.dataOffset > len || header.dataSize > len - header.dataOffset || header.dataOffset % IMAGE_ALIGNMENT ||
+		header.relocationOffset > len || header.relocationCount > (len - header.relocationOffset) / sizeof(uint64_t) ||
+		header.fileInfo.type.sector >= header.fileInfo.sectorCount || header.fileInfo.root.sector >= header.fileInfo.sectorCount ||
+		(header.relative && (header.relocationCount || header.dataSize >= UINT32_MAX)))
+	{
+		dbg_printf("out of bounds");
+		return false;
+	}
+
+	gr2->header = header.header;
+	gr2->fileInfo = header.fileInfo;
+	gr2->bitsSize = (uint8_t)header.bitsSize;
+	gr2->mismatchEndianness = false;
+
+	gr2->sectors = (TSector*)malloc(sizeof(TSector) * (gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1));
+	gr2->dirtySectors = (bool*)calloc(gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1, sizeof(bool));
+	gr2->sectorOffsets = (size_t*)malloc(sizeof(size_t) * (gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1));
+
+	if (!gr2->sectors || !gr2->dirtySectors || !gr2->sectorOffsets ||
+		(!header.relative && !DArray_Resize(&gr2->virtual_ptr.pointers, header.relocationCount ? (size_t)header.relocationCount : 1)))
+	{
+		dbg_printf("memory allocation fail!!!");
+		return false;
+	}
+
+	memcpy(gr2->sectors, image + header.sectorsOffset, sizeof(TSector) * gr2->fileInfo.sectorCount);
+
+	for (uint32_t i = 0; i < gr2->fileInfo.sectorCount; i++)
+	{
+		gr2->sectorOffsets[i] = (size_t)total;
+		total += gr2->sectors[i].decompressLen;
+	}
+
+	if (total != header.dataSize)
+	{
+		dbg_printf("sectors size %llu does not match data size %llu", (unsigned long long)total, (unsigned long long)header.dataSize);
+		return false;
+	}
+
+	gr2->data = (uint8_t*)(image + header.dataOffset);
+	gr2->dataSize = (size_t)header.dataSize;
+	gr2->externalData = true;
+
+	LayoutCache_SetBits(&gr2->layouts, gr2->bitsSize == 64);
+
+	/* relative pointers are resolved on access, the image is never written */
+	if (header.relative)
+	{
+		set_relative_ptr(&gr2->virtual_ptr, gr2->data, gr2->dataSize);
+		return Gr2_ParseRoot(gr2);
+	}
+
+	/* the only relocation pass, the data keeps the virtual pointers */
+	relocations = image + header.relocationOffset;
+	gr2->virtual_ptr.pointers.count = 0;
+
+	for (uint64_t i = 0; i < header.relocationCount; i++)
+	{
+		uint64_t offset;
+		uint8_t* ptr = NULL;
+
+		memcpy(&offset, relocations + i * sizeof(uint64_t), sizeof(offset));
+
+		if (offset != IMAGE_NULL_OFFSET)
+		{
+			if (offset > header.dataSize)
+			{
+				dbg_printf("relocation %llu is out of bounds", (unsigned long long)i);
+				return false;
+			}
+
+			ptr = gr2->data + offset;
+		}
+
+		if (!DArray_Add(&gr2->virtual_ptr.pointers, &ptr))
+			return false;
+	}
+
+	return Gr2_ParseRoot(gr2);
+}
+
+OG_DLLAPI bool Gr2_LoadImageFile(const char* path, TGr2* gr2)
+{
+	size_t len;
+	void* image = Platform_MapFile(path, &len);
+
+	if (!image)
+	{
+		dbg_printf("cannot map %s", path);
+		return false;
+	}
+
+	/* the structure owns the mapping even if the load fails, Gr2_Free releases both */
+	gr2->mapping = image;
+	gr2->mappingSize = len;
+
+	return Gr2_LoadImage((const uint8_t*)image, len, gr2);
+}
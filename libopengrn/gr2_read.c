@@ -7,7 +7,7 @@
 	License, v. 2.0. If a copy of the MPL was not distributed with this
 	file, You can obtain one at https://mozilla.org/MPL/2.0/.
 */
-#include "gr2.h"
+#include "gr2_read.h"
 #include "debug.h"
 #include "compression.h"
 #include "magic.h"
@@ -80,23 +80,33 @@ static bool Gr2_LoadFileInfo(TGr2* gr2, const uint8_t* data, size_t len, bool ex
 	@param gr2 The gr2 file to fix
 	@param srcSector the current sector that contains the fixup data
 	@param fd fixup information
+	@return true if the pointer was fixed up, false if it can't be encoded
 */
-static void Gr2_ApplyFixUp(TGr2* gr2, uint32_t srcSector, TFixUpData* fd, bool is64)
-{
-	void* dst = gr2->data + gr2->sectorOffsets[fd->dstSector] + fd->dstOffset;
-	void* src = gr2->data + gr2->sectorOffsets[srcSector] + fd->srcOffset;
+typedef bool (*TFixUpFunc)(TGr2* gr2, uint32_t srcSector, TFixUpData* fd);
 
-	if (is64)
-	{
-		uint64_t dstPtr = encode_ptr(&gr2->virtual_ptr, dst);
-		memcpy(src, &dstPtr, sizeof(dstPtr));
-	}
-	else
-	{
-		uint32_t dstPtr = encode_ptr(&gr2->virtual_ptr, dst);
-		memcpy(src, &dstPtr, sizeof(dstPtr));
+/*!
+	Defines a fix up function for the specified pointer size
+	@param bits Pointer size in bits
+	@param ptr Unsigned type of a pointer
+*/
+#define GR2_DEFINE_FIXUP(bits, ptr) \
+	static bool Gr2_ApplyFixUp##bits(TGr2* gr2, uint32_t srcSector, TFixUpData* fd) \
+	{ \
+		void* dst = gr2->data + gr2->sectorOffsets[fd->dstSector] + fd->dstOffset; \
+		void* src = gr2->data + gr2->sectorOffsets[srcSector] + fd->srcOffset; \
+		uint32_t virtualPtr; \
+		ptr dstPtr; \
+		\
+		if (!encode_ptr(&gr2->virtual_ptr, dst, &virtualPtr)) \
+			return false; \
+		\
+		dstPtr = virtualPtr; \
+		memcpy(src, &dstPtr, sizeof(dstPtr)); \
+		return true; \
 	}
-}
+
+GR2_DEFINE_FIXUP(32, uint32_t)
+GR2_DEFINE_FIXUP(64, uint64_t)
 
 /*!
 	Applies marshalling fix for endianness mismatch situations
@@ -157,7 +167,7 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 	uint32_t i;
 	size_t ofs = 0;
 	uint8_t magicFlags;
-	uint64_t rootOffset = 0;
+	TFixUpFunc applyFixUp;
 
 	/* load the magic and gr2 header */
 	if (len < sizeof(THeader))
@@ -172,10 +182,19 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 		return false;
 	}
 
+	/* select the parsers specialized for the pointer size once */
 	if (magicFlags & MAGIC_FLAG_64BIT)
+	{
 		gr2->bitsSize = 64;
+		applyFixUp = Gr2_ApplyFixUp64;
+	}
 	else
+	{
 		gr2->bitsSize = 32;
+		applyFixUp = Gr2_ApplyFixUp32;
+	}
+
+	LayoutCache_SetBits(&gr2->layouts, magicFlags & MAGIC_FLAG_64BIT);
 
 	gr2->mismatchEndianness = Platform_IsBigEndian() != (magicFlags & MAGIC_FLAG_BIGENDIAN);
 
@@ -203,8 +222,9 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 
 	/* allocate sector info array */
 	gr2->sectors = (TSector*)malloc(sizeof(TSector) * gr2->fileInfo.sectorCount);
+	gr2->dirtySectors = (bool*)calloc(gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1, sizeof(bool));
 
-	if (!gr2->sectors)
+	if (!gr2->sectors || !gr2->dirtySectors)
 	{
 		dbg_printf("memory allocation fail!!!");
 		return false;
@@ -239,6 +259,18 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 		return false;
 	}
 
+	/* the fixups become offsets inside the data, they must fit in a virtual pointer */
+	if (gr2->relativePointers)
+	{
+		if (gr2->dataSize >= UINT32_MAX)
+		{
+			dbg_printf("data size %zu is too big for relative pointers", gr2->dataSize);
+			return false;
+		}
+
+		set_relative_ptr(&gr2->virtual_ptr, gr2->data, gr2->dataSize);
+	}
+
 	/* decompress the sectors and apply the required byte swapping */
 	for (i = 0; i < gr2->fileInfo.sectorCount; i++)
 	{
@@ -251,6 +283,19 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 			if (gr2->mismatchEndianness)
 				Platform_Swap1(gr2->data + ofs, sector.decompressLen); /* should be done on compressed data as well */
 		}
+		else if (sector.compressType == COMPRESSION_TYPE_LZ)
+		{
+			/* the compressed stream is made of bytes, it's decoded from the file straight into the data without a copy */
+			if (!Compression_UnLz(data + sector.dataOffset, sector.compressedLen, gr2->data + ofs, sector.decompressLen))
+			{
+				dbg_printf("decompression of %d fail", sector.compressType);
+				return false;
+			}
+
+			/* the decoded data is swapped like a stored sector */
+			if (gr2->mismatchEndianness)
+				Platform_Swap1(gr2->data + ofs, sector.decompressLen);
+		}
 		else
 		{
 			// Required for Oodle
@@ -339,7 +384,7 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 
 		for (k = 0; k < sector.marshallSize; k++)
 		{
-			pos = sector.marshallOffset + (k * sizeof(TFixUpData));
+			pos = sector.marshallOffset + (k * sizeof(TMarshallData));
 
 			if (pos > len)
 			{
@@ -371,10 +416,33 @@ OG_DLLAPI bool Gr2_Load(const uint8_t* data, size_t len, TGr2* gr2)
 			if (gr2->mismatchEndianness)
 				Platform_Swap1((uint8_t*)fd, sizeof(TFixUpData));
 
-			Gr2_ApplyFixUp(gr2, i, fd, magicFlags & MAGIC_FLAG_64BIT);
+			if (!applyFixUp(gr2, i, fd))
+			{
+				dbg_printf("cannot fix up offset %u of sector %u", fd->srcOffset, i);
+				return false;
+			}
 		}
 	}
 
 	/* file parsing completed! begin node loading */
-	return Element_Parse(&gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position, gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position, magicFlags & MAGIC_FLAG_64BIT, &gr2->elements, gr2->root, &rootOffset);
+	return Gr2_ParseRoot(gr2);
+}
+
+bool Gr2_ParseRoot(TGr2* gr2)
+{
+	const TTypeLayout* rootLayout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+
+	if (!rootLayout)
+	{
+		dbg_printf("cannot compile root type");
+		return false;
+	}
+
+	if (gr2->loadMode == GR2_LOAD_DATA)
+	{
+		gr2->root->expanded = false;
+		return true;
+	}
+
+	return Element_Parse(&gr2->virtual_ptr, &gr2->layouts, rootLayout, gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position, &gr2->elements, gr2->root, gr2->maxDepth, gr2->loadMode == GR2_LOAD_LAZY);
 }
@@ -0,0 +1,19 @@
+/*!
+	Project: libopengrn
+	File: gr2_read.h
+	Private functions of the Gr2 read api shared by the loaders
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+/*!
+	Builds the root layout and the elements of data that was just loaded, as loadMode says
+	@param gr2 The Gr2 structure
+	@return true if the elements were built, otherwise false
+*/
+extern bool Gr2_ParseRoot(TGr2* gr2);
@@ -9,17 +9,1868 @@
 */
 #include "gr2.h"
 #include "debug.h"
+#include "compression.h"
+#include "magic.h"
+#include "platform.h"
+#include "crc.h"
 
-bool OG_DLLAPI Gr2_Compose(TGr2* gr2)
+#include <stdlib.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+/*!
+	Size of the buffer that collects the small writes before they reach the stream
+*/
+#define WRITE_BUFFER_SIZE 0x10000
+
+/*!
+	Alignment of the sectors and of the objects inside them
+*/
+#define WRITE_ALIGNMENT 4
+
+/*!
+	Alignment of the bulk sector of GR2_WRITE_LAYOUT_CLUSTER and of the arrays inside it, enough for SIMD loads
+*/
+#define WRITE_BULK_ALIGNMENT 16
+
+/*!
+	Minimum size of an array moved to the bulk sector, the smaller ones stay next to their structures
+*/
+#define WRITE_BULK_MIN_SIZE 256
+
+/*!
+	Object index of pointers written as NULL and of objects that are not contained in another one
+*/
+#define WRITE_NO_OBJECT UINT32_MAX
+
+/*!
+	Kinds of the objects reachable from the file info
+*/
+enum EWriteObjectKinds
+{
+	WRITE_OBJECT_TYPE, /* type node list, terminated by a node with type 0 */
+	WRITE_OBJECT_STRING, /* zero terminated string */
+	WRITE_OBJECT_STRUCTURES, /* array of structures of a layout */
+	WRITE_OBJECT_REFERENCES, /* array of pointers to structures of a layout */
+};
+
+/*!
+	A block of data pointed by the file
+*/
+typedef struct SWriteObject
+{
+	const uint8_t* src; /* source data */
+	uint32_t size; /* size of the data */
+	uint32_t count; /* number of structures or references */
+	const TTypeLayout* layout; /* layout of the structures */
+	uint8_t kind; /* one of EWriteObjectKinds */
+	uint32_t container; /* object whose data contains this one, WRITE_NO_OBJECT if the object is written by itself */
+	uint32_t sector; /* output sector */
+	uint32_t offset; /* output offset inside the sector */
+} TWriteObject;
+
+/*!
+	A pointer inside an object
+*/
+typedef struct SWriteSlot
+{
+	uint32_t object; /* object that contains the pointer */
+	uint32_t offset; /* offset of the pointer inside the object */
+	uint32_t target; /* pointed object, WRITE_NO_OBJECT if the pointer is written as NULL */
+} TWriteSlot;
+
+/*!
+	A pointer resolved to it's output position
+*/
+typedef struct SWriteFixUp
+{
+	uint32_t sector; /* sector of the pointer */
+	TFixUpData data; /* position of the pointer and of the pointed data, dstSector is WRITE_NO_OBJECT for NULL */
+} TWriteFixUp;
+
+/*!
+	Range of source data of an object, used to find the objects inside other objects
+*/
+typedef struct SWriteRange
+{
+	const uint8_t* src; /* source data */
+	uint32_t size; /* size of the data */
+	uint32_t object; /* index of the object */
+} TWriteRange;
+
+/*!
+	Encoded data of a sector
+*/
+typedef struct SWriteSector
+{
+	uint8_t* data; /* data stored in the file, NULL if the sector is streamed from the objects */
+	uint32_t crc; /* CRC32 of the data stored in the file */
+	bool failed; /* true if the sector could not be encoded */
+} TWriteSector;
+
+/*!
+	State of Gr2_Compose
+*/
+typedef struct SGr2Writer
+{
+	TGr2* gr2; /* the written structure */
+	uint32_t ptrSize; /* size of a pointer in the file */
+	uint32_t nodeSize; /* size of a type node in the file */
+	uint32_t sectorCount; /* number of output sectors */
+	uint32_t fileInfoSize; /* size of the output file info */
+	uint32_t compression; /* compression of the sectors (one of ECompressionTypes) */
+	TDArray objects; /* reachable objects in the order they were found (sizeof(TWriteObject)) */
+	TDArray slots; /* pointers of the objects (sizeof(TWriteSlot)) */
+	THashTable index; /* source pointer -> object index + 1 */
+	TDArray fixups; /* pointers sorted by output position (sizeof(TWriteFixUp)) */
+	TSector* sectors; /* output sector table */
+	size_t* firstFixUp; /* first fixup of every sector, plus the end of the last one */
+	TWriteSector* encoded; /* sectors encoded before writing, NULL if the sectors are checksummed while they are streamed */
+	uint32_t typeObject; /* object of the root type */
+	uint32_t rootObject; /* object of the root structure */
+	uint32_t totalSize; /* size of the output file */
+} TGr2Writer;
+
+/*!
+	Buffered output that computes the CRC32 of what passes through it
+*/
+typedef struct SWriteBuffer
+{
+	const TGr2Stream* stream; /* destination, NULL to write in memory or to only compute the CRC32 */
+	uint8_t* data; /* buffered bytes, or the output memory when there is no stream (NULL to only compute the CRC32) */
+	size_t used; /* number of buffered (or written in memory) bytes */
+	uint64_t position; /* number of bytes written so far */
+	uint32_t crc; /* CRC32 of the checksummed bytes */
+	bool checksum; /* true if the written bytes are added to the CRC32 */
+} TWriteBuffer;
+
+/*!
+	File descriptor of Gr2_ComposeFd
+*/
+typedef struct SWriteFd
+{
+	int fd; /* the file descriptor */
+	int64_t start; /* position of the start of the file */
+} TWriteFd;
+
+/*!
+	Sends the buffered bytes to the stream
+	@param buffer The buffer
+	@return true if the bytes were written, otherwise false
+*/
+static bool Writer_Flush(TWriteBuffer* buffer)
+{
+	bool success;
+
+	if (!buffer->stream)
+		return true;
+
+	success = !buffer->used || buffer->stream->write(buffer->stream->context, buffer->data, buffer->used);
+
+	buffer->used = 0;
+	return success;
+}
+
+/*!
+	Appends bytes to the output
+	@param buffer The buffer
+	@param data The bytes to write
+	@param len Number of bytes
+	@return true if the bytes were written, otherwise false
+*/
+static bool Writer_Write(TWriteBuffer* buffer, const uint8_t* data, size_t len)
+{
+	buffer->position += len;
+
+	if (buffer->checksum)
+		buffer->crc = CRC32_Update(buffer->crc, data, len);
+
+	if (!buffer->stream)
+	{
+		if (buffer->data)
+			memcpy(buffer->data + buffer->used, data, len);
+
+		buffer->used += len;
+		return true;
+	}
+
+	/* big blocks skip the buffer */
+	if (len >= WRITE_BUFFER_SIZE)
+		return Writer_Flush(buffer) && buffer->stream->write(buffer->stream->context, data, len);
+
+	if (buffer->used + len > WRITE_BUFFER_SIZE && !Writer_Flush(buffer))
+		return false;
+
+	memcpy(buffer->data + buffer->used, data, len);
+	buffer->used += len;
+	return true;
+}
+
+/*!
+	Appends zeros to the output
+	@param buffer The buffer
+	@param len Number of zeros
+	@return true if the zeros were written, otherwise false
+*/
+static bool Writer_WriteZeros(TWriteBuffer* buffer, size_t len)
+{
+	static const uint8_t zeros[64] = { 0 };
+
+	while (len)
+	{
+		size_t chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+
+		if (!Writer_Write(buffer, zeros, chunk))
+			return false;
+
+		len -= chunk;
+	}
+
+	return true;
+}
+
+/*!
+	Appends a block that was already checksummed to an output that only computes the CRC32
+	@param buffer The buffer
+	@param crc CRC32 of the block
+	@param len Length of the block
+*/
+static void Writer_WriteChecksum(TWriteBuffer* buffer, uint32_t crc, uint64_t len)
+{
+	buffer->position += len;
+	buffer->crc = CRC32_Combine(buffer->crc, crc, len);
+}
+
+/*!
+	Pads the output with zeros up to a position
+	@param buffer The buffer
+	@param position The position to reach
+	@return true if the padding was written, false if the output is already past the position
+*/
+static bool Writer_PadTo(TWriteBuffer* buffer, uint64_t position)
+{
+	if (buffer->position > position)
+	{
+		dbg_printf("output position %llu is past %llu", (unsigned long long)buffer->position, (unsigned long long)position);
+		return false;
+	}
+
+	return Writer_WriteZeros(buffer, (size_t)(position - buffer->position));
+}
+
+/*!
+	Gets an object of the writer
+	@param w The writer
+	@param index Index of the object
+	@return the object
+*/
+static TWriteObject* Writer_GetObject(TGr2Writer* w, uint32_t index)
+{
+	return (TWriteObject*)DArray_Get(&w->objects, index);
+}
+
+/*!
+	Checks if a block is inside the loaded data
+	@param w The writer
+	@param src Start of the block
+	@return true if the block starts inside the loaded data
+*/
+static bool Writer_IsLoaded(TGr2Writer* w, const uint8_t* src)
+{
+	return src >= w->gr2->data && src < w->gr2->data + w->gr2->dataSize;
+}
+
+/*!
+	Computes the size of an object
+	@param w The writer
+	@param src Source data of the object
+	@param kind Kind of the object
+	@param layout Layout of the structures
+	@param count Number of structures or references
+	@param size Output size
+	@return true if the size was computed, false if the object is malformed
+*/
+static bool Writer_GetSize(TGr2Writer* w, const uint8_t* src, uint8_t kind, const TTypeLayout* layout, uint32_t count, uint32_t* size)
+{
+	const uint8_t* end = Writer_IsLoaded(w, src) ? w->gr2->data + w->gr2->dataSize : NULL;
+	uint64_t len;
+
+	switch (kind)
+	{
+	case WRITE_OBJECT_TYPE:
+		/* the nodes end with a node of type 0, like the parsers the unknown types end them too */
+		for (len = w->nodeSize;; len += w->nodeSize)
+		{
+			uint32_t type;
+
+			if (end && (uint64_t)(end - src) < len)
+			{
+				dbg_printf("type %p is not terminated", src);
+				return false;
+			}
+
+			memcpy(&type, src + len - w->nodeSize, sizeof(type));
+
+			if (type == TYPEID_NONE || type >= TYPEID_MAX)
+				break;
+		}
+		break;
+
+	case WRITE_OBJECT_STRING:
+		if (end)
+		{
+			const uint8_t* term = (const uint8_t*)memchr(src, 0, end - src);
+
+			if (!term)
+			{
+				dbg_printf("string %p is not terminated", src);
+				return false;
+			}
+
+			len = term - src + 1;
+		}
+		else
+			len = strlen((const char*)src) + 1;
+		break;
+
+	case WRITE_OBJECT_STRUCTURES:
+		len = (uint64_t)layout->stride * count;
+		break;
+
+	default:
+		len = (uint64_t)w->ptrSize * count;
+		break;
+	}
+
+	if (len > UINT32_MAX || (end && (uint64_t)(end - src) < len))
+	{
+		dbg_printf("object %p of %llu bytes is out of bounds", src, (unsigned long long)len);
+		return false;
+	}
+
+	*size = (uint32_t)len;
+	return true;
+}
+
+/*!
+	Gets the object of a block, adding it the first time the block is found
+	@param w The writer
+	@param src Source data of the object
+	@param kind Kind of the object
+	@param layout Layout of the structures
+	@param count Number of structures or references
+	@param index Output index of the object
+	@return true if the object was found or added, otherwise false
+*/
+static bool Writer_AddObject(TGr2Writer* w, const uint8_t* src, uint8_t kind, const TTypeLayout* layout, uint32_t count, uint32_t* index)
+{
+	uint64_t key = HashTable_HashPtr(src);
+	TWriteObject object;
+	size_t cursor = 0;
+	void* value;
+
+	/* the same block reached again is written once */
+	while ((value = HashTable_Find(&w->index, key, &cursor)))
+	{
+		const TWriteObject* found = Writer_GetObject(w, (uint32_t)((uintptr_t)value - 1));
+
+		if (found->src == src && found->kind == kind && found->layout == layout && found->count == count)
+		{
+			*index = (uint32_t)((uintptr_t)value - 1);
+			return true;
+		}
+	}
+
+	memset(&object, 0, sizeof(object));
+	object.src = src;
+	object.kind = kind;
+	object.layout = layout;
+	object.count = count;
+	object.container = WRITE_NO_OBJECT;
+
+	if (!Writer_GetSize(w, src, kind, layout, count, &object.size))
+		return false;
+
+	if (w->objects.count >= WRITE_NO_OBJECT - 1)
+	{
+		dbg_printf("too many objects");
+		return false;
+	}
+
+	*index = (uint32_t)w->objects.count;
+
+	return DArray_Add(&w->objects, &object) && HashTable_Add(&w->index, key, (void*)(uintptr_t)(w->objects.count));
+}
+
+/*!
+	Adds a pointer of an object, adding the pointed object too
+	@param w The writer
+	@param object Object that contains the pointer
+	@param offset Offset of the pointer inside the object
+	@param kind Kind of the pointed object
+	@param layout Layout of the pointed structures
+	@param count Number of pointed structures or references
+	@return true if the pointer was added, otherwise false
+	@note Pointers that cannot be followed (no data, no type or no elements) are written as NULL
+*/
+static bool Writer_AddPointer(TGr2Writer* w, uint32_t object, uint32_t offset, uint8_t kind, const TTypeLayout* layout, uint32_t count)
+{
+	TWriteSlot slot = { object, offset, WRITE_NO_OBJECT };
+	const uint8_t* target = LayoutCache_ReadPtr(&w->gr2->layouts, &w->gr2->virtual_ptr, Writer_GetObject(w, object)->src + offset);
+
+	if (target && count && (layout || (kind != WRITE_OBJECT_STRUCTURES && kind != WRITE_OBJECT_REFERENCES)))
+	{
+		if (!Writer_AddObject(w, target, kind, layout, count, &slot.target))
+			return false;
+	}
+
+	return DArray_Add(&w->slots, &slot);
+}
+
+/*!
+	Adds the pointers of a structure
+	@param w The writer
+	@param object Object that contains the structure
+	@param layout Layout of the structure
+	@param offset Offset of the structure inside the object
+	@return true if the pointers were added, otherwise false
+*/
+static bool Writer_WalkStructure(TGr2Writer* w, uint32_t object, const TTypeLayout* layout, uint32_t offset)
+{
+	const uint8_t* src = Writer_GetObject(w, object)->src;
+	TTypeLayout* child;
+
+	for (uint32_t i = 0; i < layout->count; i++)
+	{
+		const TTypeMember* member = &layout->members[i];
+		uint32_t stride = member->size / member->count;
+
+		for (uint32_t e = 0; e < member->count; e++)
+		{
+			uint32_t at = offset + member->offset + e * stride, count;
+			bool success = true;
+
+			switch (member->info.type)
+			{
+			case TYPEID_INLINE:
+				if (member->inlineLayout)
+					success = Writer_WalkStructure(w, object, member->inlineLayout, at);
+				break;
+
+			case TYPEID_REFERENCE:
+				child = LayoutCache_Get(&w->gr2->layouts, &w->gr2->virtual_ptr, member->childType);
+				success = Writer_AddPointer(w, object, at, WRITE_OBJECT_STRUCTURES, child, 1);
+				break;
+
+			case TYPEID_REFERENCETOARRAY:
+			case TYPEID_ARRAYOFREFERENCES:
+				memcpy(&count, src + at, sizeof(count));
+				child = LayoutCache_Get(&w->gr2->layouts, &w->gr2->virtual_ptr, member->childType);
+				success = Writer_AddPointer(w, object, at + 4, member->info.type == TYPEID_REFERENCETOARRAY ? WRITE_OBJECT_STRUCTURES : WRITE_OBJECT_REFERENCES, child, count);
+				break;
+
+			case TYPEID_VARIANTREFERENCE:
+			case TYPEID_REFERENCETOVARIANTARRAY:
+				/* the type is stored inside the data */
+				child = LayoutCache_Get(&w->gr2->layouts, &w->gr2->virtual_ptr, LayoutCache_ReadPtr(&w->gr2->layouts, &w->gr2->virtual_ptr, src + at));
+				success = Writer_AddPointer(w, object, at, WRITE_OBJECT_TYPE, NULL, 1);
+
+				if (!success)
+					break;
+
+				if (member->info.type == TYPEID_VARIANTREFERENCE)
+					success = Writer_AddPointer(w, object, at + w->ptrSize, WRITE_OBJECT_STRUCTURES, child, 1);
+				else
+				{
+					memcpy(&count, src + at + w->ptrSize, sizeof(count));
+					success = Writer_AddPointer(w, object, at + w->ptrSize + 4, WRITE_OBJECT_STRUCTURES, child, count);
+				}
+				break;
+
+			case TYPEID_STRING:
+				success = Writer_AddPointer(w, object, at, WRITE_OBJECT_STRING, NULL, 1);
+				break;
+
+			case TYPEID_EMPTYREFERENCE:
+				/* nothing is known about the pointed data */
+				success = Writer_AddPointer(w, object, at, WRITE_OBJECT_STRUCTURES, NULL, 0);
+				break;
+
+			default:
+				break;
+			}
+
+			if (!success)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+	Adds the pointers of an object
+	@param w The writer
+	@param index Index of the object
+	@return true if the pointers were added, otherwise false
+*/
+static bool Writer_WalkObject(TGr2Writer* w, uint32_t index)
+{
+	TWriteObject object = *Writer_GetObject(w, index);
+
+	switch (object.kind)
+	{
+	case WRITE_OBJECT_TYPE:
+		for (uint32_t i = 0; i + 1 < object.size / w->nodeSize; i++)
+		{
+			if (!Writer_AddPointer(w, index, i * w->nodeSize + 4, WRITE_OBJECT_STRING, NULL, 1) ||
+				!Writer_AddPointer(w, index, i * w->nodeSize + 4 + w->ptrSize, WRITE_OBJECT_TYPE, NULL, 1))
+				return false;
+		}
+		break;
+
+	case WRITE_OBJECT_STRUCTURES:
+		for (uint32_t i = 0; i < object.count; i++)
+		{
+			if (!Writer_WalkStructure(w, index, object.layout, i * object.layout->stride))
+				return false;
+		}
+		break;
+
+	case WRITE_OBJECT_REFERENCES:
+		for (uint32_t i = 0; i < object.count; i++)
+		{
+			if (!Writer_AddPointer(w, index, i * w->ptrSize, WRITE_OBJECT_STRUCTURES, object.layout, 1))
+				return false;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+/*!
+	Orders the ranges by start, the bigger range first
+*/
+static int Writer_CompareRanges(const void* a, const void* b)
+{
+	const TWriteRange* ra = (const TWriteRange*)a;
+	const TWriteRange* rb = (const TWriteRange*)b;
+
+	if (ra->src != rb->src)
+		return (uintptr_t)ra->src < (uintptr_t)rb->src ? -1 : 1;
+
+	if (ra->size != rb->size)
+		return ra->size > rb->size ? -1 : 1;
+
+	return ra->object < rb->object ? -1 : ra->object > rb->object;
+}
+
+/*!
+	Finds the objects that are inside other objects (e.g. a reference to an element of an array),
+	so they are written once as part of the bigger one
+	@param w The writer
+	@return true if the objects were resolved, otherwise false
+*/
+static bool Writer_ResolveContainers(TGr2Writer* w)
+{
+	TWriteRange* ranges = (TWriteRange*)malloc(sizeof(TWriteRange) * (w->objects.count ? w->objects.count : 1));
+	const TWriteRange* current = NULL;
+
+	if (!ranges)
+		return false;
+
+	for (uint32_t i = 0; i < w->objects.count; i++)
+	{
+		ranges[i].src = Writer_GetObject(w, i)->src;
+		ranges[i].size = Writer_GetObject(w, i)->size;
+		ranges[i].object = i;
+	}
+
+	qsort(ranges, w->objects.count, sizeof(TWriteRange), Writer_CompareRanges);
+
+	for (size_t i = 0; i < w->objects.count; i++)
+	{
+		const TWriteRange* range = &ranges[i];
+
+		/* partial overlaps are written twice */
+		if (current && (uint64_t)((uintptr_t)range->src - (uintptr_t)current->src) + range->size <= current->size)
+		{
+			TWriteObject* object = Writer_GetObject(w, range->object);
+
+			object->container = current->object;
+			object->offset = (uint32_t)(range->src - current->src);
+			continue;
+		}
+
+		current = range;
+	}
+
+	free(ranges);
+	return true;
+}
+
+/*!
+	Pointers of the objects, used to compare their contents
+*/
+typedef struct SWriteContents
+{
+	size_t* firstSlot; /* first slot of every object, plus the end of the last one */
+	uint64_t* hash; /* hash of the data of every object, the pointers excluded */
+	uint32_t* canonical; /* object every object was merged into, itself if it was not merged */
+} TWriteContents;
+
+/*!
+	Finds the object that stands for an object merged with identical ones
+	@param contents The contents of the objects
+	@param index Index of the object, WRITE_NO_OBJECT for NULL
+	@return the canonical object
+*/
+static uint32_t Writer_FindCanonical(TWriteContents* contents, uint32_t index)
+{
+	if (index == WRITE_NO_OBJECT)
+		return index;
+
+	while (contents->canonical[index] != index)
+	{
+		contents->canonical[index] = contents->canonical[contents->canonical[index]];
+		index = contents->canonical[index];
+	}
+
+	return index;
+}
+
+/*!
+	Hashes or compares the data of objects skipping their pointers
+	@param w The writer
+	@param contents The contents of the objects
+	@param a First object
+	@param b Second object to compare, WRITE_NO_OBJECT to hash the first one
+	@param hash Output hash of the first object, NULL when comparing
+	@return true if the data is the same (always true when hashing)
+*/
+static bool Writer_ScanContent(TGr2Writer* w, const TWriteContents* contents, uint32_t a, uint32_t b, uint64_t* hash)
+{
+	const TWriteObject* object = Writer_GetObject(w, a);
+	const uint8_t* other = b != WRITE_NO_OBJECT ? Writer_GetObject(w, b)->src : NULL;
+	uint32_t position = 0;
+
+	for (size_t i = contents->firstSlot[a]; i <= contents->firstSlot[a + 1]; i++)
+	{
+		uint32_t end = object->size;
+
+		if (i < contents->firstSlot[a + 1])
+		{
+			end = ((const TWriteSlot*)DArray_Get(&w->slots, i))->offset;
+
+			if (end < position)
+				continue;
+		}
+
+		if (hash)
+			*hash = HashTable_HashBytes(object->src + position, end - position, *hash);
+		else if (memcmp(object->src + position, other + position, end - position))
+			return false;
+
+		position = end + w->ptrSize < object->size ? end + w->ptrSize : object->size;
+	}
+
+	return true;
+}
+
+/*!
+	Checks if two objects are written with the same bytes and point to the same data
+	@param w The writer
+	@param contents The contents of the objects
+	@param a First object
+	@param b Second object
+	@return true if the objects are identical
+*/
+static bool Writer_SameContent(TGr2Writer* w, TWriteContents* contents, uint32_t a, uint32_t b)
+{
+	const TWriteObject* oa = Writer_GetObject(w, a);
+	const TWriteObject* ob = Writer_GetObject(w, b);
+	size_t slots = contents->firstSlot[a + 1] - contents->firstSlot[a];
+
+	if (oa->kind != ob->kind || oa->size != ob->size || contents->hash[a] != contents->hash[b] || slots != contents->firstSlot[b + 1] - contents->firstSlot[b])
+		return false;
+
+	for (size_t i = 0; i < slots; i++)
+	{
+		const TWriteSlot* sa = (const TWriteSlot*)DArray_Get(&w->slots, contents->firstSlot[a] + i);
+		const TWriteSlot* sb = (const TWriteSlot*)DArray_Get(&w->slots, contents->firstSlot[b] + i);
+
+		if (sa->offset != sb->offset || Writer_FindCanonical(contents, sa->target) != Writer_FindCanonical(contents, sb->target))
+			return false;
+	}
+
+	return Writer_ScanContent(w, contents, a, b, NULL);
+}
+
+/*!
+	Merges the objects with the same contents, so they are written once and all their pointers
+	point to the same copy
+
+	Objects are identical when their bytes match outside the pointers and the pointers lead to
+	identical objects; every pass merges the objects whose pointed objects were merged by the
+	previous one (e.g. type nodes after their names), until nothing changes
+	@param w The writer
+	@return true if the objects were merged, otherwise false
+	@note Objects inside other objects, or with objects inside them, are not merged
+*/
+static bool Writer_Deduplicate(TGr2Writer* w)
+{
+	TWriteContents contents;
+	THashTable table;
+	bool* skip;
+	uint32_t merged, count = (uint32_t)w->objects.count;
+	bool success = false;
+
+	memset(&table, 0, sizeof(table));
+	contents.firstSlot = (size_t*)calloc((size_t)count + 1, sizeof(size_t));
+	contents.hash = (uint64_t*)calloc(count ? count : 1, sizeof(uint64_t));
+	contents.canonical = (uint32_t*)malloc(sizeof(uint32_t) * (count ? count : 1));
+	skip = (bool*)calloc(count ? count : 1, sizeof(bool));
+
+	if (!contents.firstSlot || !contents.hash || !contents.canonical || !skip)
+	{
+		dbg_printf("memory allocation fail!!!");
+		goto end;
+	}
+
+	/* the slots were added object by object while walking them */
+	for (uint32_t i = 0, s = 0; i <= count; i++)
+	{
+		contents.firstSlot[i] = s;
+
+		while (i < count && s < w->slots.count && ((const TWriteSlot*)DArray_Get(&w->slots, s))->object == i)
+			s++;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TWriteObject* object = Writer_GetObject(w, i);
+
+		contents.canonical[i] = i;
+
+		if (object->container != WRITE_NO_OBJECT)
+			skip[i] = skip[object->container] = true;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		contents.hash[i] = HashTable_HashBytes(&Writer_GetObject(w, i)->size, sizeof(uint32_t), HASHTABLE_SEED);
+		Writer_ScanContent(w, &contents, i, WRITE_NO_OBJECT, &contents.hash[i]);
+	}
+
+	do
+	{
+		merged = 0;
+
+		if (!HashTable_Init(&table, count))
+			goto end;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t key = contents.hash[i];
+			size_t cursor = 0;
+			void* value;
+
+			if (skip[i] || contents.canonical[i] != i)
+				continue;
+
+			for (size_t s = contents.firstSlot[i]; s < contents.firstSlot[i + 1]; s++)
+			{
+				uint32_t target = Writer_FindCanonical(&contents, ((const TWriteSlot*)DArray_Get(&w->slots, s))->target);
+
+				key = HashTable_HashBytes(&target, sizeof(target), key);
+			}
+
+			while ((value = HashTable_Find(&table, key, &cursor)))
+			{
+				if (Writer_SameContent(w, &contents, i, (uint32_t)((uintptr_t)value - 1)))
+				{
+					contents.canonical[i] = (uint32_t)((uintptr_t)value - 1);
+					merged++;
+					break;
+				}
+			}
+
+			if (contents.canonical[i] == i && !HashTable_Add(&table, key, (void*)(uintptr_t)(i + 1)))
+				goto end;
+		}
+
+		HashTable_Free(&table);
+	} while (merged);
+
+	/* a merged object is written as part of it's copy */
+	for (uint32_t i = 0; i < count; i++)
+	{
+		TWriteObject* object = Writer_GetObject(w, i);
+
+		if (Writer_FindCanonical(&contents, i) != i)
+		{
+			object->container = Writer_FindCanonical(&contents, i);
+			object->offset = 0;
+		}
+	}
+
+	success = true;
+
+end:
+	HashTable_Free(&table);
+	free(contents.firstSlot);
+	free(contents.hash);
+	free(contents.canonical);
+	free(skip);
+	return success;
+}
+
+/*!
+	Chooses the sector of an object
+	@param w The writer
+	@param object The object, not contained in another one
+	@param pointers true if the data of the object contains pointers
+	@return the output sector
+*/
+static uint32_t Writer_ChooseSector(TGr2Writer* w, const TWriteObject* object, bool pointers)
+{
+	uint32_t sector = 0;
+
+	if (w->gr2->writeLayout == GR2_WRITE_LAYOUT_CLUSTER)
+		return object->kind == WRITE_OBJECT_STRUCTURES && !pointers && object->size >= WRITE_BULK_MIN_SIZE ? GR2_SECTOR_BULK : GR2_SECTOR_METADATA;
+
+	/* loaded objects stay in their sector */
+	if (Writer_IsLoaded(w, object->src))
+	{
+		size_t position = object->src - w->gr2->data;
+
+		for (uint32_t s = 1; s < w->gr2->fileInfo.sectorCount && s < w->sectorCount; s++)
+		{
+			if (w->gr2->sectorOffsets[s] <= position && w->gr2->sectors[s].decompressLen)
+				sector = s;
+		}
+	}
+
+	return sector;
+}
+
+/*!
+	Places the objects inside the sectors
+	@param w The writer
+	@return true if the objects were placed, false if a sector is too big
+*/
+static bool Writer_Place(TGr2Writer* w)
+{
+	bool* pointers = (bool*)calloc(w->objects.count ? w->objects.count : 1, sizeof(bool));
+
+	if (!pointers)
+	{
+		dbg_printf("memory allocation fail!!!");
+		return false;
+	}
+
+	/* the pointers of a contained object are inside it's container */
+	for (size_t i = 0; i < w->slots.count; i++)
+	{
+		uint32_t object = ((const TWriteSlot*)DArray_Get(&w->slots, i))->object;
+
+		while (Writer_GetObject(w, object)->container != WRITE_NO_OBJECT)
+			object = Writer_GetObject(w, object)->container;
+
+		pointers[object] = true;
+	}
+
+	for (uint32_t i = 0; i < w->objects.count; i++)
+	{
+		TWriteObject* object = Writer_GetObject(w, i);
+		TSector* sector;
+		uint64_t offset;
+
+		if (object->container != WRITE_NO_OBJECT)
+			continue;
+
+		object->sector = Writer_ChooseSector(w, object, pointers[i]);
+		sector = &w->sectors[object->sector];
+		offset = sector->decompressLen;
+
+		if (object->kind != WRITE_OBJECT_STRING)
+			offset = (offset + sector->alignment - 1) & ~(uint64_t)(sector->alignment - 1);
+
+		if (offset + object->size > UINT32_MAX)
+		{
+			dbg_printf("sector %u is too big", object->sector);
+			free(pointers);
+			return false;
+		}
+
+		object->offset = (uint32_t)offset;
+		sector->decompressLen = (uint32_t)(offset + object->size);
+	}
+
+	free(pointers);
+
+	/* the sectors are loaded one after the other, the padding keeps the next one aligned */
+	for (uint32_t s = 0; s + 1 < w->sectorCount; s++)
+	{
+		uint32_t alignment = w->sectors[s + 1].alignment;
+
+		if ((uint64_t)w->sectors[s].decompressLen + alignment - 1 > UINT32_MAX)
+		{
+			dbg_printf("sector %u is too big", s);
+			return false;
+		}
+
+		w->sectors[s].decompressLen = (w->sectors[s].decompressLen + alignment - 1) & ~(alignment - 1);
+	}
+
+	/* the containers are placed, the contained objects follow them */
+	for (uint32_t i = 0; i < w->objects.count; i++)
+	{
+		TWriteObject* object = Writer_GetObject(w, i);
+
+		if (object->container != WRITE_NO_OBJECT)
+		{
+			const TWriteObject* container = Writer_GetObject(w, object->container);
+
+			object->sector = container->sector;
+			object->offset += container->offset;
+		}
+	}
+
+	return true;
+}
+
+/*!
+	Orders the fixups by output position, the pointers written as NULL last
+*/
+static int Writer_CompareFixUps(const void* a, const void* b)
+{
+	const TWriteFixUp* fa = (const TWriteFixUp*)a;
+	const TWriteFixUp* fb = (const TWriteFixUp*)b;
+
+	if (fa->sector != fb->sector)
+		return fa->sector < fb->sector ? -1 : 1;
+
+	if (fa->data.srcOffset != fb->data.srcOffset)
+		return fa->data.srcOffset < fb->data.srcOffset ? -1 : 1;
+
+	return fa->data.dstSector < fb->data.dstSector ? -1 : fa->data.dstSector > fb->data.dstSector;
+}
+
+/*!
+	Resolves the pointers to their output position and builds the fixup tables
+	@param w The writer
+	@return true if the fixups were built, otherwise false
+*/
+static bool Writer_BuildFixUps(TGr2Writer* w)
+{
+	size_t count = 0;
+
+	if (!DArray_Resize(&w->fixups, w->slots.count ? w->slots.count : 1))
+		return false;
+
+	for (size_t i = 0; i < w->slots.count; i++)
+	{
+		const TWriteSlot* slot = (const TWriteSlot*)DArray_Get(&w->slots, i);
+		const TWriteObject* object = Writer_GetObject(w, slot->object);
+		TWriteFixUp* fixup = (TWriteFixUp*)(w->fixups.data + i * sizeof(TWriteFixUp));
+
+		fixup->sector = object->sector;
+		fixup->data.srcOffset = object->offset + slot->offset;
+		fixup->data.dstSector = WRITE_NO_OBJECT;
+		fixup->data.dstOffset = 0;
+
+		if (slot->target != WRITE_NO_OBJECT)
+		{
+			fixup->data.dstSector = Writer_GetObject(w, slot->target)->sector;
+			fixup->data.dstOffset = Writer_GetObject(w, slot->target)->offset;
+		}
+	}
+
+	qsort(w->fixups.data, w->slots.count, sizeof(TWriteFixUp), Writer_CompareFixUps);
+
+	/* a pointer reached from an object and from it's container is kept once */
+	for (size_t i = 0; i < w->slots.count; i++)
+	{
+		const TWriteFixUp* fixup = (const TWriteFixUp*)(w->fixups.data + i * sizeof(TWriteFixUp));
+
+		if (count)
+		{
+			const TWriteFixUp* last = (const TWriteFixUp*)(w->fixups.data + (count - 1) * sizeof(TWriteFixUp));
+
+			if (last->sector == fixup->sector && last->data.srcOffset == fixup->data.srcOffset)
+				continue;
+		}
+
+		memmove(w->fixups.data + count * sizeof(TWriteFixUp), fixup, sizeof(TWriteFixUp));
+		count++;
+	}
+
+	w->fixups.count = count;
+
+	for (uint32_t s = 0, i = 0; s <= w->sectorCount; s++)
+	{
+		w->firstFixUp[s] = i;
+
+		while (s < w->sectorCount && i < count && ((const TWriteFixUp*)DArray_Get(&w->fixups, i))->sector == s)
+		{
+			if (((const TWriteFixUp*)DArray_Get(&w->fixups, i))->data.dstSector != WRITE_NO_OBJECT)
+				w->sectors[s].fixupSize++;
+
+			i++;
+		}
+	}
+
+	return true;
+}
+
+/*!
+	Computes the position of the sectors and of the fixup tables inside the file
+	@param w The writer
+	@return true if the file fits in the 32-bit offsets, otherwise false
+	@note The sectors must be encoded first, the positions depend on their compressed length
+*/
+static bool Writer_LayoutFile(TGr2Writer* w)
+{
+	uint64_t position = sizeof(THeader) + w->fileInfoSize + (uint64_t)sizeof(TSector) * w->sectorCount;
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		TSector* sector = &w->sectors[s];
+
+		position = (position + WRITE_ALIGNMENT - 1) & ~(uint64_t)(WRITE_ALIGNMENT - 1);
+
+		sector->dataOffset = (uint32_t)position;
+		position += sector->compressedLen;
+	}
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		w->sectors[s].fixupOffset = (uint32_t)position;
+		position += (uint64_t)sizeof(TFixUpData) * w->sectors[s].fixupSize;
+	}
+
+	/* the file has the byte order of the platform, there is nothing to marshall (see Gr2_Compose) */
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		w->sectors[s].marshallOffset = (uint32_t)position;
+		w->sectors[s].marshallSize = 0;
+	}
+
+	if (position > UINT32_MAX)
+	{
+		dbg_printf("file size %llu does not fit in 32 bits", (unsigned long long)position);
+		return false;
+	}
+
+	w->totalSize = (uint32_t)position;
+	return true;
+}
+
+/*!
+	Writes the data of an object, with the pointers set to NULL
+	@param w The writer
+	@param buffer The output
+	@param object The object
+	@param fixup Current fixup of the sector, updated past the pointers of the object
+	@param end End of the fixups of the sector
+	@return true if the data was written, otherwise false
+*/
+static bool Writer_EmitObject(TGr2Writer* w, TWriteBuffer* buffer, const TWriteObject* object, size_t* fixup, size_t end)
+{
+	uint32_t position = 0;
+
+	for (; *fixup < end; (*fixup)++)
+	{
+		const TWriteFixUp* current = (const TWriteFixUp*)DArray_Get(&w->fixups, *fixup);
+		uint32_t slot, len;
+
+		if (current->data.srcOffset >= object->offset + object->size)
+			break;
+
+		if (current->data.srcOffset < object->offset + position)
+			continue;
+
+		slot = current->data.srcOffset - object->offset;
+		len = object->size - slot < w->ptrSize ? object->size - slot : w->ptrSize;
+
+		if (!Writer_Write(buffer, object->src + position, slot - position) || !Writer_WriteZeros(buffer, len))
+			return false;
+
+		position = slot + len;
+	}
+
+	return Writer_Write(buffer, object->src + position, object->size - position);
+}
+
+/*!
+	Writes the uncompressed data of a sector
+	@param w The writer
+	@param sector Index of the sector
+	@param buffer The output, positioned at the start of the sector
+	@return true if the data was written, otherwise false
+*/
+static bool Writer_EmitSector(TGr2Writer* w, uint32_t sector, TWriteBuffer* buffer)
+{
+	uint64_t base = buffer->position;
+	size_t fixup = w->firstFixUp[sector];
+
+	/* the objects of a sector are placed in the order they were found */
+	for (uint32_t i = 0; i < w->objects.count; i++)
+	{
+		const TWriteObject* object = Writer_GetObject(w, i);
+
+		if (object->container != WRITE_NO_OBJECT || object->sector != sector)
+			continue;
+
+		if (!Writer_PadTo(buffer, base + object->offset) || !Writer_EmitObject(w, buffer, object, &fixup, w->firstFixUp[sector + 1]))
+			return false;
+	}
+
+	return Writer_PadTo(buffer, base + w->sectors[sector].decompressLen);
+}
+
+/*!
+	Encodes a sector, run by Platform_RunParallel
+	@param context The TGr2Writer
+	@param index Index of the sector
+*/
+static void Writer_EncodeTask(void* context, uint32_t index)
+{
+	TGr2Writer* w = (TGr2Writer*)context;
+	TSector* sector = &w->sectors[index];
+	TWriteSector* encoded = &w->encoded[index];
+	TWriteBuffer buffer;
+	uint8_t* compressed;
+	uint32_t compressedLen;
+
+	memset(&buffer, 0, sizeof(buffer));
+
+	/* uncompressed sectors are only checksummed, they are streamed later */
+	if (w->compression == COMPRESSION_TYPE_NONE || !sector->decompressLen)
+	{
+		buffer.checksum = true;
+		encoded->failed = !Writer_EmitSector(w, index, &buffer);
+		encoded->crc = buffer.crc;
+		return;
+	}
+
+	buffer.data = (uint8_t*)malloc(sector->decompressLen);
+
+	if (!buffer.data || !Writer_EmitSector(w, index, &buffer))
+	{
+		dbg_printf("cannot build sector %u", index);
+		free(buffer.data);
+		encoded->failed = true;
+		return;
+	}
+
+	encoded->data = buffer.data;
+
+	if (Compression_Encode(w->compression, buffer.data, sector->decompressLen, &compressed, &compressedLen))
+	{
+		/* a sector that doesn't shrink is stored */
+		if (compressedLen < sector->decompressLen)
+		{
+			free(encoded->data);
+			encoded->data = compressed;
+			sector->compressType = w->compression;
+			sector->compressedLen = compressedLen;
+		}
+		else
+			free(compressed);
+	}
+
+	encoded->crc = CRC32(encoded->data, sector->compressedLen);
+}
+
+/*!
+	Writes everything after the file info: sector table, sectors and fixup tables
+	@param w The writer
+	@param buffer The output
+	@return true if the data was written, otherwise false
+*/
+static bool Writer_EmitBody(TGr2Writer* w, TWriteBuffer* buffer)
+{
+	if (!Writer_Write(buffer, (const uint8_t*)w->sectors, sizeof(TSector) * w->sectorCount))
+		return false;
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		if (!Writer_PadTo(buffer, w->sectors[s].dataOffset))
+			return false;
+
+		if (w->encoded && w->encoded[s].data)
+		{
+			if (!buffer->stream)
+				Writer_WriteChecksum(buffer, w->encoded[s].crc, w->sectors[s].compressedLen);
+			else if (!Writer_Write(buffer, w->encoded[s].data, w->sectors[s].compressedLen))
+				return false;
+		}
+		else if (w->encoded && !buffer->stream)
+			Writer_WriteChecksum(buffer, w->encoded[s].crc, w->sectors[s].compressedLen);
+		else if (!Writer_EmitSector(w, s, buffer))
+			return false;
+	}
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		for (size_t i = w->firstFixUp[s]; i < w->firstFixUp[s + 1]; i++)
+		{
+			const TWriteFixUp* fixup = (const TWriteFixUp*)DArray_Get(&w->fixups, i);
+
+			if (fixup->data.dstSector != WRITE_NO_OBJECT && !Writer_Write(buffer, (const uint8_t*)&fixup->data, sizeof(TFixUpData)))
+				return false;
+		}
+	}
+
+	return buffer->position == w->totalSize;
+}
+
+/*!
+	Encodes the sectors on many threads and computes the CRC32 of the file
+	@param w The writer
+	@param threads Maximum number of threads
+	@param crc Output CRC32 of the data after the file info
+	@return true if the sectors were encoded, otherwise false
+*/
+static bool Writer_Encode(TGr2Writer* w, uint32_t threads, uint32_t* crc)
+{
+	TWriteBuffer buffer;
+
+	w->encoded = (TWriteSector*)calloc(w->sectorCount, sizeof(TWriteSector));
+
+	if (!w->encoded)
+	{
+		dbg_printf("memory allocation fail!!!");
+		return false;
+	}
+
+	Platform_RunParallel(Writer_EncodeTask, w, w->sectorCount, threads);
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		if (w->encoded[s].failed)
+			return false;
+	}
+
+	/* the offsets are known once every sector has it's compressed length */
+	if (!Writer_LayoutFile(w))
+		return false;
+
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.checksum = true;
+	buffer.position = sizeof(THeader) + w->fileInfoSize;
+
+	if (!Writer_EmitBody(w, &buffer))
+		return false;
+
+	*crc = buffer.crc;
+	return true;
+}
+
+/*!
+	Frees the memory of a writer
+	@param w The writer
+*/
+static void Writer_Free(TGr2Writer* w)
+{
+	DArray_Free(&w->objects);
+	DArray_Free(&w->slots);
+	DArray_Free(&w->fixups);
+	HashTable_Free(&w->index);
+	free(w->sectors);
+	free(w->firstFixUp);
+
+	for (uint32_t s = 0; w->encoded && s < w->sectorCount; s++)
+		free(w->encoded[s].data);
+
+	free(w->encoded);
+}
+
+/*!
+	Walks the data of a Gr2 structure and lays out the output file
+	@param w The writer to fill, must be freed with Writer_Free even if the function fails
+	@param gr2 The Gr2 structure to write
+	@return true if the file was laid out, otherwise false
+*/
+static bool Writer_Build(TGr2Writer* w, TGr2* gr2)
+{
+	const uint8_t *type, *root;
+	const TTypeLayout* rootLayout;
+
+	memset(w, 0, sizeof(TGr2Writer));
+	w->gr2 = gr2;
+	w->ptrSize = gr2->bitsSize == 64 ? 8 : 4;
+	w->nodeSize = 4 + w->ptrSize * 3 + 4 + 12;
+	w->sectorCount = gr2->writeLayout == GR2_WRITE_LAYOUT_CLUSTER ? GR2_SECTOR_BULK + 1 : gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1;
+	w->fileInfoSize = gr2->fileInfo.format == 7 ? 0x48 : 0x38;
+	w->compression = gr2->writeCompression;
+
+	if (!gr2->data || !gr2->sectorOffsets || gr2->fileInfo.type.sector >= gr2->fileInfo.sectorCount || gr2->fileInfo.root.sector >= gr2->fileInfo.sectorCount)
+	{
+		dbg_printf("there is no data to write");
+		return false;
+	}
+
+	type = gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position;
+	root = gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position;
+	rootLayout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, type);
+
+	if (!rootLayout)
+	{
+		dbg_printf("cannot compile root type");
+		return false;
+	}
+
+	w->sectors = (TSector*)calloc(w->sectorCount, sizeof(TSector));
+	w->firstFixUp = (size_t*)calloc(w->sectorCount + 1, sizeof(size_t));
+
+	if (!w->sectors || !w->firstFixUp || !DArray_Init(&w->objects, sizeof(TWriteObject), 256) || !DArray_Init(&w->slots, sizeof(TWriteSlot), 256) ||
+		!DArray_Init(&w->fixups, sizeof(TWriteFixUp), 1) || !HashTable_Init(&w->index, 256))
+	{
+		dbg_printf("memory allocation fail!!!");
+		return false;
+	}
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+		w->sectors[s].alignment = gr2->writeLayout == GR2_WRITE_LAYOUT_CLUSTER && s == GR2_SECTOR_BULK ? WRITE_BULK_ALIGNMENT : WRITE_ALIGNMENT;
+
+	if (!Writer_AddObject(w, type, WRITE_OBJECT_TYPE, NULL, 1, &w->typeObject) || !Writer_AddObject(w, root, WRITE_OBJECT_STRUCTURES, rootLayout, 1, &w->rootObject))
+		return false;
+
+	/* the objects array is the work queue, every object adds the ones it points */
+	for (uint32_t i = 0; i < w->objects.count; i++)
+	{
+		if (!Writer_WalkObject(w, i))
+			return false;
+	}
+
+	if (!Writer_ResolveContainers(w) || (gr2->writeDeduplicate && !Writer_Deduplicate(w)) || !Writer_Place(w) || !Writer_BuildFixUps(w))
+		return false;
+
+	for (uint32_t s = 0; s < w->sectorCount; s++)
+	{
+		w->sectors[s].compressType = COMPRESSION_TYPE_NONE;
+		w->sectors[s].compressedLen = w->sectors[s].decompressLen;
+		w->sectors[s].oodleStop0 = w->sectors[s].decompressLen;
+		w->sectors[s].oodleStop1 = w->sectors[s].decompressLen;
+	}
+
+	return true;
+}
+
+OG_DLLAPI bool Gr2_Compose(TGr2* gr2, const TGr2Stream* stream)
+{
+	TGr2Writer w;
+	TWriteBuffer buffer;
+	THeader header;
+	TFileInfo fileInfo;
+	uint8_t magicFlags = 0;
+	uint32_t threads, crc = 0;
+	bool success = false, prepared;
+
+	memset(&buffer, 0, sizeof(buffer));
+
+	if (!stream || !stream->write)
+		return false;
+
+	if (gr2->fileInfo.format != 6 && gr2->fileInfo.format != 7)
+	{
+		dbg_printf("file format %u is not supported", gr2->fileInfo.format);
+		return false;
+	}
+
+	/* the marshalling of the loaded file is not applied, the data is only in part in the byte order of the platform */
+	if (gr2->mismatchEndianness)
+	{
+		dbg_printf("the data was loaded with the byte order of the file");
+		return false;
+	}
+
+	if (gr2->fileInfo.format == 7)
+		magicFlags |= MAGIC_FLAG_EXTRA16;
+
+	if (gr2->bitsSize == 64)
+		magicFlags |= MAGIC_FLAG_64BIT;
+
+	if (Platform_IsBigEndian())
+		magicFlags |= MAGIC_FLAG_BIGENDIAN;
+
+	memset(&header, 0, sizeof(header));
+
+	if (!Magic_Set(header.magic, magicFlags))
+	{
+		dbg_printf("there is no magic for flags %u", magicFlags);
+		return false;
+	}
+
+	if (!Writer_Build(&w, gr2))
+		goto end;
+
+	/* the sectors are encoded in advance only when they are compressed or the CRC32 cannot be written back later */
+	threads = gr2->writeThreads ? gr2->writeThreads : Platform_GetCpuCount();
+	prepared = w.compression != COMPRESSION_TYPE_NONE || !stream->seek;
+
+	if (prepared ? !Writer_Encode(&w, threads, &crc) : !Writer_LayoutFile(&w))
+		goto end;
+
+	header.sizeWithSectors = w.fileInfoSize + (uint32_t)sizeof(TSector) * w.sectorCount;
+	header.format = 0;
+	memcpy(header.extra, gr2->header.extra, sizeof(header.extra));
+
+	fileInfo = gr2->fileInfo;
+	fileInfo.fileInfoSize = w.fileInfoSize;
+	fileInfo.totalSize = w.totalSize;
+	fileInfo.crc32 = prepared ? crc : 0;
+	fileInfo.sectorCount = w.sectorCount;
+	fileInfo.type.sector = Writer_GetObject(&w, w.typeObject)->sector;
+	fileInfo.type.position = Writer_GetObject(&w, w.typeObject)->offset;
+	fileInfo.root.sector = Writer_GetObject(&w, w.rootObject)->sector;
+	fileInfo.root.position = Writer_GetObject(&w, w.rootObject)->offset;
+
+	buffer.data = (uint8_t*)malloc(WRITE_BUFFER_SIZE);
+	buffer.stream = stream;
+
+	if (!buffer.data)
+	{
+		dbg_printf("memory allocation fail!!!");
+		goto end;
+	}
+
+	if (!Writer_Write(&buffer, (const uint8_t*)&header, sizeof(header)) || !Writer_Write(&buffer, (const uint8_t*)&fileInfo, fileInfo.fileInfoSize))
+		goto end;
+
+	buffer.checksum = !prepared;
+
+	if (!Writer_EmitBody(&w, &buffer) || !Writer_Flush(&buffer))
+		goto end;
+
+	if (!prepared)
+	{
+		fileInfo.crc32 = buffer.crc;
+
+		if (!stream->seek(stream->context, sizeof(THeader) + offsetof(TFileInfo, crc32)) ||
+			!stream->write(stream->context, &fileInfo.crc32, sizeof(fileInfo.crc32)) ||
+			!stream->seek(stream->context, w.totalSize))
+			goto end;
+	}
+
+	success = true;
+
+end:
+	if (!success)
+	{
+		dbg_printf("cannot write the file");
+	}
+
+	free(buffer.data);
+	Writer_Free(&w);
+	return success;
+}
+
+/*!
+	A modified sector of Gr2_ComposeIncremental
+*/
+typedef struct SWriteDirty
+{
+	uint32_t index; /* index of the sector */
+	TSector sector; /* sector information in the output file */
+	uint8_t* data; /* data stored in the output file */
+	uint32_t paddedLen; /* length of the data in the output file, keeps the following offsets aligned */
+	bool failed; /* true if the sector could not be encoded */
+} TWriteDirty;
+
+/*!
+	State of Gr2_ComposeIncremental
+*/
+typedef struct SWriteIncremental
+{
+	TGr2* gr2; /* the written structure */
+	const uint8_t* original; /* the file the structure was loaded from */
+	uint32_t originalLen; /* length of the original file */
+	uint32_t ptrSize; /* size of a pointer in the file */
+	TWriteDirty* dirty; /* modified sectors, sorted by original data offset */
+	uint32_t dirtyCount; /* number of modified sectors */
+	uint32_t transcodeFrom; /* the sectors with this compression are encoded with transcodeTo */
+	uint32_t transcodeTo; /* same as transcodeFrom when nothing is transcoded */
+} TWriteIncremental;
+
+/*!
+	Compares the original data offset of two modified sectors
+*/
+static int Writer_CompareDirty(const void* a, const void* b)
+{
+	const TWriteDirty* da = (const TWriteDirty*)a;
+	const TWriteDirty* db = (const TWriteDirty*)b;
+
+	if (da->sector.dataOffset != db->sector.dataOffset)
+		return da->sector.dataOffset < db->sector.dataOffset ? -1 : 1;
+
+	return 0;
+}
+
+/*!
+	Moves an offset of the original file to the output file
+	@param inc The incremental writer
+	@param offset Offset in the original file
+	@return the offset in the output file
+*/
+static uint32_t Writer_MoveOffset(const TWriteIncremental* inc, uint32_t offset)
+{
+	uint32_t moved = offset;
+
+	for (uint32_t i = 0; i < inc->dirtyCount && inc->gr2->sectors[inc->dirty[i].index].dataOffset < offset; i++)
+		moved += inc->dirty[i].paddedLen - inc->gr2->sectors[inc->dirty[i].index].compressedLen;
+
+	return moved;
+}
+
+/*!
+	Rebuilds and encodes a modified sector, run by Platform_RunParallel
+	@param context The TWriteIncremental
+	@param index Index of the modified sector
+*/
+static void Writer_EncodeDirtyTask(void* context, uint32_t index)
+{
+	TWriteIncremental* inc = (TWriteIncremental*)context;
+	TWriteDirty* dirty = &inc->dirty[index];
+	TGr2* gr2 = inc->gr2;
+	const TSector* original = &gr2->sectors[dirty->index];
+	uint32_t compression = original->compressType == inc->transcodeFrom ? inc->transcodeTo : original->compressType;
+	uint8_t* compressed = NULL;
+	uint32_t compressedLen;
+
+	dirty->data = (uint8_t*)malloc(original->decompressLen);
+
+	if (!dirty->data)
+	{
+		dbg_printf("memory allocation fail!!!");
+		dirty->failed = true;
+		return;
+	}
+
+	memcpy(dirty->data, gr2->data + gr2->sectorOffsets[dirty->index], original->decompressLen);
+
+	/* the pointers hold virtual pointers, they get back the bytes of the file as long as they still point where the fixups say */
+	for (uint32_t k = 0; k < original->fixupSize; k++)
+	{
+		TFixUpData fd;
+
+		memcpy(&fd, inc->original + original->fixupOffset + k * sizeof(TFixUpData), sizeof(fd));
+
+		if ((uint64_t)fd.srcOffset + inc->ptrSize > original->decompressLen || fd.dstSector >= gr2->fileInfo.sectorCount ||
+			LayoutCache_ReadPtr(&gr2->layouts, &gr2->virtual_ptr, dirty->data + fd.srcOffset) != gr2->data + gr2->sectorOffsets[fd.dstSector] + fd.dstOffset)
+		{
+			dbg_printf("pointer at %u of sector %u was changed", fd.srcOffset, dirty->index);
+			dirty->failed = true;
+			return;
+		}
+
+		if (original->compressType == COMPRESSION_TYPE_NONE)
+			memcpy(dirty->data + fd.srcOffset, inc->original + original->dataOffset + fd.srcOffset, inc->ptrSize);
+		else
+			memset(dirty->data + fd.srcOffset, 0, inc->ptrSize);
+	}
+
+	dirty->sector = *original;
+
+	if (original->compressType == COMPRESSION_TYPE_NONE && compression == COMPRESSION_TYPE_NONE)
+	{
+		dirty->paddedLen = original->compressedLen;
+		return;
+	}
+
+	if (compression != COMPRESSION_TYPE_NONE && Compression_Encode(compression, dirty->data, original->decompressLen, &compressed, &compressedLen) && compressedLen < original->decompressLen)
+	{
+		free(dirty->data);
+		dirty->data = compressed;
+		dirty->sector.compressType = compression;
+		dirty->sector.compressedLen = compressedLen;
+	}
+	else
+	{
+		/* without an encoder for the compression, or when it doesn't shrink, the sector is stored */
+		free(compressed);
+
+		dirty->sector.compressType = COMPRESSION_TYPE_NONE;
+		dirty->sector.compressedLen = original->decompressLen;
+		dirty->sector.oodleStop0 = original->decompressLen;
+		dirty->sector.oodleStop1 = original->decompressLen;
+	}
+
+	/* pad to keep the distance from the original offsets a multiple of 4 */
+	dirty->paddedLen = dirty->sector.compressedLen + ((original->compressedLen - dirty->sector.compressedLen) & (WRITE_ALIGNMENT - 1));
+}
+
+/*!
+	Writes the sector table and the data after it, with the modified sectors replaced
+	@param inc The incremental writer
+	@param sectors Output sector table
+	@param buffer The output
+	@return true if the data was written, otherwise false
+*/
+static bool Writer_EmitIncremental(const TWriteIncremental* inc, const TSector* sectors, TWriteBuffer* buffer)
+{
+	uint32_t position = (uint32_t)(sizeof(THeader) + inc->gr2->fileInfo.fileInfoSize + sizeof(TSector) * inc->gr2->fileInfo.sectorCount);
+
+	if (!Writer_Write(buffer, (const uint8_t*)sectors, sizeof(TSector) * inc->gr2->fileInfo.sectorCount))
+		return false;
+
+	for (uint32_t i = 0; i < inc->dirtyCount; i++)
+	{
+		const TWriteDirty* dirty = &inc->dirty[i];
+		const TSector* original = &inc->gr2->sectors[dirty->index];
+
+		if (!Writer_Write(buffer, inc->original + position, original->dataOffset - position) ||
+			!Writer_Write(buffer, dirty->data, dirty->sector.compressedLen) ||
+			!Writer_WriteZeros(buffer, dirty->paddedLen - dirty->sector.compressedLen))
+			return false;
+
+		position = original->dataOffset + original->compressedLen;
+	}
+
+	return Writer_Write(buffer, inc->original + position, inc->originalLen - position);
+}
+
+/*!
+	Computes the CRC32 of a file where only the contents of uncompressed sectors changed
+
+	For messages of the same length the CRC32 is linear in the xor of the messages, so the
+	difference of every sector is shifted by the bytes that follow it and added to the old CRC32
+	@param inc The incremental writer
+	@return the CRC32 of the data after the file info
+*/
+static uint32_t Writer_UpdateCrc(const TWriteIncremental* inc)
+{
+	uint32_t crc = inc->gr2->fileInfo.crc32;
+
+	for (uint32_t i = 0; i < inc->dirtyCount; i++)
+	{
+		const TSector* sector = &inc->dirty[i].sector;
+		uint32_t diff;
+
+		/* CRC32_Update with an initial value of ~0 is the crc register without the pre and post inversions */
+		diff = ~CRC32_Update(UINT32_MAX, inc->original + sector->dataOffset, sector->compressedLen) ^ ~CRC32_Update(UINT32_MAX, inc->dirty[i].data, sector->compressedLen);
+		crc ^= CRC32_Combine(diff, 0, inc->originalLen - (sector->dataOffset + sector->compressedLen));
+	}
+
+	return crc;
+}
+
+/*!
+	Writes a loaded file again re-encoding the modified sectors and the transcoded ones (see Gr2_ComposeIncremental)
+	@param gr2 The Gr2 structure, loaded from original
+	@param original The file the structure was loaded from
+	@param len Length of the original file
+	@param stream Destination of the file
+	@param transcodeFrom Compression of the sectors to transcode
+	@param transcodeTo Compression of the transcoded sectors, transcodeFrom to transcode nothing
+	@return true if the file was written, otherwise false
+*/
+static bool Writer_ComposeIncremental(TGr2* gr2, const uint8_t* original, size_t len, const TGr2Stream* stream, uint32_t transcodeFrom, uint32_t transcodeTo)
+{
+	TWriteIncremental inc;
+	TWriteBuffer buffer;
+	TFileInfo fileInfo;
+	TSector* sectors = NULL;
+	uint32_t threads, headerSize;
+	bool success = false, moved = false;
+
+	memset(&inc, 0, sizeof(inc));
+	memset(&buffer, 0, sizeof(buffer));
+
+	if (!stream || !stream->write || !gr2->data || !gr2->sectors || !gr2->dirtySectors)
+		return false;
+
+	headerSize = (uint32_t)sizeof(THeader) + gr2->fileInfo.fileInfoSize;
+
+	/* the structure must still describe the original file */
+	if (gr2->mismatchEndianness || len != gr2->fileInfo.totalSize || len < headerSize + sizeof(TSector) * gr2->fileInfo.sectorCount ||
+		memcmp(original + sizeof(THeader) + offsetof(TFileInfo, crc32), &gr2->fileInfo.crc32, sizeof(gr2->fileInfo.crc32)) ||
+		memcmp(original + headerSize, gr2->sectors, sizeof(TSector) * gr2->fileInfo.sectorCount))
+	{
+		dbg_printf("the original file does not match the structure");
+		return false;
+	}
+
+	inc.gr2 = gr2;
+	inc.original = original;
+	inc.originalLen = (uint32_t)len;
+	inc.ptrSize = gr2->bitsSize == 64 ? 8 : 4;
+	inc.transcodeFrom = transcodeFrom;
+	inc.transcodeTo = transcodeTo;
+	inc.dirty = (TWriteDirty*)calloc(gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1, sizeof(TWriteDirty));
+	sectors = (TSector*)malloc(sizeof(TSector) * (gr2->fileInfo.sectorCount ? gr2->fileInfo.sectorCount : 1));
+	buffer.data = (uint8_t*)malloc(WRITE_BUFFER_SIZE);
+
+	if (!inc.dirty || !sectors || !buffer.data)
+	{
+		dbg_printf("memory allocation fail!!!");
+		goto end;
+	}
+
+	for (uint32_t s = 0; s < gr2->fileInfo.sectorCount; s++)
+	{
+		bool transcoded = transcodeFrom != transcodeTo && gr2->sectors[s].compressType == transcodeFrom;
+
+		if ((gr2->dirtySectors[s] || transcoded) && gr2->sectors[s].decompressLen)
+		{
+			inc.dirty[inc.dirtyCount].index = s;
+			inc.dirty[inc.dirtyCount].sector = gr2->sectors[s];
+			inc.dirtyCount++;
+		}
+	}
+
+	qsort(inc.dirty, inc.dirtyCount, sizeof(TWriteDirty), Writer_CompareDirty);
+
+	threads = gr2->writeThreads ? gr2->writeThreads : Platform_GetCpuCount();
+	Platform_RunParallel(Writer_EncodeDirtyTask, &inc, inc.dirtyCount, threads);
+
+	for (uint32_t i = 0; i < inc.dirtyCount; i++)
+	{
+		if (inc.dirty[i].failed)
+			goto end;
+
+		moved |= inc.dirty[i].sector.compressType != gr2->sectors[inc.dirty[i].index].compressType || inc.dirty[i].paddedLen != gr2->sectors[inc.dirty[i].index].compressedLen;
+	}
+
+	memcpy(sectors, gr2->sectors, sizeof(TSector) * gr2->fileInfo.sectorCount);
+
+	for (uint32_t i = 0; i < inc.dirtyCount; i++)
+		sectors[inc.dirty[i].index] = inc.dirty[i].sector;
+
+	for (uint32_t s = 0; moved && s < gr2->fileInfo.sectorCount; s++)
+	{
+		sectors[s].dataOffset = Writer_MoveOffset(&inc, gr2->sectors[s].dataOffset);
+		sectors[s].fixupOffset = Writer_MoveOffset(&inc, gr2->sectors[s].fixupOffset);
+		sectors[s].marshallOffset = Writer_MoveOffset(&inc, gr2->sectors[s].marshallOffset);
+	}
+
+	fileInfo = gr2->fileInfo;
+	fileInfo.totalSize = Writer_MoveOffset(&inc, inc.originalLen);
+
+	/* a different layout needs a pass over the whole file, otherwise only the modified sectors are read */
+	if (moved)
+	{
+		TWriteBuffer checksum;
+
+		memset(&checksum, 0, sizeof(checksum));
+		checksum.checksum = true;
+		checksum.position = headerSize;
+
+		if (!Writer_EmitIncremental(&inc, sectors, &checksum))
+			goto end;
+
+		fileInfo.crc32 = checksum.crc;
+	}
+	else
+		fileInfo.crc32 = Writer_UpdateCrc(&inc);
+
+	buffer.stream = stream;
+
+	if (!Writer_Write(&buffer, original, sizeof(THeader)) || !Writer_Write(&buffer, (const uint8_t*)&fileInfo, fileInfo.fileInfoSize) ||
+		!Writer_EmitIncremental(&inc, sectors, &buffer) || !Writer_Flush(&buffer) || buffer.position != fileInfo.totalSize)
+		goto end;
+
+	/* the structure now describes the written file */
+	memcpy(gr2->sectors, sectors, sizeof(TSector) * gr2->fileInfo.sectorCount);
+	memset(gr2->dirtySectors, 0, sizeof(bool) * gr2->fileInfo.sectorCount);
+	gr2->fileInfo.totalSize = fileInfo.totalSize;
+	gr2->fileInfo.crc32 = fileInfo.crc32;
+	success = true;
+
+end:
+	if (!success)
+	{
+		dbg_printf("cannot write the file");
+	}
+
+	for (uint32_t i = 0; inc.dirty && i < inc.dirtyCount; i++)
+		free(inc.dirty[i].data);
+
+	free(inc.dirty);
+	free(sectors);
+	free(buffer.data);
+	return success;
+}
+
+OG_DLLAPI bool Gr2_ComposeIncremental(TGr2* gr2, const uint8_t* original, size_t len, const TGr2Stream* stream)
 {
-	// TODO
+	return Writer_ComposeIncremental(gr2, original, len, stream, COMPRESSION_TYPE_NONE, COMPRESSION_TYPE_NONE);
+}
+
+OG_DLLAPI bool Gr2_Transcode(TGr2* gr2, const uint8_t* original, size_t len, uint32_t from, uint32_t to, const TGr2Stream* stream)
+{
+	return Writer_ComposeIncremental(gr2, original, len, stream, from, to);
+}
 
-	size_t completeSize;
+/*!
+	Writes to the file descriptor of a TWriteFd
+*/
+static bool Gr2_WriteFd(void* context, const void* data, size_t len)
+{
+	const TWriteFd* out = (const TWriteFd*)context;
 
-	for (size_t i = 0; i < gr2->elements.count; i++)
+	while (len)
 	{
+#ifdef _WIN32
+		int written = _write(out->fd, data, len > 0x40000000 ? 0x40000000 : (unsigned int)len);
+#else
+		ssize_t written = write(out->fd, data, len);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+#endif
+		if (written <= 0)
+			return false;
 
+		data = (const uint8_t*)data + written;
+		len -= (size_t)written;
 	}
 
-	return false;
+	return true;
+}
+
+/*!
+	Seeks the file descriptor of a TWriteFd
+*/
+static bool Gr2_SeekFd(void* context, uint64_t position)
+{
+	const TWriteFd* out = (const TWriteFd*)context;
+
+#ifdef _WIN32
+	return _lseeki64(out->fd, out->start + (int64_t)position, SEEK_SET) >= 0;
+#else
+	return lseek(out->fd, (off_t)(out->start + (int64_t)position), SEEK_SET) >= 0;
+#endif
+}
+
+OG_DLLAPI bool Gr2_ComposeFd(TGr2* gr2, int fd)
+{
+	TWriteFd out;
+	TGr2Stream stream;
+
+	out.fd = fd;
+#ifdef _WIN32
+	out.start = _lseeki64(fd, 0, SEEK_CUR);
+#else
+	out.start = lseek(fd, 0, SEEK_CUR);
+#endif
+
+	stream.context = &out;
+	stream.write = Gr2_WriteFd;
+	stream.seek = out.start >= 0 ? Gr2_SeekFd : NULL; /* pipes and sockets cannot seek */
+
+	return Gr2_Compose(gr2, &stream);
 }
@@ -0,0 +1,149 @@
+/*!
+	Project: libopengrn
+	File: hashtable.c
+	Simple open addressing hash table
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "hashtable.h"
+#include "debug.h"
+
+#include <stdlib.h>
+
+/*!
+	Mixes the bits of a key to get the first slot of the key
+	@param key the key to mix
+	@return the mixed key
+*/
+static uint64_t HashTable_Mix(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+static void HashTable_Insert(THashEntry* entries, size_t capacity, uint64_t key, void* value)
+{
+	size_t mask = capacity - 1, i = HashTable_Mix(key) & mask;
+
+	while (entries[i].value)
+		i = (i + 1) & mask;
+
+	entries[i].key = key;
+	entries[i].value = value;
+}
+
+static bool HashTable_Grow(THashTable* t, size_t newCapacity)
+{
+	THashEntry* entries = (THashEntry*)calloc(newCapacity, sizeof(THashEntry));
+
+	if (!entries)
+	{
+		dbg_printf("hash table alloc of %zu fail", newCapacity);
+		return false;
+	}
+
+	for (size_t i = 0; i < t->capacity; i++)
+	{
+		if (t->entries[i].value)
+			HashTable_Insert(entries, newCapacity, t->entries[i].key, t->entries[i].value);
+	}
+
+	free(t->entries);
+	t->entries = entries;
+	t->capacity = newCapacity;
+	return true;
+}
+
+OG_DLLAPI bool HashTable_Init(THashTable* t, size_t initialSize)
+{
+	size_t capacity = 16;
+
+	while (capacity < initialSize + initialSize / 2)
+		capacity <<= 1;
+
+	t->entries = NULL;
+	t->count = 0;
+	t->capacity = 0;
+
+	return HashTable_Grow(t, capacity);
+}
+
+OG_DLLAPI void HashTable_Free(THashTable* t)
+{
+	if (t->entries)
+	{
+		free(t->entries);
+		t->entries = NULL;
+	}
+
+	t->count = 0;
+	t->capacity = 0;
+}
+
+OG_DLLAPI bool HashTable_Add(THashTable* t, uint64_t key, void* value)
+{
+	if (!value || !t->capacity)
+		return false;
+
+	/* keep the load factor under 75% */
+	if ((t->count + 1) * 4 > t->capacity * 3)
+	{
+		if (!HashTable_Grow(t, t->capacity * 2))
+			return false;
+	}
+
+	HashTable_Insert(t->entries, t->capacity, key, value);
+	t->count++;
+	return true;
+}
+
+OG_DLLAPI void* HashTable_Find(THashTable* t, uint64_t key, size_t* cursor)
+{
+	size_t mask, i;
+
+	if (!t->capacity)
+		return NULL;
+
+	mask = t->capacity - 1;
+	i = (HashTable_Mix(key) + *cursor) & mask;
+
+	for (; *cursor < t->capacity && t->entries[i].value; i = (i + 1) & mask)
+	{
+		(*cursor)++;
+
+		if (t->entries[i].key == key)
+			return t->entries[i].value;
+	}
+
+	return NULL;
+}
+
+OG_DLLAPI void* HashTable_Get(THashTable* t, uint64_t key)
+{
+	size_t cursor = 0;
+	return HashTable_Find(t, key, &cursor);
+}
+
+OG_DLLAPI uint64_t HashTable_HashPtr(const void* ptr)
+{
+	return (uint64_t)(uintptr_t)ptr;
+}
+
+OG_DLLAPI uint64_t HashTable_HashBytes(const void* data, size_t len, uint64_t seed)
+{
+	const uint8_t* p = (const uint8_t*)data;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		seed ^= p[i];
+		seed *= 0x100000001b3ULL;
+	}
+
+	return seed;
+}
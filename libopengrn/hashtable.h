@@ -0,0 +1,103 @@
+/*!
+	Project: libopengrn
+	File: hashtable.h
+	Simple open addressing hash table
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "dllapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Entry of the hash table
+	@note A slot is considered empty when value is NULL
+*/
+typedef struct SHashEntry
+{
+	uint64_t key; /* hashed key */
+	void* value; /* stored value */
+} THashEntry;
+
+/*!
+	Hash table that maps 64-bit keys to pointers, the same key can be stored
+	multiple times (see HashTable_Find)
+*/
+typedef struct SHashTable
+{
+	THashEntry* entries; /* entry slots */
+	size_t count; /* number of used slots */
+	size_t capacity; /* number of slots (always a power of two) */
+} THashTable;
+
+/*!
+	Initializes a new hash table
+	@param t The table to initialize
+	@param initialSize Number of elements that the table can hold before growing
+	@return true if the initialization succeeded, otherwise false
+*/
+extern OG_DLLAPI bool HashTable_Init(THashTable* t, size_t initialSize);
+
+/*!
+	Frees the memory of an hash table (the values are not freed)
+	@param t The table to free
+*/
+extern OG_DLLAPI void HashTable_Free(THashTable* t);
+
+/*!
+	Adds a new value inside the table
+	@param t The table
+	@param key The key of the value
+	@param value The value to add (must not be NULL)
+	@return true if the value was added, otherwise false
+*/
+extern OG_DLLAPI bool HashTable_Add(THashTable* t, uint64_t key, void* value);
+
+/*!
+	Finds a value with the specified key
+	@param t The table
+	@param key The key to search
+	@param cursor Position where the search starts, the value must be 0 in the first call
+		and it's updated so that the next call returns the next value with the same key
+	@return The found value or NULL if there are no more values with that key
+*/
+extern OG_DLLAPI void* HashTable_Find(THashTable* t, uint64_t key, size_t* cursor);
+
+/*!
+	Gets the first value with the specified key
+	@param t The table
+	@param key The key to search
+	@return The found value or NULL if the key does not exist
+*/
+extern OG_DLLAPI void* HashTable_Get(THashTable* t, uint64_t key);
+
+/*!
+	Hashes a pointer
+	@param ptr The pointer to hash
+	@return the hashed value
+*/
+extern OG_DLLAPI uint64_t HashTable_HashPtr(const void* ptr);
+
+/*!
+	Hashes a sequence of bytes (FNV-1a)
+	@param data The data to hash
+	@param len Length of the data
+	@param seed Previous hash value (use HASHTABLE_SEED for a new hash)
+	@return the hashed value
+*/
+extern OG_DLLAPI uint64_t HashTable_HashBytes(const void* data, size_t len, uint64_t seed);
+
+#define HASHTABLE_SEED 0xcbf29ce484222325ULL
+
+#ifdef __cplusplus
+}
+#endif
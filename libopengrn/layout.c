@@ -0,0 +1,401 @@
+/*!
+	Project: libopengrn
+	File: layout.c
+	Compiled type layouts
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "layout.h"
+#include "typeinfo.h"
+#include "elements.h"
+#include "virtual_ptr.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool LayoutCache_Init(TLayoutCache* cache)
+{
+	LayoutCache_SetBits(cache, false);
+
+	if (!HashTable_Init(&cache->table, 64))
+		return false;
+
+	return DArray_Init(&cache->layouts, sizeof(TTypeLayout*), 64);
+}
+
+void LayoutCache_SetBits(TLayoutCache* cache, bool is64)
+{
+	cache->is64 = is64;
+
+	if (is64)
+	{
+		cache->parseType = TypeInfo_Parse64;
+		cache->parsers = ELEMENT_PARSE_64;
+	}
+	else
+	{
+		cache->parseType = TypeInfo_Parse32;
+		cache->parsers = ELEMENT_PARSE_32;
+	}
+}
+
+void LayoutCache_Free(TLayoutCache* cache)
+{
+	for (size_t i = 0; i < cache->layouts.count; i++)
+	{
+		TTypeLayout* layout = *(TTypeLayout**)DArray_Get(&cache->layouts, i);
+
+		HashTable_Free(&layout->names);
+		free(layout->members);
+		free(layout);
+	}
+
+	DArray_Free(&cache->layouts);
+	HashTable_Free(&cache->table);
+}
+
+/*!
+	Checks if a member requires the parsing of it's children
+	@param type Type of the member
+	@param childType Decoded children type of the member
+	@return true if the children has to be parsed
+*/
+static bool Layout_NeedsRecurse(uint32_t type, const uint8_t* childType)
+{
+	if (type == TYPEID_VARIANTREFERENCE || type == TYPEID_REFERENCETOVARIANTARRAY)
+		return true; /* type is stored inside the data */
+
+	return childType && (type == TYPEID_INLINE || type == TYPEID_REFERENCE || type == TYPEID_REFERENCETOARRAY || type == TYPEID_ARRAYOFREFERENCES);
+}
+
+/*!
+	Compiles the type nodes into a new layout
+	@param cache The cache where the layout is stored
+	@param vptr Virtual pointer table
+	@param type Pointer to the first type node
+	@return the compiled layout or NULL in case of an error
+*/
+static TTypeLayout* Layout_Compile(TLayoutCache* cache, TVirtualPtrTable* vptr, const uint8_t* type)
+{
+	TTypeLayout* layout;
+	TNodeTypeInfo info;
+	uint64_t offset = 0;
+	uint32_t i, count = 0, ofs = 0;
+
+	while (cache->parseType(type, &info, &offset))
+		count++;
+
+	layout = (TTypeLayout*)malloc(sizeof(TTypeLayout));
+
+	if (!layout)
+		return NULL;
+
+	layout->type = type;
+	layout->count = count;
+	layout->stride = 0;
+	layout->compiling = true;
+	layout->treeHash = 0;
+	memset(&layout->names, 0, sizeof(layout->names));
+	layout->members = (TTypeMember*)calloc(count ? count : 1, sizeof(TTypeMember));
+
+	if (!layout->members)
+	{
+		free(layout);
+		return NULL;
+	}
+
+	/* register the layout before compiling the members so self referencing types can find it */
+	if (!DArray_Add(&cache->layouts, &layout))
+	{
+		free(layout->members);
+		free(layout);
+		return NULL;
+	}
+
+	if (!HashTable_Add(&cache->table, HashTable_HashPtr(type), layout))
+		return NULL;
+
+	offset = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		TTypeMember* member = &layout->members[i];
+
+		cache->parseType(type, &member->info, &offset);
+
+		member->name = member->info.nameOffset ? decode_ptr(vptr, member->info.nameOffset) : NULL;
+		member->childType = member->info.childrenOffset ? decode_ptr(vptr, member->info.childrenOffset) : NULL;
+		member->count = member->info.arraySize > 0 ? member->info.arraySize : 1;
+		member->offset = ofs;
+		member->recurse = Layout_NeedsRecurse(member->info.type, member->childType);
+		member->parse = cache->parsers[member->info.type];
+
+		if (member->info.type == TYPEID_INLINE)
+		{
+			if (member->childType)
+			{
+				member->inlineLayout = LayoutCache_Get(cache, vptr, member->childType);
+
+				if (!member->inlineLayout)
+				{
+					dbg_printf("invalid inline type %p in %p", member->childType, type);
+					return NULL;
+				}
+
+				member->size = member->inlineLayout->stride * member->count;
+			}
+		}
+		else if (cache->is64)
+			member->size = ELEMENT_TYPE_INFO[member->info.type].size64 * member->count;
+		else
+			member->size = ELEMENT_TYPE_INFO[member->info.type].size32 * member->count;
+
+		ofs += member->size;
+	}
+
+	layout->stride = ofs;
+	layout->compiling = false;
+	return layout;
+}
+
+OG_DLLAPI TTypeLayout* LayoutCache_Get(TLayoutCache* cache, TVirtualPtrTable* vptr, const uint8_t* type)
+{
+	TTypeLayout* layout;
+
+	if (!type)
+		return NULL;
+
+	layout = (TTypeLayout*)HashTable_Get(&cache->table, HashTable_HashPtr(type));
+
+	if (layout) /* a layout that is still compiling is an inline type that contains itself */
+		return layout->compiling ? NULL : layout;
+
+	return Layout_Compile(cache, vptr, type);
+}
+
+OG_DLLAPI int32_t Layout_FindMember(TTypeLayout* layout, const char* name, size_t len)
+{
+	const TTypeMember* member;
+	size_t cursor = 0;
+	uint64_t key = HashTable_HashBytes(name, len, HASHTABLE_SEED);
+
+	if (!layout->names.capacity)
+	{
+		/* first lookup, build the name table */
+		if (!HashTable_Init(&layout->names, layout->count))
+			return -1;
+
+		for (uint32_t i = 0; i < layout->count; i++)
+		{
+			if (!layout->members[i].name)
+				continue;
+
+			if (!HashTable_Add(&layout->names, HashTable_HashBytes(layout->members[i].name, strlen(layout->members[i].name), HASHTABLE_SEED), &layout->members[i]))
+				return -1;
+		}
+	}
+
+	while ((member = (const TTypeMember*)HashTable_Find(&layout->names, key, &cursor)))
+	{
+		if (strncmp(member->name, name, len) == 0 && member->name[len] == 0)
+			return (int32_t)(member - layout->members);
+	}
+
+	return -1;
+}
+
+/*!
+	Gets the layout of the structures referenced by a member, when the type is not stored in the data
+	@param cache The cache
+	@param vptr Virtual pointer table
+	@param member The member
+	@return the layout or NULL if the member has no static children
+*/
+static TTypeLayout* Layout_GetStaticChild(TLayoutCache* cache, TVirtualPtrTable* vptr, const TTypeMember* member)
+{
+	if (!member->recurse || member->info.type == TYPEID_VARIANTREFERENCE || member->info.type == TYPEID_REFERENCETOVARIANTARRAY)
+		return NULL;
+
+	if (member->info.type == TYPEID_INLINE)
+		return member->inlineLayout;
+
+	return LayoutCache_Get(cache, vptr, member->childType);
+}
+
+OG_DLLAPI uint64_t LayoutCache_GetTreeHash(TLayoutCache* cache, TVirtualPtrTable* vptr, TTypeLayout* layout)
+{
+	TDArray queue;
+	THashTable visited;
+	uint64_t hash = HASHTABLE_SEED;
+	uint8_t is64 = cache->is64;
+	bool success = false;
+
+	if (layout->treeHash)
+		return layout->treeHash;
+
+	if (!DArray_Init(&queue, sizeof(TTypeLayout*), 16))
+		return 0;
+
+	if (!HashTable_Init(&visited, 16))
+	{
+		DArray_Free(&queue);
+		return 0;
+	}
+
+	if (!DArray_Add(&queue, &layout) || !HashTable_Add(&visited, HashTable_HashPtr(layout), (void*)(uintptr_t)1))
+		goto end;
+
+	hash = HashTable_HashBytes(&is64, sizeof(is64), hash);
+
+	/* the layouts are numbered in the order they are reached, so the hash does not depend on where the type nodes are */
+	for (size_t i = 0; i < queue.count; i++)
+	{
+		const TTypeLayout* current = *(TTypeLayout**)DArray_Get(&queue, i);
+
+		hash = HashTable_HashBytes(&current->count, sizeof(current->count), hash);
+		hash = HashTable_HashBytes(&current->stride, sizeof(current->stride), hash);
+
+		for (uint32_t j = 0; j < current->count; j++)
+		{
+			const TTypeMember* member = &current->members[j];
+			TTypeLayout* child = Layout_GetStaticChild(cache, vptr, member);
+			uint32_t ordinal = UINT32_MAX;
+
+			hash = HashTable_HashBytes(&member->info.type, sizeof(member->info.type), hash);
+			hash = HashTable_HashBytes(&member->count, sizeof(member->count), hash);
+			hash = HashTable_HashBytes(&member->offset, sizeof(member->offset), hash);
+
+			if (member->name)
+				hash = HashTable_HashBytes(member->name, strlen(member->name) + 1, hash);
+
+			if (child)
+			{
+				void* value;
+				size_t cursor = 0;
+
+				while ((value = HashTable_Find(&visited, HashTable_HashPtr(child), &cursor)))
+				{
+					if (*(TTypeLayout**)DArray_Get(&queue, (uintptr_t)value - 1) == child)
+					{
+						ordinal = (uint32_t)((uintptr_t)value - 1);
+						break;
+					}
+				}
+
+				if (ordinal == UINT32_MAX)
+				{
+					ordinal = (uint32_t)queue.count;
+
+					if (!DArray_Add(&queue, &child) || !HashTable_Add(&visited, HashTable_HashPtr(child), (void*)(uintptr_t)(queue.count)))
+						goto end;
+				}
+			}
+			else if (member->recurse && member->info.type != TYPEID_VARIANTREFERENCE && member->info.type != TYPEID_REFERENCETOVARIANTARRAY && member->info.type != TYPEID_INLINE)
+				goto end; /* the child type cannot be compiled */
+
+			hash = HashTable_HashBytes(&ordinal, sizeof(ordinal), hash);
+		}
+	}
+
+	success = true;
+
+end:
+	DArray_Free(&queue);
+	HashTable_Free(&visited);
+
+	if (!success)
+	{
+		dbg_printf("cannot hash the type tree of %p", layout->type);
+		return 0;
+	}
+
+	/* 0 is reserved for layouts that are not hashed yet */
+	layout->treeHash = hash ? hash : 1;
+	return layout->treeHash;
+}
+
+OG_DLLAPI const uint8_t* LayoutCache_ReadPtr(TLayoutCache* cache, TVirtualPtrTable* vptr, const uint8_t* data)
+{
+	if (cache->is64)
+		return (const uint8_t*)decode_ptr(vptr, *(const uint64_t*)data);
+
+	return (const uint8_t*)decode_ptr(vptr, *(const uint32_t*)data);
+}
+
+OG_DLLAPI bool LayoutCache_GetChildren(TLayoutCache* cache, TVirtualPtrTable* vptr, const TTypeMember* member, const uint8_t* data, TLayoutChildren* children)
+{
+	const uint8_t* type = member->childType;
+	size_t ptrSize = cache->is64 ? 8 : 4;
+
+	children->layout = NULL;
+	children->base = NULL;
+	children->count = 0;
+	children->references = false;
+
+	if (!member->recurse)
+		return true;
+
+	switch (member->info.type)
+	{
+	case TYPEID_INLINE: // 1
+		children->layout = member->inlineLayout;
+		children->base = data;
+		children->count = member->count;
+		return true;
+
+	case TYPEID_REFERENCE: // 2
+		children->base = LayoutCache_ReadPtr(cache, vptr, data);
+		children->count = 1;
+		break;
+
+	case TYPEID_REFERENCETOARRAY: // 3
+		children->count = *(const uint32_t*)data;
+		children->base = LayoutCache_ReadPtr(cache, vptr, data + 4);
+		break;
+
+	case TYPEID_ARRAYOFREFERENCES: // 4
+		children->count = *(const uint32_t*)data;
+		children->base = LayoutCache_ReadPtr(cache, vptr, data + 4);
+		children->references = true;
+		break;
+
+	case TYPEID_VARIANTREFERENCE: // 5
+		/* the type of a variant is stored inside the data */
+		type = LayoutCache_ReadPtr(cache, vptr, data);
+		children->base = LayoutCache_ReadPtr(cache, vptr, data + ptrSize);
+		children->count = 1;
+		break;
+
+	case TYPEID_REFERENCETOVARIANTARRAY: // 7
+		type = LayoutCache_ReadPtr(cache, vptr, data);
+		children->count = *(const uint32_t*)(data + ptrSize);
+		children->base = LayoutCache_ReadPtr(cache, vptr, data + ptrSize + 4);
+		break;
+
+	default:
+		return true;
+	}
+
+	if (!children->base || !type || !children->count)
+	{
+		children->count = 0;
+		return true;
+	}
+
+	children->layout = LayoutCache_Get(cache, vptr, type);
+	return children->layout != NULL;
+}
+
+OG_DLLAPI const uint8_t* LayoutCache_GetStructure(TLayoutCache* cache, TVirtualPtrTable* vptr, const TLayoutChildren* children, uint32_t index)
+{
+	if (index >= children->count)
+		return NULL;
+
+	if (children->references)
+		return LayoutCache_ReadPtr(cache, vptr, children->base + (index * (cache->is64 ? 8 : 4)));
+
+	return children->base + (index * children->layout->stride);
+}
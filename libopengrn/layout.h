@@ -0,0 +1,170 @@
+/*!
+	Project: libopengrn
+	File: layout.h
+	Compiled type layouts
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include "structures.h"
+#include "darray.h"
+#include "hashtable.h"
+#include "typeinfo.h"
+#include "virtual_ptr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct STypeLayout;
+struct SElementGeneric;
+
+/*!
+	Parses the value of an element from the data of it's member
+	@param vptr Virtual pointer table
+	@param elem The element to fill
+	@param data Pointer to the member data
+	@return true if the parsing succeeded, otherwise false
+*/
+typedef bool (*TElementParseFunc)(TVirtualPtrTable* vptr, struct SElementGeneric* elem, const uint8_t* data);
+
+/*!
+	Member of a compiled type
+*/
+typedef struct STypeMember
+{
+	TNodeTypeInfo info; /* raw node info */
+	const char* name; /* decoded name of the member */
+	const uint8_t* childType; /* decoded type of the children, NULL if the type is not static */
+	struct STypeLayout* inlineLayout; /* layout of the children (TYPEID_INLINE only) */
+	uint32_t offset; /* offset of the member inside the structure */
+	uint32_t size; /* full size of the member (array included) */
+	uint32_t count; /* number of array elements (at least 1) */
+	bool recurse; /* true if the children of the member must be parsed */
+	TElementParseFunc parse; /* parser of the member value */
+} TTypeMember;
+
+/*!
+	A type node list compiled into member offsets and sizes, so the
+	type tree is walked once per type instead of once per structure
+*/
+typedef struct STypeLayout
+{
+	const uint8_t* type; /* type nodes this layout was compiled from */
+	TTypeMember* members; /* compiled members */
+	uint32_t count; /* number of members */
+	uint32_t stride; /* size of one structure of this type */
+	bool compiling; /* true while the members are being compiled */
+	uint64_t treeHash; /* hash of the layout and all the static types it reaches, 0 until LayoutCache_GetTreeHash is called */
+	THashTable names; /* member name hash -> member, built by Layout_FindMember */
+} TTypeLayout;
+
+/*!
+	Structures referenced by the data of a member
+*/
+typedef struct SLayoutChildren
+{
+	const TTypeLayout* layout; /* layout of the structures */
+	const uint8_t* base; /* first structure, or array of encoded pointers when references is true */
+	uint32_t count; /* number of structures */
+	bool references; /* base is an array of encoded pointers to the structures (TYPEID_ARRAYOFREFERENCES) */
+} TLayoutChildren;
+
+/*!
+	Cache of the compiled layouts of a file
+*/
+typedef struct SLayoutCache
+{
+	THashTable table; /* type pointer -> TTypeLayout* */
+	TDArray layouts; /* all the compiled layouts (sizeof(TTypeLayout*)) */
+	bool is64; /* true if the type nodes are from a 64-bit file */
+	TTypeInfoParseFunc parseType; /* type node parser for the pointer size */
+	const TElementParseFunc* parsers; /* element parsers for the pointer size */
+} TLayoutCache;
+
+/*!
+	Initializes a new layout cache
+	@param cache The cache to initialize
+	@return true if the initialization succeeded, otherwise false
+*/
+extern bool LayoutCache_Init(TLayoutCache* cache);
+
+/*!
+	Selects the parsers of the cache for the pointer size of a file
+	@param cache The cache
+	@param is64 true if the file uses 64-bit pointers
+*/
+extern void LayoutCache_SetBits(TLayoutCache* cache, bool is64);
+
+/*!
+	Frees all the compiled layouts of a cache
+	@param cache The cache to free
+*/
+extern void LayoutCache_Free(TLayoutCache* cache);
+
+/*!
+	Gets the compiled layout of a type, compiling it if it's the first time the type is requested
+	@param cache The cache
+	@param vptr Virtual pointer table used to decode the type pointers
+	@param type Pointer to the first type node
+	@return the compiled layout or NULL in case of an error
+*/
+extern OG_DLLAPI TTypeLayout* LayoutCache_Get(TLayoutCache* cache, TVirtualPtrTable* vptr, const uint8_t* type);
+
+/*!
+	Finds a member of a layout by name
+	@param layout The layout
+	@param name Name of the member
+	@param len Length of the name
+	@return the index of the member or -1 if the member does not exist
+*/
+extern OG_DLLAPI int32_t Layout_FindMember(TTypeLayout* layout, const char* name, size_t len);
+
+/*!
+	Hashes a layout with all the layouts it reaches through static child types, two files
+	produced with the same type tree (and pointer size) give the same hash
+	@param cache The cache
+	@param vptr Virtual pointer table
+	@param layout The layout to hash
+	@return the hash or 0 in case of an error
+	@note The result is cached inside the layout, the children with variant types are not followed
+*/
+extern OG_DLLAPI uint64_t LayoutCache_GetTreeHash(TLayoutCache* cache, TVirtualPtrTable* vptr, TTypeLayout* layout);
+
+/*!
+	Reads an encoded pointer from the data
+	@param cache The cache
+	@param vptr Virtual pointer table
+	@param data Pointer to the encoded pointer
+	@return the decoded pointer
+*/
+extern OG_DLLAPI const uint8_t* LayoutCache_ReadPtr(TLayoutCache* cache, TVirtualPtrTable* vptr, const uint8_t* data);
+
+/*!
+	Resolves the structures referenced by the raw data of a member
+	@param cache The cache
+	@param vptr Virtual pointer table
+	@param member The member to resolve
+	@param data Pointer to the data of the member
+	@param children Output structures, count is 0 if the member has no children
+	@return true if the children were resolved, otherwise false
+*/
+extern OG_DLLAPI bool LayoutCache_GetChildren(TLayoutCache* cache, TVirtualPtrTable* vptr, const TTypeMember* member, const uint8_t* data, TLayoutChildren* children);
+
+/*!
+	Gets the data of a structure resolved by LayoutCache_GetChildren
+	@param cache The cache
+	@param vptr Virtual pointer table
+	@param children The resolved structures
+	@param index Index of the structure
+	@return pointer to the structure data, or NULL if the reference is empty
+*/
+extern OG_DLLAPI const uint8_t* LayoutCache_GetStructure(TLayoutCache* cache, TVirtualPtrTable* vptr, const TLayoutChildren* children, uint32_t index);
+
+#ifdef __cplusplus
+}
+#endif
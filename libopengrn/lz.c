@@ -0,0 +1,319 @@
+/*!
+	Project: libopengrn
+	File: lz.c
+	Byte aligned LZ compression/decompression functions (COMPRESSION_TYPE_LZ)
+
+	The stream is the LZ4 block format: every sequence is a token with the literal and match lengths
+	(4 bits each, 15 continues with bytes up to 255), the literals, a 16 bit little endian offset and
+	the extra match length. The last sequence has only literals, the last 5 bytes are always literals
+	and a match doesn't start in the last 12 bytes
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "compression.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+	Bits of the hash table of the encoder (entries of 4 bytes)
+*/
+#define LZ_HASH_BITS 14
+
+/*!
+	Shortest match
+*/
+#define LZ_MIN_MATCH 4
+
+/*!
+	Bytes at the end of the data that are always literals
+*/
+#define LZ_LAST_LITERALS 5
+
+/*!
+	No match starts in the last LZ_MF_LIMIT bytes
+*/
+#define LZ_MF_LIMIT 12
+
+/*!
+	Farthest match
+*/
+#define LZ_MAX_OFFSET 0xFFFF
+
+/*!
+	Reads 4 bytes at any alignment
+*/
+static uint32_t Lz_Read32(const uint8_t* p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*!
+	Hashes the 4 bytes at a position
+*/
+static uint32_t Lz_Hash(const uint8_t* p)
+{
+	return (Lz_Read32(p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/*!
+	Writes the continuation bytes of a length
+	@param op The output
+	@param len The length minus 15
+	@return the output after the bytes
+*/
+static uint8_t* Lz_WriteLength(uint8_t* op, size_t len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/*!
+	Writes a sequence
+	@param op The output
+	@param literals The literals
+	@param literalLen Number of literals
+	@param offset Distance of the match, 0 for the last sequence
+	@param matchLen Length of the match
+	@return the output after the sequence
+*/
+static uint8_t* Lz_WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalLen, uint32_t offset, size_t matchLen)
+{
+	uint8_t* token = op++;
+
+	*token = (uint8_t)((literalLen >= 15 ? 15 : literalLen) << 4);
+
+	if (literalLen >= 15)
+		op = Lz_WriteLength(op, literalLen - 15);
+
+	memcpy(op, literals, literalLen);
+	op += literalLen;
+
+	if (!offset)
+		return op;
+
+	*op++ = (uint8_t)offset;
+	*op++ = (uint8_t)(offset >> 8);
+
+	matchLen -= LZ_MIN_MATCH;
+	*token |= (uint8_t)(matchLen >= 15 ? 15 : matchLen);
+
+	if (matchLen >= 15)
+		op = Lz_WriteLength(op, matchLen - 15);
+
+	return op;
+}
+
+bool Compression_Lz(const uint8_t* data, uint32_t length, uint8_t** compressedData, uint32_t* compressedLength)
+{
+	uint32_t* table;
+	uint8_t* out, * op;
+	uint32_t ip = 0, anchor = 0;
+
+	*compressedData = NULL;
+	*compressedLength = 0;
+
+	/* incompressible data grows by a byte every 255 literals */
+	out = (uint8_t*)malloc((size_t)length + length / 255 + 16);
+	table = (uint32_t*)calloc((size_t)1 << LZ_HASH_BITS, sizeof(uint32_t));
+
+	if (!out || !table)
+	{
+		dbg_printf("memory allocation fail!!!");
+		free(out);
+		free(table);
+		return false;
+	}
+
+	op = out;
+
+	while (length > LZ_MF_LIMIT && ip < length - LZ_MF_LIMIT)
+	{
+		uint32_t h = Lz_Hash(data + ip), candidate = table[h];
+		uint32_t matchLen = LZ_MIN_MATCH;
+
+		table[h] = ip;
+
+		if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET || Lz_Read32(data + candidate) != Lz_Read32(data + ip))
+		{
+			/* skip faster through data that doesn't match */
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		while (ip > anchor && candidate > 0 && data[ip - 1] == data[candidate - 1])
+		{
+			ip--;
+			candidate--;
+			matchLen++;
+		}
+
+		while (ip + matchLen + 8 <= length - LZ_LAST_LITERALS && !memcmp(data + ip + matchLen, data + candidate + matchLen, 8))
+			matchLen += 8;
+
+		while (ip + matchLen < length - LZ_LAST_LITERALS && data[ip + matchLen] == data[candidate + matchLen])
+			matchLen++;
+
+		op = Lz_WriteSequence(op, data + anchor, ip - anchor, ip - candidate, matchLen);
+		ip += matchLen;
+		anchor = ip;
+
+		if (ip < length - LZ_MF_LIMIT)
+			table[Lz_Hash(data + ip - 2)] = ip - 2;
+	}
+
+	op = Lz_WriteSequence(op, data + anchor, length - anchor, 0, 0);
+	free(table);
+
+	*compressedData = out;
+	*compressedLength = (uint32_t)(op - out);
+	return true;
+}
+
+/*!
+	Copies 16 bytes at a time, writes up to 15 bytes after the end
+	@param dst Destination, at least 16 bytes before it's end and len bytes after the source
+	@param src Source
+	@param len Number of bytes to copy
+*/
+static void Lz_WildCopy16(uint8_t* dst, const uint8_t* src, size_t len)
+{
+	uint8_t* end = dst + len;
+
+	do
+	{
+		memcpy(dst, src, 16);
+		dst += 16;
+		src += 16;
+	} while (dst < end);
+}
+
+/*!
+	Copies 8 bytes at a time, writes up to 7 bytes after the end
+	@param dst Destination, at least 8 bytes after the source
+	@param src Source
+	@param len Number of bytes to copy
+*/
+static void Lz_WildCopy8(uint8_t* dst, const uint8_t* src, size_t len)
+{
+	uint8_t* end = dst + len;
+
+	do
+	{
+		memcpy(dst, src, 8);
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+/*!
+	Reads the continuation bytes of a length
+	@param ip The input, moved after the bytes
+	@param iend End of the input
+	@param len The length, incremented by the bytes
+	@return true if the length was read, false if the input ends
+*/
+static bool Lz_ReadLength(const uint8_t** ip, const uint8_t* iend, size_t* len)
+{
+	uint8_t b;
+
+	do
+	{
+		if (*ip >= iend)
+			return false;
+
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return true;
+}
+
+bool Compression_UnLz(const uint8_t* compressedData, uint32_t compressedLength, uint8_t* decompressedData, uint32_t decompressedLength)
+{
+	const uint8_t* ip = compressedData, * iend = compressedData + compressedLength;
+	uint8_t* op = decompressedData, * oend = decompressedData + decompressedLength;
+
+	while (ip < iend)
+	{
+		uint8_t token = *ip++;
+		size_t len = token >> 4, offset;
+
+		if (len == 15 && !Lz_ReadLength(&ip, iend, &len))
+			return false;
+
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+			return false;
+
+		/* the wide copies stay inside both buffers when there is space after the literals */
+		if (len + 16 <= (size_t)(iend - ip) && len + 16 <= (size_t)(oend - op))
+			Lz_WildCopy16(op, ip, len);
+		else
+			memcpy(op, ip, len);
+
+		ip += len;
+		op += len;
+
+		/* the last sequence has only literals */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+
+		offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+
+		if (!offset || offset > (size_t)(op - decompressedData))
+			return false;
+
+		len = (token & 15) + LZ_MIN_MATCH;
+
+		if ((token & 15) == 15 && !Lz_ReadLength(&ip, iend, &len))
+			return false;
+
+		if (len > (size_t)(oend - op))
+			return false;
+
+		if (len + 16 > (size_t)(oend - op))
+		{
+			/* near the end of the output */
+			for (size_t i = 0; i < len; i++)
+				op[i] = op[i - offset];
+		}
+		else if (offset >= 16)
+			Lz_WildCopy16(op, op - offset, len);
+		else
+		{
+			/* a short offset repeats a pattern, after a multiple of it that is at least 8 bytes the copy goes on by words */
+			size_t step = offset, head;
+
+			while (step < 8)
+				step += offset;
+
+			head = len < step ? len : step;
+
+			for (size_t i = 0; i < head; i++)
+				op[i] = op[i - offset];
+
+			if (len > step)
+				Lz_WildCopy8(op + step, op, len - step);
+		}
+
+		op += len;
+	}
+
+	return op == oend;
+}
@@ -44,13 +44,16 @@ bool OG_DLLAPI Magic_GetFlags(const uint32_t* magic, uint8_t* flags)
 	return false;
 }
 
-void OG_DLLAPI Magic_Set(uint32_t* magic, uint8_t flags)
+bool OG_DLLAPI Magic_Set(uint32_t* magic, uint8_t flags)
 {
 	for (int i = 0; i < (sizeof(MAGIC_DATA) / sizeof(TMagicInfo)); i++)
 	{
 		if (flags == MAGIC_DATA[i].flags)
 		{
 			memcpy(magic, MAGIC_DATA[i].magic, 16);
+			return true;
 		}
 	}
+
+	return false;
 }
@@ -47,4 +47,10 @@ extern OG_DLLAPI const TMagicInfo MAGIC_DATA[];
 */
 extern OG_DLLAPI bool Magic_GetFlags(const uint32_t* magic, uint8_t* flags);
 
-extern OG_DLLAPI void Magic_Set(uint32_t* magic, uint8_t flags);
+/*!
+	Sets the magic of the specified flags
+	@param magic Output magic (4 values)
+	@param flags Flags of the magic
+	@return true if the magic was set, false if no known magic has the flags
+*/
+extern OG_DLLAPI bool Magic_Set(uint32_t* magic, uint8_t flags);
@@ -0,0 +1,607 @@
+/*!
+	Project: libopengrn
+	File: mesh.c
+	Extraction of the mesh data into typed buffers
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "mesh.h"
+#include "convert.h"
+#include "pathindex.h"
+#include "platform.h"
+#include "debug.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OG_SSE2
+#include <emmintrin.h>
+#endif
+
+/*!
+	Number of vertices converted by each stream before moving to the next stream,
+	a block of vertices stays in the cache while all the streams read it
+*/
+#define MESH_VERTEX_BLOCK 256
+
+/*!
+	A vertex stream resolved against the layout of the vertices
+*/
+typedef struct SVertexPlan
+{
+	TConvertToFloatFunc convert; /* conversion of the member, NULL if the member does not exist */
+	uint32_t offset; /* offset of the member inside the vertex */
+	uint32_t converted; /* number of components read from the member */
+	size_t stride; /* distance in floats between two vertices of the output */
+} TVertexPlan;
+
+/*!
+	Resolves the structures of an array (vertices, indices or tri groups)
+	@param gr2 The Gr2 structure that contains the array
+	@param vertices The array
+	@param children Output structures
+	@return true if the structures were resolved, otherwise false
+*/
+static bool Mesh_GetArray(TGr2* gr2, const TElementGeneric* vertices, TLayoutChildren* children)
+{
+	if (!vertices->member || !gr2->data)
+	{
+		dbg_printf("array %s was not loaded from a file", vertices->name ? vertices->name : "(null)");
+		return false;
+	}
+
+	if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, vertices->member, vertices->data, children))
+		return false;
+
+	if (children->references)
+	{
+		dbg_printf("array %s is an array of references", vertices->name ? vertices->name : "(null)");
+		return false;
+	}
+
+	return true;
+}
+
+OG_DLLAPI uint32_t Gr2_GetVertexCount(TGr2* gr2, const TElementGeneric* vertices)
+{
+	TLayoutChildren children;
+
+	if (!Mesh_GetArray(gr2, vertices, &children) || !children.layout)
+		return 0;
+
+	return children.count;
+}
+
+OG_DLLAPI bool Gr2_ExtractVertices(TGr2* gr2, const TElementGeneric* vertices, const TGr2VertexStream* streams, uint32_t count)
+{
+	TLayoutChildren children;
+	TVertexPlan* plans;
+
+	if (!Mesh_GetArray(gr2, vertices, &children))
+		return false;
+
+	if (!children.layout || !children.count || !count)
+		return true;
+
+	plans = (TVertexPlan*)calloc(count, sizeof(TVertexPlan));
+
+	if (!plans)
+		return false;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t index = Layout_FindMember((TTypeLayout*)children.layout, streams[i].name, strlen(streams[i].name));
+
+		plans[i].stride = streams[i].stride ? streams[i].stride : streams[i].components;
+
+		/* a shorter stride makes the rows of the stream overlap */
+		if (plans[i].stride < streams[i].components)
+		{
+			dbg_printf("stream %s has a stride of %u floats for %u components", streams[i].name, streams[i].stride, streams[i].components);
+			free(plans);
+			return false;
+		}
+
+		if (index < 0)
+			continue;
+
+		plans[i].convert = Convert_GetToFloat(children.layout->members[index].info.type);
+
+		if (!plans[i].convert)
+		{
+			dbg_printf("vertex member %s has the non numeric type %u", streams[i].name, children.layout->members[index].info.type);
+			free(plans);
+			return false;
+		}
+
+		plans[i].offset = children.layout->members[index].offset;
+		plans[i].converted = children.layout->members[index].count;
+
+		if (plans[i].converted > streams[i].components)
+			plans[i].converted = streams[i].components;
+	}
+
+	for (uint32_t first = 0; first < children.count; first += MESH_VERTEX_BLOCK)
+	{
+		uint32_t rows = children.count - first < MESH_VERTEX_BLOCK ? children.count - first : MESH_VERTEX_BLOCK;
+		const uint8_t* block = children.base + (size_t)first * children.layout->stride;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float* out = streams[i].out + (size_t)first * plans[i].stride;
+
+			if (plans[i].convert)
+				plans[i].convert(block + plans[i].offset, children.layout->stride, out, plans[i].stride, plans[i].converted, rows);
+
+			if (plans[i].converted < streams[i].components)
+			{
+				for (uint32_t v = 0; v < rows; v++)
+					memset(out + v * plans[i].stride + plans[i].converted, 0, (streams[i].components - plans[i].converted) * sizeof(float));
+			}
+		}
+	}
+
+	free(plans);
+	return true;
+}
+
+/*!
+	Maximum number of bone influences of a vertex read by Gr2_ComputeBounds
+*/
+#define MESH_MAX_INFLUENCES 8
+
+/*!
+	Converts a member of a block of vertices to float
+	@param layout Layout of the vertices
+	@param block First vertex of the block
+	@param name Name of the member
+	@param out Output floats
+	@param components Number of floats of each vertex
+	@param rows Number of vertices
+	@return the number of components read from the member, 0 if the member does not exist or is not numeric
+*/
+static uint32_t Mesh_ConvertMember(const TTypeLayout* layout, const uint8_t* block, const char* name, float* out, uint32_t components, uint32_t rows)
+{
+	int32_t index = Layout_FindMember((TTypeLayout*)layout, name, strlen(name));
+	TConvertToFloatFunc convert;
+	uint32_t converted;
+
+	if (index < 0 || !(convert = Convert_GetToFloat(layout->members[index].info.type)))
+		return 0;
+
+	converted = layout->members[index].count < components ? layout->members[index].count : components;
+	convert(block + layout->members[index].offset, layout->stride, out, components, converted, rows);
+	return converted;
+}
+
+/*!
+	Grows the sphere of a bounds to contain a point, the box is not updated
+	@param bounds The bounds
+	@param p The point
+*/
+static void Mesh_GrowSphere(TGr2Bounds* bounds, const float* p)
+{
+	float d[3], distance;
+
+	if (!bounds->count++)
+	{
+		memcpy(bounds->center, p, sizeof(float) * 3);
+		bounds->radius = 0.0f;
+		return;
+	}
+
+	for (uint32_t c = 0; c < 3; c++)
+		d[c] = p[c] - bounds->center[c];
+
+	distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+	if (distance <= bounds->radius * bounds->radius)
+		return;
+
+	/* move the center toward the point so the new sphere touches the point and the old sphere */
+	distance = sqrtf(distance);
+
+	for (uint32_t c = 0; c < 3; c++)
+		bounds->center[c] += d[c] * (distance - bounds->radius) * 0.5f / distance;
+
+	bounds->radius = (bounds->radius + distance) * 0.5f;
+}
+
+/*!
+	Adds a point to a bounds
+	@param bounds The bounds
+	@param p The point
+*/
+static void Mesh_AddPoint(TGr2Bounds* bounds, const float* p)
+{
+	if (!bounds->count)
+	{
+		memcpy(bounds->min, p, sizeof(float) * 3);
+		memcpy(bounds->max, p, sizeof(float) * 3);
+	}
+
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		bounds->min[c] = p[c] < bounds->min[c] ? p[c] : bounds->min[c];
+		bounds->max[c] = p[c] > bounds->max[c] ? p[c] : bounds->max[c];
+	}
+
+	Mesh_GrowSphere(bounds, p);
+}
+
+/*!
+	Keeps the smaller of the grown sphere and the sphere around the box
+	@param bounds The bounds
+*/
+static void Mesh_FinishBounds(TGr2Bounds* bounds)
+{
+	float half[3], radius;
+
+	if (!bounds->count)
+	{
+		memset(bounds, 0, sizeof(TGr2Bounds));
+		return;
+	}
+
+	for (uint32_t c = 0; c < 3; c++)
+		half[c] = (bounds->max[c] - bounds->min[c]) * 0.5f;
+
+	radius = sqrtf(half[0] * half[0] + half[1] * half[1] + half[2] * half[2]);
+
+	if (radius < bounds->radius)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+			bounds->center[c] = bounds->min[c] + half[c];
+
+		bounds->radius = radius;
+	}
+}
+
+OG_DLLAPI bool Gr2_ComputeBounds(TGr2* gr2, const TElementGeneric* vertices, TGr2Bounds* bounds, TGr2Bounds* bones, uint32_t boneCount)
+{
+	/* one more float so the last position can be loaded with four floats */
+	float positions[MESH_VERTEX_BLOCK * 3 + 1], weights[MESH_VERTEX_BLOCK * MESH_MAX_INFLUENCES], indices[MESH_VERTEX_BLOCK * MESH_MAX_INFLUENCES];
+	TLayoutChildren children;
+	uint32_t influences = 0;
+	int32_t position;
+
+	memset(bounds, 0, sizeof(TGr2Bounds));
+
+	if (bones)
+		memset(bones, 0, sizeof(TGr2Bounds) * boneCount);
+
+	if (!Mesh_GetArray(gr2, vertices, &children))
+		return false;
+
+	if (!children.layout || !children.count)
+		return true;
+
+	position = Layout_FindMember((TTypeLayout*)children.layout, "Position", 8);
+
+	if (position < 0 || children.layout->members[position].count < 3)
+	{
+		dbg_printf("vertices without Position");
+		return false;
+	}
+
+	if (bones && boneCount)
+	{
+		int32_t weightMember = Layout_FindMember((TTypeLayout*)children.layout, "BoneWeights", 11);
+		int32_t indexMember = Layout_FindMember((TTypeLayout*)children.layout, "BoneIndices", 11);
+
+		if (weightMember >= 0 && indexMember >= 0)
+		{
+			influences = children.layout->members[weightMember].count < children.layout->members[indexMember].count
+				? children.layout->members[weightMember].count : children.layout->members[indexMember].count;
+
+			if (influences > MESH_MAX_INFLUENCES)
+				influences = MESH_MAX_INFLUENCES;
+		}
+	}
+
+	positions[MESH_VERTEX_BLOCK * 3] = 0.0f;
+
+	for (uint32_t first = 0; first < children.count; first += MESH_VERTEX_BLOCK)
+	{
+		uint32_t rows = children.count - first < MESH_VERTEX_BLOCK ? children.count - first : MESH_VERTEX_BLOCK;
+		const uint8_t* block = children.base + (size_t)first * children.layout->stride;
+
+		if (Mesh_ConvertMember(children.layout, block, "Position", positions, 3, rows) != 3)
+			return false;
+
+#ifdef OG_SSE2
+		{
+			/* box of the block, the fourth lane is ignored */
+			__m128 low = _mm_loadu_ps(positions), high = low;
+			float lowOut[4], highOut[4];
+
+			for (uint32_t v = 1; v < rows; v++)
+			{
+				__m128 p = _mm_loadu_ps(positions + v * 3);
+
+				low = _mm_min_ps(low, p);
+				high = _mm_max_ps(high, p);
+			}
+
+			_mm_storeu_ps(lowOut, low);
+			_mm_storeu_ps(highOut, high);
+
+			/* the box is merged once per block, the sphere still needs every point */
+			if (bounds->count)
+			{
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					lowOut[c] = lowOut[c] < bounds->min[c] ? lowOut[c] : bounds->min[c];
+					highOut[c] = highOut[c] > bounds->max[c] ? highOut[c] : bounds->max[c];
+				}
+			}
+
+			for (uint32_t v = 0; v < rows; v++)
+				Mesh_GrowSphere(bounds, positions + v * 3);
+
+			memcpy(bounds->min, lowOut, sizeof(float) * 3);
+			memcpy(bounds->max, highOut, sizeof(float) * 3);
+		}
+#else
+		for (uint32_t v = 0; v < rows; v++)
+			Mesh_AddPoint(bounds, positions + v * 3);
+#endif
+
+		if (!influences)
+			continue;
+
+		Mesh_ConvertMember(children.layout, block, "BoneWeights", weights, influences, rows);
+		Mesh_ConvertMember(children.layout, block, "BoneIndices", indices, influences, rows);
+
+		for (uint32_t v = 0; v < rows; v++)
+		{
+			for (uint32_t i = 0; i < influences; i++)
+			{
+				float bone = indices[v * influences + i];
+
+				if (weights[v * influences + i] > 0.0f && bone >= 0.0f && bone < (float)boneCount)
+					Mesh_AddPoint(&bones[(uint32_t)bone], positions + v * 3);
+			}
+		}
+	}
+
+	Mesh_FinishBounds(bounds);
+
+	for (uint32_t i = 0; bones && i < boneCount; i++)
+		Mesh_FinishBounds(&bones[i]);
+
+	return true;
+}
+
+/*!
+	Resolves an array member of a topology
+	@param gr2 The Gr2 structure
+	@param elem Element that contains the topology
+	@param index Index of the topology
+	@param name Name of the array member
+	@param children Output structures of the array
+	@return true if the member was resolved (count is 0 when it's missing or empty), false if it's malformed
+*/
+static bool Mesh_GetTopologyArray(TGr2* gr2, TElementGeneric* elem, uint32_t index, const char* name, TLayoutChildren* children)
+{
+	const TElementGeneric* array = Element_FindChild(gr2, elem, name, index);
+
+	children->layout = NULL;
+	children->count = 0;
+
+	if (!array)
+		return true;
+
+	if (!Mesh_GetArray(gr2, array, children))
+		return false;
+
+	if (!children->layout)
+		children->count = 0;
+
+	return true;
+}
+
+/*!
+	Resolves the indices of a topology, the 32-bit indices are preferred
+	@param gr2 The Gr2 structure
+	@param elem Element that contains the topology
+	@param index Index of the topology
+	@param children Output indices
+	@param width Output size of a stored index
+	@return true if the indices were resolved, otherwise false
+*/
+static bool Mesh_GetIndices(TGr2* gr2, TElementGeneric* elem, uint32_t index, TLayoutChildren* children, uint32_t* width)
+{
+	if (!Mesh_GetTopologyArray(gr2, elem, index, "Indices", children))
+		return false;
+
+	*width = 4;
+
+	if (!children->count)
+	{
+		if (!Mesh_GetTopologyArray(gr2, elem, index, "Indices16", children))
+			return false;
+
+		*width = 2;
+	}
+
+	if (children->count && (children->layout->count != 1 || children->layout->stride != *width
+		|| (children->layout->members[0].info.type != (*width == 4 ? TYPEID_INT32 : TYPEID_INT16)
+			&& children->layout->members[0].info.type != (*width == 4 ? TYPEID_UINT32 : TYPEID_UINT16))))
+	{
+		dbg_printf("indices with an unexpected type");
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+	Widens 16-bit indices
+	@param src The indices
+	@param dst Output indices
+	@param count Number of indices
+*/
+static void Mesh_WidenIndices(const uint8_t* src, uint32_t* dst, size_t count)
+{
+	size_t i = 0;
+
+#ifdef OG_SSE2
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(v, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(v, zero));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		uint16_t v;
+
+		memcpy(&v, src + i * 2, sizeof(v));
+		dst[i] = v;
+	}
+}
+
+/*!
+	Narrows 32-bit indices
+	@param src The indices
+	@param dst Output indices
+	@param count Number of indices
+	@return false if an index doesn't fit in 16 bits
+*/
+static bool Mesh_NarrowIndices(const uint8_t* src, uint16_t* dst, size_t count)
+{
+	size_t i = 0;
+
+#ifdef OG_SSE2
+	/* the indices are biased to the signed range so the saturating pack keeps them */
+	const __m128i bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16((short)0x8000), high = _mm_set1_epi32((int)0xffff0000);
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(a, b), high), _mm_setzero_si128())) != 0xffff)
+			return false;
+
+		a = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, bias16));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		uint32_t v;
+
+		memcpy(&v, src + i * 4, sizeof(v));
+
+		if (v > 0xffff)
+			return false;
+
+		dst[i] = (uint16_t)v;
+	}
+
+	return true;
+}
+
+OG_DLLAPI uint32_t Gr2_GetIndexCount(TGr2* gr2, TElementGeneric* elem, uint32_t index)
+{
+	TLayoutChildren children;
+	uint32_t width;
+
+	if (!Mesh_GetIndices(gr2, elem, index, &children, &width))
+		return 0;
+
+	return children.count;
+}
+
+OG_DLLAPI bool Gr2_ExtractIndices(TGr2* gr2, TElementGeneric* elem, uint32_t index, void* out, uint32_t width)
+{
+	TLayoutChildren children;
+	uint32_t stored;
+
+	if (width != 2 && width != 4)
+	{
+		dbg_printf("unsupported index width %u", width);
+		return false;
+	}
+
+	if (!Mesh_GetIndices(gr2, elem, index, &children, &stored))
+		return false;
+
+	if (!children.count)
+		return true;
+
+	if (stored == width)
+	{
+		memcpy(out, children.base, (size_t)children.count * width);
+		return true;
+	}
+
+	if (width == 4)
+	{
+		Mesh_WidenIndices(children.base, (uint32_t*)out, children.count);
+		return true;
+	}
+
+	if (!Mesh_NarrowIndices(children.base, (uint16_t*)out, children.count))
+	{
+		dbg_printf("indices don't fit in 16 bits");
+		return false;
+	}
+
+	return true;
+}
+
+OG_DLLAPI uint32_t Gr2_GetTriGroupCount(TGr2* gr2, TElementGeneric* elem, uint32_t index)
+{
+	TLayoutChildren children;
+
+	if (!Mesh_GetTopologyArray(gr2, elem, index, "Groups", &children))
+		return 0;
+
+	return children.count;
+}
+
+OG_DLLAPI bool Gr2_GetTriGroups(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2TriGroup* groups)
+{
+	TLayoutChildren children;
+	int32_t material, first, count;
+
+	if (!Mesh_GetTopologyArray(gr2, elem, index, "Groups", &children))
+		return false;
+
+	if (!children.count)
+		return true;
+
+	material = Layout_FindMember((TTypeLayout*)children.layout, "MaterialIndex", 13);
+	first = Layout_FindMember((TTypeLayout*)children.layout, "TriFirst", 8);
+	count = Layout_FindMember((TTypeLayout*)children.layout, "TriCount", 8);
+
+	if (material < 0 || first < 0 || count < 0 || children.layout->members[material].info.type != TYPEID_INT32
+		|| children.layout->members[first].info.type != TYPEID_INT32 || children.layout->members[count].info.type != TYPEID_INT32)
+	{
+		dbg_printf("tri groups without MaterialIndex, TriFirst or TriCount");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < children.count; i++)
+	{
+		const uint8_t* group = children.base + (size_t)i * children.layout->stride;
+
+		memcpy(&groups[i].materialIndex, group + children.layout->members[material].offset, sizeof(int32_t));
+		memcpy(&groups[i].triFirst, group + children.layout->members[first].offset, sizeof(uint32_t));
+		memcpy(&groups[i].triCount, group + children.layout->members[count].offset, sizeof(uint32_t));
+	}
+
+	return true;
+}
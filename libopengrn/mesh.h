@@ -0,0 +1,140 @@
+/*!
+	Project: libopengrn
+	File: mesh.h
+	Extraction of the mesh data into typed buffers
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	A float stream filled from a member of the vertex type
+*/
+typedef struct SGr2VertexStream
+{
+	const char* name; /* name of the vertex member (e.g. "Position", "Normal", "TextureCoordinates0", "BoneWeights") */
+	float* out; /* first float of the stream */
+	uint32_t components; /* number of floats written for each vertex */
+	uint32_t stride; /* distance in floats between two vertices, 0 for tightly packed streams */
+} TGr2VertexStream;
+
+/*!
+	Range of triangles of a topology that use the same material
+*/
+typedef struct SGr2TriGroup
+{
+	int32_t materialIndex; /* index of the material inside the material bindings of the mesh */
+	uint32_t triFirst; /* first triangle of the group */
+	uint32_t triCount; /* number of triangles of the group */
+} TGr2TriGroup;
+
+/*!
+	Axis aligned box and sphere that contain a set of vertices
+*/
+typedef struct SGr2Bounds
+{
+	float min[3]; /* minimum corner of the box */
+	float max[3]; /* maximum corner of the box */
+	float center[3]; /* center of the sphere */
+	float radius; /* radius of the sphere */
+	uint32_t count; /* number of vertices inside the bounds, everything is 0 when there are none */
+} TGr2Bounds;
+
+/*!
+	Gets the number of vertices of a vertex array
+	@param gr2 The Gr2 structure that contains the array
+	@param vertices The vertex array (e.g. the "Vertices" member of a vertex data)
+	@return the number of vertices, 0 if the array is empty or is not an array of structures
+*/
+extern OG_DLLAPI uint32_t Gr2_GetVertexCount(TGr2* gr2, const TElementGeneric* vertices);
+
+/*!
+	Converts the vertices of an array into float streams
+
+	The vertices are converted in blocks that fit in the cache, each stream of a block is
+	converted by a loop specialized for the type of it's member. Use a stride of 0 to get
+	separated streams (SoA), or the same buffer with different offsets and the size of the
+	vertex as stride to get interleaved vertices.
+	@param gr2 The Gr2 structure that contains the array
+	@param vertices The vertex array (e.g. the "Vertices" member of a vertex data)
+	@param streams The streams to fill, each stream must have room for Gr2_GetVertexCount vertices
+	@param count Number of streams
+	@return true if the vertices were converted, false if a member is not numeric or the stride of a
+		stream is smaller than it's components
+	@note Streams without a matching member, and the components that the member does
+		not have, are filled with 0
+	@note The array must be loaded from a file, with GR2_LOAD_LAZY it doesn't need to be expanded
+*/
+extern OG_DLLAPI bool Gr2_ExtractVertices(TGr2* gr2, const TElementGeneric* vertices, const TGr2VertexStream* streams, uint32_t count);
+
+/*!
+	Computes the bounds of the vertices of an array, and of the vertices influenced by each bone
+
+	The vertices are read once in blocks, the box is accumulated with SSE2 and the sphere is
+	grown incrementally, at the end the smaller of that sphere and the sphere around the box is kept
+	@param gr2 The Gr2 structure that contains the array
+	@param vertices The vertex array (e.g. the "Vertices" member of a vertex data)
+	@param bounds Output bounds of all the vertices
+	@param bones Output bounds of the vertices with a weight on each bone binding ("BoneWeights" and
+		"BoneIndices" members), or NULL
+	@param boneCount Number of bounds of bones, the bigger bone indices are ignored
+	@return true if the bounds were computed, false if the vertices have no "Position"
+	@note The bounds are in the space of the mesh, the array is read from the file data so with
+		GR2_LOAD_LAZY it doesn't need to be expanded
+*/
+extern OG_DLLAPI bool Gr2_ComputeBounds(TGr2* gr2, const TElementGeneric* vertices, TGr2Bounds* bounds, TGr2Bounds* bones, uint32_t boneCount);
+
+/*!
+	Gets the number of indices of a topology
+	@param gr2 The Gr2 structure that contains the topology
+	@param elem Element that contains the topology (e.g. "Meshes[0].PrimaryTopology")
+	@param index Index of the topology inside the element (0 for references)
+	@return the number of indices (three for each triangle), 0 if the topology has no indices
+*/
+extern OG_DLLAPI uint32_t Gr2_GetIndexCount(TGr2* gr2, TElementGeneric* elem, uint32_t index);
+
+/*!
+	Copies the indices of a topology into an index buffer of the requested width
+
+	The topology stores either 32-bit ("Indices") or 16-bit ("Indices16") indices, they are
+	widened or narrowed with SSE2 while being copied
+	@param gr2 The Gr2 structure that contains the topology
+	@param elem Element that contains the topology (e.g. "Meshes[0].PrimaryTopology")
+	@param index Index of the topology inside the element (0 for references)
+	@param out Output buffer, must have room for Gr2_GetIndexCount indices
+	@param width Size of an output index in bytes, 2 or 4
+	@return true if the indices were copied, false if an index doesn't fit in 16 bits
+		(out is partially written) or the topology is malformed
+*/
+extern OG_DLLAPI bool Gr2_ExtractIndices(TGr2* gr2, TElementGeneric* elem, uint32_t index, void* out, uint32_t width);
+
+/*!
+	Gets the number of triangle groups of a topology
+	@param gr2 The Gr2 structure that contains the topology
+	@param elem Element that contains the topology (e.g. "Meshes[0].PrimaryTopology")
+	@param index Index of the topology inside the element (0 for references)
+	@return the number of groups
+*/
+extern OG_DLLAPI uint32_t Gr2_GetTriGroupCount(TGr2* gr2, TElementGeneric* elem, uint32_t index);
+
+/*!
+	Gets the triangle groups of a topology
+	@param gr2 The Gr2 structure that contains the topology
+	@param elem Element that contains the topology (e.g. "Meshes[0].PrimaryTopology")
+	@param index Index of the topology inside the element (0 for references)
+	@param groups Output groups, must have room for Gr2_GetTriGroupCount groups
+	@return true if the groups were read, otherwise false
+*/
+extern OG_DLLAPI bool Gr2_GetTriGroups(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2TriGroup* groups);
+
+#ifdef __cplusplus
+}
+#endif
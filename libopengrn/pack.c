@@ -0,0 +1,445 @@
+/*!
+	Project: libopengrn
+	File: pack.c
+	Archives of many Granny2 files with a memory mappable index
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "pack.h"
+#include "debug.h"
+#include "platform.h"
+#include "hashtable.h"
+
+#include <stdlib.h>
+
+/*!
+	Magic of the pack files ("OGPK")
+*/
+#define PACK_MAGIC 0x4B50474F
+
+/*!
+	Version of the pack format
+*/
+#define PACK_VERSION 1
+
+/*!
+	Alignment of the data of the files inside the pack, the images need 16
+*/
+#define PACK_ALIGNMENT 16
+
+/*!
+	Header of a pack, followed by the entries, the buckets, the names and the data of the files
+*/
+typedef struct SPackHeader
+{
+	uint32_t magic; /* PACK_MAGIC */
+	uint32_t version; /* PACK_VERSION */
+	uint32_t count; /* number of entries */
+	uint32_t bucketBits; /* the bucket of a hash is it's top bucketBits bits */
+	uint64_t entriesOffset; /* position of the entries, sorted by hash */
+	uint64_t bucketsOffset; /* position of the first entry of every bucket (uint32_t each, (1 << bucketBits) + 1 values) */
+	uint64_t namesOffset; /* position of the name table */
+	uint64_t namesSize; /* length of the name table */
+} TPackHeader;
+
+/*!
+	Hashes the name of a file
+	@param name The name
+	@param len Length of the name
+	@return the hash
+*/
+static uint64_t Pack_Hash(const char* name, size_t len)
+{
+	return HashTable_HashBytes(name, len, HASHTABLE_SEED);
+}
+
+/*!
+	Gets the bucket of a hash
+	@param hash The hash
+	@param bits Number of bits of the bucket index
+	@return the bucket
+*/
+static uint32_t Pack_GetBucket(uint64_t hash, uint32_t bits)
+{
+	return bits ? (uint32_t)(hash >> (64 - bits)) : 0;
+}
+
+OG_DLLAPI bool Gr2Pack_OpenMemory(TGr2Pack* pack, const uint8_t* data, size_t len)
+{
+	TPackHeader header;
+	uint64_t buckets;
+
+	memset(pack, 0, sizeof(TGr2Pack));
+
+	if (len < sizeof(TPackHeader) || (uintptr_t)data % sizeof(uint64_t))
+	{
+		dbg_printf("pack %zu is too small or not aligned", len);
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != PACK_MAGIC || header.version != PACK_VERSION)
+	{
+		dbg_printf("not a pack of version %u", PACK_VERSION);
+		return false;
+	}
+
+	/* only the index is checked, the entries are checked when they are found */
+	buckets = header.bucketBits < 32 ? ((uint64_t)1 << header.bucketBits) + 1 : 0;
+
+	if (!buckets || header.entriesOffset % sizeof(uint64_t) || header.bucketsOffset % sizeof(uint32_t) ||
+		header.entriesOffset > len || header.count > (len - header.entriesOffset) / sizeof(TGr2PackEntry) ||
+		header.bucketsOffset > len || buckets > (len - header.bucketsOffset) / sizeof(uint32_t) ||
+		header.namesOffset > len || header.namesSize > len - header.namesOffset)
+	{
+		dbg_printf("out of bounds");
+		return false;
+	}
+
+	pack->data = data;
+	pack->size = len;
+	pack->entries = (const TGr2PackEntry*)(data + header.entriesOffset);
+	pack->count = header.count;
+	pack->buckets = (const uint32_t*)(data + header.bucketsOffset);
+	pack->bucketBits = header.bucketBits;
+	pack->names = (const char*)(data + header.namesOffset);
+	pack->namesSize = header.namesSize;
+	return true;
+}
+
+OG_DLLAPI bool Gr2Pack_Open(TGr2Pack* pack, const char* path)
+{
+	size_t len;
+	void* data = Platform_MapFile(path, &len);
+
+	memset(pack, 0, sizeof(TGr2Pack));
+
+	if (!data)
+	{
+		dbg_printf("cannot map %s", path);
+		return false;
+	}
+
+	if (!Gr2Pack_OpenMemory(pack, (const uint8_t*)data, len))
+	{
+		Platform_UnmapFile(data, len);
+		return false;
+	}
+
+	pack->mapping = data;
+	return true;
+}
+
+OG_DLLAPI void Gr2Pack_Close(TGr2Pack* pack)
+{
+	if (pack->mapping)
+		Platform_UnmapFile(pack->mapping, pack->size);
+
+	memset(pack, 0, sizeof(TGr2Pack));
+}
+
+OG_DLLAPI const TGr2PackEntry* Gr2Pack_Find(const TGr2Pack* pack, const char* name)
+{
+	size_t len = strlen(name);
+	uint64_t hash = Pack_Hash(name, len);
+	uint32_t bucket = Pack_GetBucket(hash, pack->bucketBits);
+	uint32_t first, last;
+
+	if (!pack->data)
+		return NULL;
+
+	first = pack->buckets[bucket];
+	last = pack->buckets[bucket + 1];
+
+	if (first > last || last > pack->count)
+	{
+		dbg_printf("bucket %u is out of bounds", bucket);
+		return NULL;
+	}
+
+	for (uint32_t i = first; i < last; i++)
+	{
+		const TGr2PackEntry* entry = &pack->entries[i];
+
+		if (entry->hash != hash || entry->nameLength != len || entry->nameOffset > pack->namesSize || len > pack->namesSize - entry->nameOffset ||
+			memcmp(pack->names + entry->nameOffset, name, len))
+			continue;
+
+		if (entry->offset > pack->size || entry->size > pack->size - entry->offset)
+		{
+			dbg_printf("entry %s is out of bounds", name);
+			return NULL;
+		}
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+OG_DLLAPI const uint8_t* Gr2Pack_GetData(const TGr2Pack* pack, const TGr2PackEntry* entry)
+{
+	return pack->data + entry->offset;
+}
+
+OG_DLLAPI bool Gr2Pack_Load(const TGr2Pack* pack, const char* name, TGr2* gr2)
+{
+	const TGr2PackEntry* entry = Gr2Pack_Find(pack, name);
+
+	if (!entry)
+	{
+		dbg_printf("%s is not in the pack", name);
+		return false;
+	}
+
+	switch (entry->kind)
+	{
+	case GR2_PACK_FILE:
+		return Gr2_Load(Gr2Pack_GetData(pack, entry), (size_t)entry->size, gr2);
+
+	case GR2_PACK_IMAGE:
+		return Gr2_LoadImage(Gr2Pack_GetData(pack, entry), (size_t)entry->size, gr2);
+
+	default:
+		dbg_printf("unknown kind %u of %s", entry->kind, name);
+		return false;
+	}
+}
+
+OG_DLLAPI bool Gr2PackWriter_Init(TGr2PackWriter* writer)
+{
+	memset(writer, 0, sizeof(TGr2PackWriter));
+
+	return DArray_Init(&writer->entries, sizeof(TGr2PackEntry), 64) && DArray_Init(&writer->blobs, sizeof(uint8_t*), 64) &&
+		DArray_Init(&writer->names, sizeof(char), 1024);
+}
+
+OG_DLLAPI void Gr2PackWriter_Free(TGr2PackWriter* writer)
+{
+	for (size_t i = 0; i < writer->blobs.count; i++)
+		free(*(uint8_t**)DArray_Get(&writer->blobs, i));
+
+	DArray_Free(&writer->entries);
+	DArray_Free(&writer->blobs);
+	DArray_Free(&writer->names);
+}
+
+/*!
+	Appends bytes to a byte array, stream callback of the images
+	@param context The TDArray (sizeof(uint8_t))
+	@param data The bytes to append
+	@param len Number of bytes
+	@return true if the bytes were appended, otherwise false
+*/
+static bool Pack_WriteArray(void* context, const void* data, size_t len)
+{
+	TDArray* array = (TDArray*)context;
+
+	if (array->count + len > array->reserved && !DArray_Resize(array, array->count + len > array->reserved * 2 ? array->count + len : array->reserved * 2))
+		return false;
+
+	memcpy(array->data + array->count, data, len);
+	array->count += len;
+	return true;
+}
+
+OG_DLLAPI bool Gr2PackWriter_Add(TGr2PackWriter* writer, const char* name, const uint8_t* data, size_t len, uint32_t kind)
+{
+	TGr2PackEntry entry;
+	uint8_t* blob = NULL;
+	size_t nameLength = strlen(name);
+
+	if (nameLength >= UINT32_MAX || writer->names.count + nameLength + 1 > UINT32_MAX)
+		return false;
+
+	if (kind == GR2_PACK_IMAGE)
+	{
+		TGr2 gr2;
+		TDArray image;
+		TGr2Stream stream = { &image, Pack_WriteArray, NULL };
+		bool success;
+
+		/* relative pointers make the image usable in place */
+		if (!DArray_Init(&image, sizeof(uint8_t), len + 1024) || !Gr2_Init(&gr2))
+		{
+			DArray_Free(&image);
+			return false;
+		}
+
+		gr2.loadMode = GR2_LOAD_DATA;
+		gr2.relativePointers = true;
+		success = Gr2_Load(data, len, &gr2) && Gr2_ComposeImage(&gr2, &stream);
+		Gr2_Free(&gr2);
+
+		if (!success)
+		{
+			dbg_printf("cannot build the image of %s", name);
+			DArray_Free(&image);
+			return false;
+		}
+
+		/* the array keeps the image, it's freed with the blobs */
+		blob = image.data;
+		len = image.count;
+	}
+	else if (kind == GR2_PACK_FILE)
+	{
+		blob = (uint8_t*)malloc(len ? len : 1);
+
+		if (!blob)
+		{
+			dbg_printf("memory allocation fail!!!");
+			return false;
+		}
+
+		memcpy(blob, data, len);
+	}
+	else
+	{
+		dbg_printf("unknown kind %u", kind);
+		return false;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	entry.hash = Pack_Hash(name, nameLength);
+	entry.offset = writer->blobs.count;
+	entry.size = len;
+	entry.nameOffset = (uint32_t)writer->names.count;
+	entry.nameLength = (uint32_t)nameLength;
+	entry.kind = kind;
+
+	/* the blobs are indexed like the entries, a failure removes everything that was added */
+	if (!DArray_Add(&writer->blobs, &blob) || !Pack_WriteArray(&writer->names, name, nameLength + 1) || !DArray_Add(&writer->entries, &entry))
+	{
+		dbg_printf("memory allocation fail!!!");
+		writer->blobs.count = writer->entries.count;
+		writer->names.count = entry.nameOffset;
+		free(blob);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+	Orders the entries by hash, then by the order they were added
+*/
+static int Pack_CompareEntries(const void* a, const void* b)
+{
+	const TGr2PackEntry* ea = (const TGr2PackEntry*)a;
+	const TGr2PackEntry* eb = (const TGr2PackEntry*)b;
+
+	if (ea->hash != eb->hash)
+		return ea->hash < eb->hash ? -1 : 1;
+
+	return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+OG_DLLAPI bool Gr2PackWriter_Write(TGr2PackWriter* writer, const TGr2Stream* stream)
+{
+	static const uint8_t padding[PACK_ALIGNMENT] = { 0 };
+	uint32_t count = (uint32_t)writer->entries.count;
+	TGr2PackEntry* entries = NULL;
+	uint32_t* buckets = NULL;
+	uint64_t position, *blobOffsets = NULL;
+	TPackHeader header;
+	bool success = false;
+
+	if (!stream || !stream->write || writer->entries.count >= UINT32_MAX)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.count = count;
+
+	/* about one entry for each bucket */
+	while (header.bucketBits < 31 && ((uint64_t)1 << header.bucketBits) < count)
+		header.bucketBits++;
+
+	entries = (TGr2PackEntry*)malloc(sizeof(TGr2PackEntry) * (count ? count : 1));
+	buckets = (uint32_t*)malloc(sizeof(uint32_t) * (((size_t)1 << header.bucketBits) + 1));
+	blobOffsets = (uint64_t*)malloc(sizeof(uint64_t) * (count ? count : 1));
+
+	if (!entries || !buckets || !blobOffsets)
+	{
+		dbg_printf("memory allocation fail!!!");
+		goto end;
+	}
+
+	header.entriesOffset = sizeof(TPackHeader);
+	header.bucketsOffset = header.entriesOffset + (uint64_t)sizeof(TGr2PackEntry) * count;
+	header.namesOffset = header.bucketsOffset + sizeof(uint32_t) * (((uint64_t)1 << header.bucketBits) + 1);
+	header.namesSize = writer->names.count;
+	position = header.namesOffset + header.namesSize;
+
+	/* the data follows in the order the files were added */
+	for (uint32_t i = 0; i < count; i++)
+	{
+		position = (position + PACK_ALIGNMENT - 1) & ~(uint64_t)(PACK_ALIGNMENT - 1);
+		blobOffsets[i] = position;
+		position += ((const TGr2PackEntry*)DArray_Get(&writer->entries, i))->size;
+	}
+
+	memcpy(entries, writer->entries.data, sizeof(TGr2PackEntry) * count);
+	qsort(entries, count, sizeof(TGr2PackEntry), Pack_CompareEntries);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		/* the names of an hash are next to each other */
+		for (uint32_t j = i + 1; j < count && entries[j].hash == entries[i].hash; j++)
+		{
+			if (entries[i].nameLength == entries[j].nameLength &&
+				!memcmp(writer->names.data + entries[i].nameOffset, writer->names.data + entries[j].nameOffset, entries[i].nameLength))
+			{
+				dbg_printf("%s was added twice", (const char*)writer->names.data + entries[i].nameOffset);
+				goto end;
+			}
+		}
+
+		entries[i].offset = blobOffsets[entries[i].offset];
+	}
+
+	for (uint32_t b = 0, i = 0; b <= ((uint32_t)1 << header.bucketBits); b++)
+	{
+		while (i < count && Pack_GetBucket(entries[i].hash, header.bucketBits) < b)
+			i++;
+
+		buckets[b] = i;
+	}
+
+	if (!stream->write(stream->context, &header, sizeof(header)) ||
+		(count && !stream->write(stream->context, entries, sizeof(TGr2PackEntry) * count)) ||
+		!stream->write(stream->context, buckets, sizeof(uint32_t) * (((size_t)1 << header.bucketBits) + 1)) ||
+		(header.namesSize && !stream->write(stream->context, writer->names.data, (size_t)header.namesSize)))
+		goto end;
+
+	position = header.namesOffset + header.namesSize;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TGr2PackEntry* entry = (const TGr2PackEntry*)DArray_Get(&writer->entries, i);
+
+		if ((blobOffsets[i] > position && !stream->write(stream->context, padding, (size_t)(blobOffsets[i] - position))) ||
+			(entry->size && !stream->write(stream->context, *(uint8_t**)DArray_Get(&writer->blobs, i), (size_t)entry->size)))
+			goto end;
+
+		position = blobOffsets[i] + entry->size;
+	}
+
+	success = true;
+
+end:
+	if (!success)
+	{
+		dbg_printf("cannot write the pack");
+	}
+
+	free(entries);
+	free(buckets);
+	free(blobOffsets);
+	return success;
+}
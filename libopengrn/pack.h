@@ -0,0 +1,150 @@
+/*!
+	Project: libopengrn
+	File: pack.h
+	Archives of many Granny2 files with a memory mappable index
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	How the files are stored inside a pack
+*/
+enum EGr2PackKinds
+{
+	GR2_PACK_FILE, /* the Granny2 file as it is, loaded with Gr2_Load */
+	GR2_PACK_IMAGE, /* the decompressed data with relative pointers (see Gr2_ComposeImage), loaded with Gr2_LoadImage */
+};
+
+/*!
+	A file stored inside a pack
+*/
+typedef struct SGr2PackEntry
+{
+	uint64_t hash; /* hash of the name */
+	uint64_t offset; /* position of the data inside the pack */
+	uint64_t size; /* length of the data */
+	uint32_t nameOffset; /* position of the name inside the name table */
+	uint32_t nameLength; /* length of the name, without the terminator */
+	uint32_t kind; /* one of EGr2PackKinds */
+	uint32_t reserved; /* always 0 */
+} TGr2PackEntry;
+
+/*!
+	An open pack, the index is used where it's mapped
+*/
+typedef struct SGr2Pack
+{
+	const uint8_t* data; /* the whole pack */
+	size_t size; /* length of the pack */
+	const TGr2PackEntry* entries; /* entries sorted by hash */
+	uint32_t count; /* number of entries */
+	const uint32_t* buckets; /* first entry of every bucket of hashes, plus the end of the last one */
+	uint32_t bucketBits; /* the bucket of a hash is it's top bucketBits bits */
+	const char* names; /* name table */
+	uint64_t namesSize; /* length of the name table */
+	void* mapping; /* file mapped by Gr2Pack_Open, NULL if the pack is in memory of the caller */
+} TGr2Pack;
+
+/*!
+	Files collected for a new pack
+*/
+typedef struct SGr2PackWriter
+{
+	TDArray entries; /* the files (sizeof(TGr2PackEntry)), offset is the index of their data until the pack is written */
+	TDArray blobs; /* data of the files (sizeof(uint8_t*)) */
+	TDArray names; /* names of the files, zero terminated one after the other (sizeof(char)) */
+} TGr2PackWriter;
+
+/*!
+	Opens a pack file with a single mapping of the whole file
+	@param pack The pack to open, must be closed with Gr2Pack_Close
+	@param path Path of the pack
+	@return true if the pack was opened, false if the file can't be mapped or is not a pack
+*/
+extern OG_DLLAPI bool Gr2Pack_Open(TGr2Pack* pack, const char* path);
+
+/*!
+	Opens a pack that is already in memory
+	@param pack The pack to open
+	@param data The pack, must stay valid until the pack is closed
+	@param len Length of the pack
+	@return true if the pack was opened, false if the data is not a pack
+*/
+extern OG_DLLAPI bool Gr2Pack_OpenMemory(TGr2Pack* pack, const uint8_t* data, size_t len);
+
+/*!
+	Closes a pack, the structures loaded from it must be freed first
+	@param pack The pack to close
+*/
+extern OG_DLLAPI void Gr2Pack_Close(TGr2Pack* pack);
+
+/*!
+	Finds a file of a pack by name, the name is hashed once and only the entries of it's bucket are compared
+	@param pack The pack
+	@param name Name of the file, as it was added
+	@return the entry of the file, NULL if the pack doesn't contain it or the entry is malformed
+*/
+extern OG_DLLAPI const TGr2PackEntry* Gr2Pack_Find(const TGr2Pack* pack, const char* name);
+
+/*!
+	Gets the data of a file of a pack, without copying it
+	@param pack The pack
+	@param entry The entry of the file (see Gr2Pack_Find)
+	@return the data of the file (entry->size bytes)
+*/
+extern OG_DLLAPI const uint8_t* Gr2Pack_GetData(const TGr2Pack* pack, const TGr2PackEntry* entry);
+
+/*!
+	Loads a file of a pack
+	@param pack The pack
+	@param name Name of the file
+	@param gr2 The structure to store the data (see Gr2_Load)
+	@return true if the file was loaded, otherwise false
+	@note Images are used in place, the pack must stay open until the structure is freed
+*/
+extern OG_DLLAPI bool Gr2Pack_Load(const TGr2Pack* pack, const char* name, TGr2* gr2);
+
+/*!
+	Initializes a pack writer
+	@param writer The writer to initialize, must be freed with Gr2PackWriter_Free
+	@return true if the writer was initialized, otherwise false
+*/
+extern OG_DLLAPI bool Gr2PackWriter_Init(TGr2PackWriter* writer);
+
+/*!
+	Frees the memory of a pack writer
+	@param writer The writer to free
+*/
+extern OG_DLLAPI void Gr2PackWriter_Free(TGr2PackWriter* writer);
+
+/*!
+	Adds a Granny2 file to a pack writer
+	@param writer The writer
+	@param name Name of the file inside the pack
+	@param data The Granny2 file, copied by the writer
+	@param len Length of the file
+	@param kind How the file is stored (one of EGr2PackKinds), GR2_PACK_IMAGE loads and decompresses it now
+	@return true if the file was added, false if the file can't be loaded or there is no memory, the writer is left as it was
+*/
+extern OG_DLLAPI bool Gr2PackWriter_Add(TGr2PackWriter* writer, const char* name, const uint8_t* data, size_t len, uint32_t kind);
+
+/*!
+	Writes the pack of the added files
+	@param writer The writer
+	@param stream Destination of the pack
+	@return true if the pack was written, false if two files have the same name or the stream fails
+*/
+extern OG_DLLAPI bool Gr2PackWriter_Write(TGr2PackWriter* writer, const TGr2Stream* stream);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,717 @@
+/*!
+	Project: libopengrn
+	File: pathindex.c
+	Lookup of the elements by their name path
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "pathindex.h"
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+	How the children of an element are grouped into structures
+*/
+typedef struct SPathStructures
+{
+	TLayoutChildren children; /* raw structures, layout is NULL for elements not loaded from a file */
+	uint32_t members; /* number of children of each structure */
+	bool array; /* the structures are selected with an index */
+} TPathStructures;
+
+/*!
+	An indexed element, the chain of containers gives back the full path of a hash
+*/
+typedef struct SPathEntry
+{
+	TElementGeneric* elem; /* the element */
+	size_t parent; /* entry of the container + 1, 0 for the members of the root */
+	uint32_t structure; /* structure of the container that has the element */
+	bool array; /* the container is an array, the structure is part of the path */
+} TPathEntry;
+
+/*!
+	A container on the index stack
+*/
+typedef struct SIndexFrame
+{
+	TElementGeneric* elem; /* the container */
+	TDArray* children; /* children of the container */
+	TPathStructures structures; /* structures of the container */
+	uint64_t hash; /* hash of the path of the container */
+	size_t entry; /* entry of the container + 1, 0 for the root */
+	uint32_t structure; /* structure being indexed */
+	uint32_t member; /* next member of the structure */
+	size_t child; /* next child to index */
+} TIndexFrame;
+
+/*!
+	A parsed name of a path
+*/
+typedef struct SPathSegment
+{
+	const char* name; /* first character of the name */
+	size_t len; /* length of the name */
+	uint32_t index; /* index of the structure */
+	bool hasIndex; /* true if the name has an index */
+} TPathSegment;
+
+/*!
+	Checks if the structures of a member are selected with an index
+	@param type Type of the member
+	@param count Number of array elements of the member
+	@return true if the member is an array of structures
+*/
+static bool Path_IsArrayType(uint32_t type, uint32_t count)
+{
+	switch (type)
+	{
+	case TYPEID_REFERENCETOARRAY:
+	case TYPEID_ARRAYOFREFERENCES:
+	case TYPEID_REFERENCETOVARIANTARRAY:
+		return true;
+
+	case TYPEID_INLINE:
+		return count > 1;
+
+	default:
+		return false;
+	}
+}
+
+static bool Path_IsArray(const TElementGeneric* elem)
+{
+	return Path_IsArrayType(elem->rawInfo.type, elem->member ? elem->member->count : 1);
+}
+
+/*!
+	Gets how the children of an element are grouped into structures
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element
+	@param children Children of the element
+	@param out Output structures
+	@return true if the structures were resolved, otherwise false
+*/
+static bool Path_GetStructures(TGr2* gr2, TElementGeneric* elem, const TDArray* children, TPathStructures* out)
+{
+	memset(out, 0, sizeof(TPathStructures));
+
+	if (elem == gr2->root && gr2->data)
+	{
+		out->children.layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+		out->children.count = 1;
+	}
+	else if (elem->member && gr2->data)
+	{
+		if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, elem->member, elem->data, &out->children))
+			return false;
+
+		out->array = Path_IsArray(elem);
+	}
+	else
+	{
+		/* element created by the program, all the children are members of the same structures */
+		out->children.count = elem->size > 1 && Path_IsArray(elem) ? elem->size : 1;
+		out->array = Path_IsArray(elem);
+	}
+
+	if (out->children.layout)
+		out->members = out->children.layout->count;
+	else if (out->children.count)
+		out->members = (uint32_t)(children->count / out->children.count);
+
+	return true;
+}
+
+/*!
+	Skips the empty references of an array of references
+	@param gr2 The Gr2 structure
+	@param structures The structures
+	@param index First structure to check
+	@return the index of the first non empty structure
+*/
+static uint32_t Path_SkipEmpty(TGr2* gr2, const TPathStructures* structures, uint32_t index)
+{
+	if (!structures->children.references)
+		return index;
+
+	while (index < structures->children.count && !LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &structures->children, index))
+		index++;
+
+	return index;
+}
+
+static uint64_t Path_HashIndex(uint64_t hash, uint32_t index)
+{
+	char buf[16];
+	int len = snprintf(buf, sizeof(buf), "[%u]", index);
+
+	return HashTable_HashBytes(buf, (size_t)len, hash);
+}
+
+/*!
+	Hashes a member name on top of the path of it's container
+	@param hash Hash of the path of the container
+	@param isRoot true if the container is the root
+	@param array true if the container is an array
+	@param structure Index of the structure inside the container
+	@param name Name of the member
+	@param len Length of the name
+	@return the hash of the path of the member
+*/
+static uint64_t Path_HashMember(uint64_t hash, bool isRoot, bool array, uint32_t structure, const char* name, size_t len)
+{
+	if (!isRoot)
+	{
+		if (array)
+			hash = Path_HashIndex(hash, structure);
+
+		hash = HashTable_HashBytes(".", 1, hash);
+	}
+
+	return HashTable_HashBytes(name, len, hash);
+}
+
+/*!
+	Parses the next name of a path
+	@param path Current position inside the path, moved after the name
+	@param segment Output name
+	@return true if a name was parsed, otherwise false
+*/
+static bool Path_NextSegment(const char** path, TPathSegment* segment)
+{
+	const char* p = *path;
+
+	segment->name = p;
+	segment->index = 0;
+	segment->hasIndex = false;
+
+	while (*p && *p != '.' && *p != '[')
+		p++;
+
+	segment->len = (size_t)(p - segment->name);
+
+	if (!segment->len)
+		return false;
+
+	if (*p == '[')
+	{
+		uint64_t index = 0;
+
+		p++;
+
+		if (*p < '0' || *p > '9')
+			return false;
+
+		while (*p >= '0' && *p <= '9')
+		{
+			index = index * 10 + (uint64_t)(*p - '0');
+
+			if (index > UINT32_MAX)
+				return false;
+
+			p++;
+		}
+
+		if (*p != ']')
+			return false;
+
+		p++;
+		segment->index = (uint32_t)index;
+		segment->hasIndex = true;
+	}
+
+	if (*p == '.')
+	{
+		p++;
+
+		if (!*p)
+			return false;
+	}
+	else if (*p)
+		return false;
+
+	*path = p;
+	return true;
+}
+
+OG_DLLAPI bool Gr2_BuildIndex(TGr2* gr2)
+{
+	TDArray stack;
+	TIndexFrame frame;
+	bool success = false;
+
+	HashTable_Free(&gr2->pathIndex);
+	DArray_Free(&gr2->pathEntries);
+
+	if (!HashTable_Init(&gr2->pathIndex, gr2->elements.count) || !DArray_Init(&gr2->pathEntries, sizeof(TPathEntry), gr2->elements.count ? gr2->elements.count : 16))
+	{
+		HashTable_Free(&gr2->pathIndex);
+		DArray_Free(&gr2->pathEntries);
+		return false;
+	}
+
+	if (!DArray_Init(&stack, sizeof(TIndexFrame), 16))
+		return false;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.elem = gr2->root;
+	frame.hash = HASHTABLE_SEED;
+
+	if (!(frame.children = Element_GetChildren(gr2, frame.elem)) || !Path_GetStructures(gr2, frame.elem, frame.children, &frame.structures))
+		goto end;
+
+	if (!DArray_Add(&stack, &frame))
+		goto end;
+
+	while (stack.count)
+	{
+		TIndexFrame* top = (TIndexFrame*)DArray_Get(&stack, stack.count - 1);
+		TElementGeneric* child;
+		TPathEntry entry;
+
+		if (top->child >= top->children->count)
+		{
+			DArray_Pop(&stack);
+			continue;
+		}
+
+		if (top->structures.members && top->member == top->structures.members)
+		{
+			top->member = 0;
+			top->structure++;
+		}
+
+		if (top->member == 0)
+			top->structure = Path_SkipEmpty(gr2, &top->structures, top->structure);
+
+		child = *(TElementGeneric**)DArray_Get(top->children, top->child++);
+		top->member++;
+
+		if (!child->name)
+			continue;
+
+		memset(&frame, 0, sizeof(frame));
+		frame.elem = child;
+		frame.hash = Path_HashMember(top->hash, top->elem == gr2->root, top->structures.array, top->structure, child->name, strlen(child->name));
+
+		entry.elem = child;
+		entry.parent = top->entry;
+		entry.structure = top->structure;
+		entry.array = top->structures.array;
+
+		if (!DArray_Add(&gr2->pathEntries, &entry) || !HashTable_Add(&gr2->pathIndex, frame.hash, (void*)gr2->pathEntries.count))
+			goto end;
+
+		frame.entry = gr2->pathEntries.count;
+
+		if (!(frame.children = Element_GetChildren(gr2, child)))
+			goto end;
+
+		if (!frame.children->count)
+			continue;
+
+		if (!Path_GetStructures(gr2, child, frame.children, &frame.structures))
+			goto end;
+
+		/* the stack may be reallocated, top is not valid after this */
+		if (!DArray_Add(&stack, &frame))
+			goto end;
+	}
+
+	success = true;
+
+end:
+	DArray_Free(&stack);
+
+	if (!success)
+	{
+		dbg_printf("cannot build the path index");
+		HashTable_Free(&gr2->pathIndex);
+		DArray_Free(&gr2->pathEntries);
+	}
+
+	return success;
+}
+
+/*!
+	Finds a member of a structure of an element
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element that contains the structures
+	@param name Name of the member
+	@param len Length of the name
+	@param index Index of the structure
+	@return the element of the member or NULL if the member does not exist
+*/
+static TElementGeneric* Element_FindChildLen(TGr2* gr2, TElementGeneric* elem, const char* name, size_t len, uint32_t index)
+{
+	TPathStructures structures;
+	TDArray* children = Element_GetChildren(gr2, elem);
+	size_t first;
+	int32_t member = -1;
+
+	if (!children || !children->count || !Path_GetStructures(gr2, elem, children, &structures))
+		return NULL;
+
+	if (index >= structures.children.count || !structures.members)
+		return NULL;
+
+	if (structures.children.references)
+	{
+		/* the empty references have no children */
+		uint32_t position = 0;
+
+		if (!LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &structures.children, index))
+			return NULL;
+
+		for (uint32_t i = 0; i < index; i++)
+		{
+			if (LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &structures.children, i))
+				position++;
+		}
+
+		first = (size_t)position * structures.members;
+	}
+	else
+		first = (size_t)index * structures.members;
+
+	if (first + structures.members > children->count)
+		return NULL;
+
+	if (structures.children.layout)
+		member = Layout_FindMember((TTypeLayout*)structures.children.layout, name, len);
+	else
+	{
+		for (uint32_t i = 0; i < structures.members; i++)
+		{
+			const TElementGeneric* child = *(TElementGeneric**)DArray_Get(children, first + i);
+
+			if (child->name && strncmp(child->name, name, len) == 0 && child->name[len] == 0)
+			{
+				member = (int32_t)i;
+				break;
+			}
+		}
+	}
+
+	if (member < 0)
+		return NULL;
+
+	return *(TElementGeneric**)DArray_Get(children, first + (size_t)member);
+}
+
+OG_DLLAPI TElementGeneric* Element_FindChild(TGr2* gr2, TElementGeneric* elem, const char* name, uint32_t index)
+{
+	return Element_FindChildLen(gr2, elem, name, strlen(name), index);
+}
+
+/*!
+	Checks that an entry of the path index has exactly the names and indices of a path
+	@param gr2 The Gr2 structure
+	@param entry The entry + 1
+	@param path The path (already validated by Path_NextSegment)
+	@param segments Number of names of the path
+	@return true if the path of the entry is the path, false for an hash collision
+*/
+static bool Path_CheckEntry(TGr2* gr2, size_t entry, const char* path, uint32_t segments)
+{
+	TPathSegment segment, previous;
+
+	memset(&previous, 0, sizeof(previous));
+
+	for (uint32_t i = 0; i < segments; i++)
+	{
+		const TPathEntry* e;
+		size_t current = entry;
+
+		/* the container of the i-th name is segments - 1 - i levels above the element */
+		for (uint32_t up = segments - 1 - i; up && current; up--)
+			current = ((const TPathEntry*)DArray_Get(&gr2->pathEntries, current - 1))->parent;
+
+		if (!current || !Path_NextSegment(&path, &segment))
+			return false;
+
+		e = (const TPathEntry*)DArray_Get(&gr2->pathEntries, current - 1);
+
+		if (!e->elem->name || strncmp(e->elem->name, segment.name, segment.len) != 0 || e->elem->name[segment.len] != 0)
+			return false;
+
+		/* the first name is a member of the root, the other ones are in the structure selected by the previous name */
+		if (i == 0 ? e->parent != 0 : (e->array != previous.hasIndex || (e->array && e->structure != previous.index)))
+			return false;
+
+		previous = segment;
+	}
+
+	return true;
+}
+
+OG_DLLAPI TElementGeneric* Gr2_FindByPath(TGr2* gr2, const char* path)
+{
+	TPathSegment segment;
+	TElementGeneric* elem = gr2->root;
+	uint32_t index = 0;
+	uint64_t hash = HASHTABLE_SEED;
+	bool array = false;
+
+	if (!path || !*path)
+		return NULL;
+
+	if (gr2->pathIndex.capacity)
+	{
+		const char* start = path;
+		uint32_t segments = 0;
+		size_t cursor = 0, found;
+		bool isRoot = true;
+
+		while (*path)
+		{
+			if (!Path_NextSegment(&path, &segment))
+				return NULL;
+
+			if (segment.hasIndex && !*path)
+				return NULL;
+
+			hash = Path_HashMember(hash, isRoot, array, index, segment.name, segment.len);
+			array = segment.hasIndex;
+			index = segment.index;
+			isRoot = false;
+			segments++;
+		}
+
+		/* every name and index of the hit is checked to reject the collisions of different paths */
+		while ((found = (size_t)HashTable_Find(&gr2->pathIndex, hash, &cursor)))
+		{
+			if (Path_CheckEntry(gr2, found, start, segments))
+				return ((const TPathEntry*)DArray_Get(&gr2->pathEntries, found - 1))->elem;
+		}
+
+		return NULL;
+	}
+
+	while (*path)
+	{
+		if (!Path_NextSegment(&path, &segment))
+			return NULL;
+
+		if (!(elem = Element_FindChildLen(gr2, elem, segment.name, segment.len, index)))
+			return NULL;
+
+		/* only the arrays that are followed by a member take an index, like the keys of the index */
+		if (*path ? segment.hasIndex != Path_IsArray(elem) : segment.hasIndex)
+			return NULL;
+
+		index = segment.index;
+	}
+
+	return elem;
+}
+
+/*!
+	Checks the variant type of a member against the type the query was compiled with
+	@param gr2 The Gr2 structure
+	@param step The step of the member
+	@param type Variant type read from the data
+	@return true if the type tree matches
+*/
+static bool Query_CheckVariant(TGr2* gr2, const TGr2QueryStep* step, const uint8_t* type)
+{
+	TTypeLayout* layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, type);
+
+	return layout && LayoutCache_GetTreeHash(&gr2->layouts, &gr2->virtual_ptr, layout) == step->hash;
+}
+
+/*!
+	Moves from a structure to the structure selected by a step
+	@param gr2 The Gr2 structure
+	@param step The step to apply
+	@param data Data of the current structure
+	@return data of the selected structure or NULL if it does not exist
+*/
+static const uint8_t* Query_Step(TGr2* gr2, const TGr2QueryStep* step, const uint8_t* data)
+{
+	TLayoutCache* cache = &gr2->layouts;
+	TVirtualPtrTable* vptr = &gr2->virtual_ptr;
+	size_t ptrSize = cache->is64 ? 8 : 4;
+	const uint8_t* base;
+
+	data += step->offset;
+
+	switch (step->type)
+	{
+	case TYPEID_INLINE: // 1
+		return data + (size_t)step->index * step->stride;
+
+	case TYPEID_REFERENCE: // 2
+		return LayoutCache_ReadPtr(cache, vptr, data);
+
+	case TYPEID_REFERENCETOARRAY: // 3
+		if (step->index >= *(const uint32_t*)data)
+			return NULL;
+
+		base = LayoutCache_ReadPtr(cache, vptr, data + 4);
+		return base ? base + (size_t)step->index * step->stride : NULL;
+
+	case TYPEID_ARRAYOFREFERENCES: // 4
+		if (step->index >= *(const uint32_t*)data)
+			return NULL;
+
+		base = LayoutCache_ReadPtr(cache, vptr, data + 4);
+		return base ? LayoutCache_ReadPtr(cache, vptr, base + step->index * ptrSize) : NULL;
+
+	case TYPEID_VARIANTREFERENCE: // 5
+		if (!Query_CheckVariant(gr2, step, LayoutCache_ReadPtr(cache, vptr, data)))
+			return NULL;
+
+		return LayoutCache_ReadPtr(cache, vptr, data + ptrSize);
+
+	case TYPEID_REFERENCETOVARIANTARRAY: // 7
+		if (step->index >= *(const uint32_t*)(data + ptrSize))
+			return NULL;
+
+		if (!Query_CheckVariant(gr2, step, LayoutCache_ReadPtr(cache, vptr, data)))
+			return NULL;
+
+		base = LayoutCache_ReadPtr(cache, vptr, data + ptrSize + 4);
+		return base ? base + (size_t)step->index * step->stride : NULL;
+
+	default:
+		return NULL;
+	}
+}
+
+OG_DLLAPI bool Gr2_CompileQuery(TGr2* gr2, const char* path, TGr2Query* query)
+{
+	TPathSegment segment;
+	TTypeLayout* layout;
+	TDArray steps;
+	const uint8_t* data;
+
+	memset(query, 0, sizeof(TGr2Query));
+
+	if (!gr2->data || !path || !*path)
+		return false;
+
+	layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+	data = gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position;
+
+	if (!layout || !(query->typeHash = LayoutCache_GetTreeHash(&gr2->layouts, &gr2->virtual_ptr, layout)))
+		return false;
+
+	if (!DArray_Init(&steps, sizeof(TGr2QueryStep), 8))
+		return false;
+
+	while (*path)
+	{
+		TGr2QueryStep step;
+		const TTypeMember* member;
+		int32_t i;
+
+		if (!Path_NextSegment(&path, &segment))
+			goto fail;
+
+		if ((i = Layout_FindMember(layout, segment.name, segment.len)) < 0)
+		{
+			dbg_printf("query member %.*s not found", (int)segment.len, segment.name);
+			goto fail;
+		}
+
+		member = &layout->members[i];
+
+		memset(&step, 0, sizeof(step));
+		step.offset = member->offset;
+		step.index = segment.index;
+		step.type = member->info.type;
+
+		if (!*path)
+		{
+			/* last member, the result of the query */
+			if (segment.hasIndex || !DArray_Add(&steps, &step))
+				goto fail;
+
+			query->type = member->info.type;
+			query->size = member->size;
+			break;
+		}
+
+		if (segment.hasIndex != Path_IsArrayType(member->info.type, member->count))
+			goto fail;
+
+		if (member->info.type == TYPEID_VARIANTREFERENCE || member->info.type == TYPEID_REFERENCETOVARIANTARRAY)
+		{
+			TLayoutChildren children;
+
+			/* the type is stored in the data, take the one of this file */
+			if (!data || !LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, member, data + member->offset, &children) || !children.layout)
+				goto fail;
+
+			layout = (TTypeLayout*)children.layout;
+
+			if (!(step.hash = LayoutCache_GetTreeHash(&gr2->layouts, &gr2->virtual_ptr, layout)))
+				goto fail;
+		}
+		else if (member->info.type == TYPEID_INLINE)
+		{
+			if (!member->inlineLayout || segment.index >= member->count)
+				goto fail;
+
+			layout = member->inlineLayout;
+		}
+		else if (!member->recurse || !(layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, member->childType)))
+			goto fail;
+
+		step.stride = layout->stride;
+
+		if (data)
+			data = Query_Step(gr2, &step, data);
+
+		if (!DArray_Add(&steps, &step))
+			goto fail;
+	}
+
+	query->steps = (TGr2QueryStep*)steps.data;
+	query->count = (uint32_t)steps.count;
+	return true;
+
+fail:
+	DArray_Free(&steps);
+	memset(query, 0, sizeof(TGr2Query));
+	return false;
+}
+
+OG_DLLAPI void Gr2_FreeQuery(TGr2Query* query)
+{
+	if (query->steps)
+	{
+		free(query->steps);
+		query->steps = NULL;
+	}
+
+	query->count = 0;
+}
+
+OG_DLLAPI const uint8_t* Gr2_EvalQuery(TGr2* gr2, const TGr2Query* query)
+{
+	TTypeLayout* layout;
+	const uint8_t* data;
+
+	if (!gr2->data || !query->count)
+		return NULL;
+
+	layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+
+	if (!layout || LayoutCache_GetTreeHash(&gr2->layouts, &gr2->virtual_ptr, layout) != query->typeHash)
+		return NULL;
+
+	data = gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position;
+
+	for (uint32_t i = 0; i + 1 < query->count && data; i++)
+		data = Query_Step(gr2, &query->steps[i], data);
+
+	return data ? data + query->steps[query->count - 1].offset : NULL;
+}
@@ -0,0 +1,108 @@
+/*!
+	Project: libopengrn
+	File: pathindex.h
+	Lookup of the elements by their name path
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	A step of a compiled query, selects a member of the current structure
+*/
+typedef struct SGr2QueryStep
+{
+	uint32_t offset; /* offset of the member inside the structure */
+	uint32_t index; /* structure selected inside the member (arrays only) */
+	uint32_t stride; /* size of the structures referenced by the member */
+	uint32_t type; /* type of the member */
+	uint64_t hash; /* tree hash of the variant type of the member (variants only) */
+} TGr2QueryStep;
+
+/*!
+	A path compiled into member offsets, valid for every file with the same type tree
+*/
+typedef struct SGr2Query
+{
+	TGr2QueryStep* steps; /* steps of the query, the last one selects the result */
+	uint32_t count; /* number of steps */
+	uint64_t typeHash; /* tree hash of the root type of the file the query was compiled with */
+	uint32_t type; /* type of the resulting member */
+	uint32_t size; /* full size of the resulting member */
+} TGr2Query;
+
+/*!
+	Builds the path index of a Gr2 structure, after this Gr2_FindByPath
+	resolves any path with a single hash lookup
+	@param gr2 The Gr2 structure to index
+	@return true if the index was built, otherwise false
+	@note In lazy mode this parses all the elements of the file
+	@note The index is not updated when elements are added, call this
+		again after modifying the element tree
+	@note The hits are checked against every name and index of the path, so a collision of the
+		64-bit hashes never returns an element with another path
+*/
+extern OG_DLLAPI bool Gr2_BuildIndex(TGr2* gr2);
+
+/*!
+	Finds an element by it's path from the root
+	@param gr2 The Gr2 structure that contains the element
+	@param path Path of the element, member names separated by dots,
+		the members of an array are selected with an index (e.g. "Meshes[3].PrimaryVertexData.Vertices")
+	@return the element or NULL if the path does not exist
+	@note Array members require an index, the other members must not have one;
+		the last name of the path selects a member, so it can't have an index
+	@note Without an index (see Gr2_BuildIndex) each name is resolved
+		with the member name table of it's structure
+*/
+extern OG_DLLAPI TElementGeneric* Gr2_FindByPath(TGr2* gr2, const char* path);
+
+/*!
+	Finds a member of a structure of an element
+	@param gr2 The Gr2 structure that contains the element
+	@param elem The element that contains the structures
+	@param name Name of the member
+	@param index Index of the structure (0 for non array elements)
+	@return the element of the member or NULL if the member does not exist
+*/
+extern OG_DLLAPI TElementGeneric* Element_FindChild(TGr2* gr2, TElementGeneric* elem, const char* name, uint32_t index);
+
+/*!
+	Compiles a path into a query, the names are resolved only once with the layouts of the file
+	@param gr2 The Gr2 structure used to resolve the path (loaded with any mode)
+	@param path Path of the member (see Gr2_FindByPath)
+	@param query Output query, must be freed with Gr2_FreeQuery
+	@return true if the path was compiled, otherwise false
+	@note The members with variant types are resolved with the data of the file, the query
+		is valid for another file only if it's variants have the same types
+*/
+extern OG_DLLAPI bool Gr2_CompileQuery(TGr2* gr2, const char* path, TGr2Query* query);
+
+/*!
+	Frees a compiled query
+	@param query The query to free
+*/
+extern OG_DLLAPI void Gr2_FreeQuery(TGr2Query* query);
+
+/*!
+	Evaluates a compiled query on a file
+	@param gr2 The Gr2 structure to evaluate (loaded with any mode)
+	@param query The query
+	@return pointer to the data of the member inside gr2->data, or NULL if the type tree
+		of the file does not match the query or the path does not exist in this file
+	@note The type tree hash is cached inside the layouts, so after the first evaluation
+		on a file the query is only pointer arithmetic
+*/
+extern OG_DLLAPI const uint8_t* Gr2_EvalQuery(TGr2* gr2, const TGr2Query* query);
+
+#ifdef __cplusplus
+}
+#endif
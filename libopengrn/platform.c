@@ -9,6 +9,29 @@
 */
 #include "platform.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*!
+	Maximum number of threads started by Platform_RunParallel
+*/
+#define PLATFORM_MAX_THREADS 64
+
+#ifdef OG_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
 /*!
 	Gets the pointer size of the platform
 	@return the pointer size
@@ -76,3 +99,265 @@ void Platform_Swap2(uint8_t* data, size_t len)
 		data[i + 3] = d2;
 	}
 }
+
+#ifdef OG_X86
+/*!
+	Runs the cpuid instruction
+	@param leaf Leaf to query
+	@param subleaf Subleaf to query
+	@param regs Output eax, ebx, ecx and edx
+*/
+static void Platform_Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/*!
+	Reads the extended control register 0, which tells the register states saved by the OS
+	@return the value of xcr0
+*/
+static uint64_t Platform_GetXcr0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+/*!
+	Instruction sets turned off by Platform_DisableCpuFeatures
+*/
+static volatile uint32_t platformDisabledFeatures = 0;
+
+uint32_t Platform_GetCpuFeatures(void)
+{
+#ifdef OG_X86
+	static volatile uint32_t features = 0;
+	static volatile bool detected = false;
+	uint32_t regs[4], maxLeaf, result = 0;
+
+	if (detected)
+		return features & ~platformDisabledFeatures;
+
+	Platform_Cpuid(0, 0, regs);
+	maxLeaf = regs[0];
+
+	if (maxLeaf >= 1)
+	{
+		Platform_Cpuid(1, 0, regs);
+
+		if (regs[3] & (1 << 26))
+			result |= PLATFORM_CPU_SSE2;
+
+		/* avx needs the os to save the ymm registers (osxsave and xcr0 bits 1-2) */
+		if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (Platform_GetXcr0() & 6) == 6)
+		{
+			result |= PLATFORM_CPU_AVX;
+
+			if (regs[2] & (1 << 12))
+				result |= PLATFORM_CPU_FMA;
+
+			if (regs[2] & (1 << 29))
+				result |= PLATFORM_CPU_F16C;
+
+			if (maxLeaf >= 7)
+			{
+				Platform_Cpuid(7, 0, regs);
+
+				if (regs[1] & (1 << 5))
+					result |= PLATFORM_CPU_AVX2;
+			}
+		}
+	}
+
+	features = result;
+	detected = true;
+	return features & ~platformDisabledFeatures;
+#else
+	return 0;
+#endif
+}
+
+void Platform_DisableCpuFeatures(uint32_t disabled)
+{
+	platformDisabledFeatures = disabled;
+}
+
+uint32_t Platform_GetCpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+/*!
+	Shared state of the threads of Platform_RunParallel
+*/
+typedef struct SPlatformParallel
+{
+	TPlatformTaskFunc func; /* task function */
+	void* context; /* task context */
+	uint32_t tasks; /* number of tasks */
+	volatile long next; /* next task to run */
+} TPlatformParallel;
+
+/*!
+	Runs tasks until all of them are taken
+	@param parallel The shared state
+*/
+static void Platform_RunTasks(TPlatformParallel* parallel)
+{
+	for (;;)
+	{
+#ifdef _WIN32
+		long index = InterlockedIncrement(&parallel->next) - 1;
+#else
+		long index = __atomic_fetch_add(&parallel->next, 1, __ATOMIC_RELAXED);
+#endif
+
+		if (index < 0 || (uint32_t)index >= parallel->tasks)
+			return;
+
+		parallel->func(parallel->context, (uint32_t)index);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Platform_ThreadMain(LPVOID param)
+{
+	Platform_RunTasks((TPlatformParallel*)param);
+	return 0;
+}
+#else
+static void* Platform_ThreadMain(void* param)
+{
+	Platform_RunTasks((TPlatformParallel*)param);
+	return NULL;
+}
+#endif
+
+void Platform_RunParallel(TPlatformTaskFunc func, void* context, uint32_t tasks, uint32_t threads)
+{
+	TPlatformParallel parallel = { func, context, tasks, 0 };
+#ifdef _WIN32
+	HANDLE handles[PLATFORM_MAX_THREADS];
+#else
+	pthread_t handles[PLATFORM_MAX_THREADS];
+#endif
+	uint32_t started = 0;
+
+	if (!threads)
+		threads = Platform_GetCpuCount();
+
+	if (threads > tasks)
+		threads = tasks;
+
+	if (threads > PLATFORM_MAX_THREADS)
+		threads = PLATFORM_MAX_THREADS;
+
+	for (uint32_t i = 1; i < threads; i++)
+	{
+#ifdef _WIN32
+		if (!(handles[started] = CreateThread(NULL, 0, Platform_ThreadMain, &parallel, 0, NULL)))
+			break;
+#else
+		if (pthread_create(&handles[started], NULL, Platform_ThreadMain, &parallel))
+			break;
+#endif
+		started++;
+	}
+
+	Platform_RunTasks(&parallel);
+
+	for (uint32_t i = 0; i < started; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+#else
+		pthread_join(handles[i], NULL);
+#endif
+	}
+}
+
+void* Platform_MapFile(const char* path, size_t* len)
+{
+	void* data = NULL;
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+
+	*len = 0;
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (uint64_t)size.QuadPart <= SIZE_MAX)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+		if (mapping)
+		{
+			data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+
+		if (data)
+			*len = (size_t)size.QuadPart;
+	}
+
+	CloseHandle(file);
+#else
+	struct stat info;
+	int fd;
+
+	*len = 0;
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+
+	if (!fstat(fd, &info) && info.st_size > 0 && (uint64_t)info.st_size <= SIZE_MAX)
+	{
+		data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED)
+			data = NULL;
+		else
+			*len = (size_t)info.st_size;
+	}
+
+	close(fd);
+#endif
+	return data;
+}
+
+void Platform_UnmapFile(void* data, size_t len)
+{
+	if (!data)
+		return;
+
+#ifdef _WIN32
+	(void)len;
+	UnmapViewOfFile(data);
+#else
+	munmap(data, len);
+#endif
+}
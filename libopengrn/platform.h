@@ -13,6 +13,42 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*!
+	Defined when the target has SSE2 (always true on x86-64)
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OG_SSE2 1
+#endif
+
+/*!
+	Defined when the target is x86, the instruction sets after SSE2 are detected at runtime
+*/
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define OG_X86 1
+#endif
+
+/*!
+	Compiles a function for an instruction set that is not enabled for the whole library,
+	the function must be called only if Platform_GetCpuFeatures reports the instruction set
+*/
+#if defined(__GNUC__) || defined(__clang__)
+#define OG_TARGET(isa) __attribute__((target(isa)))
+#else
+#define OG_TARGET(isa)
+#endif
+
+/*!
+	Instruction sets reported by Platform_GetCpuFeatures
+*/
+enum EPlatformCpuFeatures
+{
+	PLATFORM_CPU_SSE2 = 1 << 0,
+	PLATFORM_CPU_AVX = 1 << 1, /* includes the OS support of the ymm registers */
+	PLATFORM_CPU_AVX2 = 1 << 2,
+	PLATFORM_CPU_FMA = 1 << 3,
+	PLATFORM_CPU_F16C = 1 << 4,
+};
+
 /*!
 	Gets the pointer size of the platform
 	@return the pointer size
@@ -38,3 +74,56 @@ extern void Platform_Swap1(uint8_t* data, size_t len);
 	@param len the length of the data
 */
 extern void Platform_Swap2(uint8_t* data, size_t len);
+
+/*!
+	Gets the instruction sets supported by the cpu
+	@return the supported instruction sets (EPlatformCpuFeatures flags)
+	@note The detection runs once, the next calls return the cached value
+*/
+extern uint32_t Platform_GetCpuFeatures(void);
+
+/*!
+	Hides instruction sets from Platform_GetCpuFeatures, to run and compare the fallback code paths
+	@param disabled The instruction sets to hide (EPlatformCpuFeatures flags), 0 to use all the supported ones
+*/
+extern void Platform_DisableCpuFeatures(uint32_t disabled);
+
+/*!
+	Task run by Platform_RunParallel
+	@param context Context passed to Platform_RunParallel
+	@param index Index of the task
+*/
+typedef void (*TPlatformTaskFunc)(void* context, uint32_t index);
+
+/*!
+	Gets the number of logical cpus
+	@return the number of cpus (at least 1)
+*/
+extern uint32_t Platform_GetCpuCount(void);
+
+/*!
+	Runs tasks on many threads and waits for all of them
+	@param func The task function, called once for each index
+	@param context Context passed to the function
+	@param tasks Number of tasks
+	@param threads Maximum number of threads (the calling thread included), 0 for one per cpu
+	@note The threads are created for each call, when a thread can't be created
+		the remaining threads (and the calling thread) run it's tasks
+*/
+extern void Platform_RunParallel(TPlatformTaskFunc func, void* context, uint32_t tasks, uint32_t threads);
+
+/*!
+	Maps a file in memory, the pages are read from the file when they are accessed and
+	shared with the other mappings of the file until they are written (copy on write)
+	@param path Path of the file
+	@param len Output length of the file
+	@return the mapped file, NULL if the file can't be opened or is empty
+*/
+extern void* Platform_MapFile(const char* path, size_t* len);
+
+/*!
+	Unmaps a file mapped by Platform_MapFile
+	@param data The mapped file
+	@param len Length of the file
+*/
+extern void Platform_UnmapFile(void* data, size_t len);
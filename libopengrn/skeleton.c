@@ -0,0 +1,269 @@
+/*!
+	Project: libopengrn
+	File: skeleton.c
+	Flat skeletons and batched pose evaluation
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "skeleton.h"
+#include "pathindex.h"
+#include "transform.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+	Sorts the bones so the parents come before their children, keeping the file order when it's already sorted
+	@param parents Parent of each bone in file order, invalid parents are roots
+	@param count Number of bones
+	@param order Output file index of each sorted bone
+	@return true if the bones were sorted, false if the parents have a cycle or the allocation failed
+*/
+static bool Skeleton_Sort(const int32_t* parents, uint32_t count, uint32_t* order)
+{
+	uint32_t *firstChild, *nextSibling, *stack, sorted = 0, top = 0;
+	bool inOrder = true;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		order[i] = i;
+
+		if (parents[i] >= (int32_t)i)
+			inOrder = false;
+	}
+
+	if (inOrder)
+		return true;
+
+	firstChild = (uint32_t*)malloc(sizeof(uint32_t) * count * 3);
+
+	if (!firstChild)
+		return false;
+
+	nextSibling = firstChild + count;
+	stack = nextSibling + count;
+
+	memset(firstChild, 0xff, sizeof(uint32_t) * count);
+
+	/* children are linked backwards so the lists keep the file order */
+	for (uint32_t i = count; i-- > 0;)
+	{
+		if (parents[i] >= 0 && (uint32_t)parents[i] < count && parents[i] != (int32_t)i)
+		{
+			nextSibling[i] = firstChild[parents[i]];
+			firstChild[parents[i]] = i;
+		}
+		else
+			nextSibling[i] = UINT32_MAX;
+	}
+
+	for (uint32_t i = count; i-- > 0;)
+	{
+		if (parents[i] < 0 || (uint32_t)parents[i] >= count || parents[i] == (int32_t)i)
+			stack[top++] = i;
+	}
+
+	/* preorder walk, a bone is reached only after it's parent */
+	while (top)
+	{
+		uint32_t bone = stack[--top], children = 0;
+
+		order[sorted++] = bone;
+
+		for (uint32_t c = firstChild[bone]; c != UINT32_MAX; c = nextSibling[c])
+			children++;
+
+		top += children;
+
+		for (uint32_t c = firstChild[bone], i = 1; c != UINT32_MAX; c = nextSibling[c], i++)
+			stack[top - i] = c;
+	}
+
+	free(firstChild);
+
+	if (sorted != count)
+	{
+		dbg_printf("skeleton bones have a parent cycle");
+		return false;
+	}
+
+	return true;
+}
+
+OG_DLLAPI bool Gr2_GetSkeleton(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2Skeleton* skeleton)
+{
+	const TElementGeneric* name = Element_FindChild(gr2, elem, "Name", index);
+	const TElementGeneric* bones = Element_FindChild(gr2, elem, "Bones", index);
+	TLayoutChildren children;
+	TTypeLayout* layout;
+	int32_t nameMember, parentMember, localMember, inverseMember;
+	int32_t* fileParents = NULL;
+	uint32_t *order = NULL, *remap;
+
+	memset(skeleton, 0, sizeof(TGr2Skeleton));
+
+	if (!bones || !bones->member || !gr2->data)
+		return false;
+
+	if (name && name->rawInfo.type == TYPEID_STRING)
+		skeleton->name = ((const TElementString*)name)->value;
+
+	if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, bones->member, bones->data, &children))
+		return false;
+
+	if (!children.layout || !children.count)
+		return true;
+
+	layout = (TTypeLayout*)children.layout;
+	nameMember = Layout_FindMember(layout, "Name", 4);
+	parentMember = Layout_FindMember(layout, "ParentIndex", 11);
+	localMember = Layout_FindMember(layout, "LocalTransform", 14);
+	inverseMember = Layout_FindMember(layout, "InverseWorld4x4", 15);
+
+	if (parentMember < 0 || layout->members[parentMember].info.type != TYPEID_INT32)
+	{
+		dbg_printf("bones without ParentIndex");
+		return false;
+	}
+
+	if (nameMember >= 0 && layout->members[nameMember].info.type != TYPEID_STRING)
+		nameMember = -1;
+
+	if (localMember >= 0 && layout->members[localMember].info.type != TYPEID_TRANSFORM)
+		localMember = -1;
+
+	if (inverseMember >= 0 && (layout->members[inverseMember].info.type != TYPEID_REAL32 || layout->members[inverseMember].count != 16))
+		inverseMember = -1;
+
+	skeleton->boneCount = children.count;
+	skeleton->parents = (int32_t*)malloc(sizeof(int32_t) * children.count);
+	skeleton->names = (const char**)calloc(children.count, sizeof(const char*));
+	skeleton->localTransforms = (TTransformation*)calloc(children.count, sizeof(TTransformation));
+	skeleton->inverseWorld = (float*)malloc(sizeof(float) * 16 * children.count);
+	skeleton->sourceIndices = (uint32_t*)malloc(sizeof(uint32_t) * children.count);
+	fileParents = (int32_t*)malloc(sizeof(int32_t) * children.count);
+	order = (uint32_t*)malloc(sizeof(uint32_t) * children.count * 2);
+
+	if (!skeleton->parents || !skeleton->names || !skeleton->localTransforms || !skeleton->inverseWorld || !skeleton->sourceIndices || !fileParents || !order)
+		goto fail;
+
+	remap = order + children.count;
+
+	for (uint32_t i = 0; i < children.count; i++)
+	{
+		const uint8_t* bone = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &children, i);
+
+		if (!bone)
+		{
+			dbg_printf("empty bone %u", i);
+			goto fail;
+		}
+
+		memcpy(&fileParents[i], bone + layout->members[parentMember].offset, sizeof(int32_t));
+	}
+
+	if (!Skeleton_Sort(fileParents, children.count, order))
+		goto fail;
+
+	for (uint32_t i = 0; i < children.count; i++)
+		remap[order[i]] = i;
+
+	for (uint32_t i = 0; i < children.count; i++)
+	{
+		const uint8_t* bone = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &children, order[i]);
+		int32_t parent = fileParents[order[i]];
+		float* inverse = skeleton->inverseWorld + (size_t)i * 16;
+
+		skeleton->sourceIndices[i] = order[i];
+		skeleton->parents[i] = parent >= 0 && (uint32_t)parent < children.count && (uint32_t)parent != order[i] ? (int32_t)remap[parent] : -1;
+
+		if (nameMember >= 0)
+			skeleton->names[i] = (const char*)LayoutCache_ReadPtr(&gr2->layouts, &gr2->virtual_ptr, bone + layout->members[nameMember].offset);
+
+		if (localMember >= 0)
+			memcpy(&skeleton->localTransforms[i], bone + layout->members[localMember].offset, sizeof(TTransformation));
+
+		if (inverseMember >= 0)
+			memcpy(inverse, bone + layout->members[inverseMember].offset, sizeof(float) * 16);
+		else
+		{
+			memset(inverse, 0, sizeof(float) * 16);
+			inverse[0] = inverse[5] = inverse[10] = inverse[15] = 1.0f;
+		}
+	}
+
+	free(fileParents);
+	free(order);
+	return true;
+
+fail:
+	free(fileParents);
+	free(order);
+	Skeleton_Free(skeleton);
+	return false;
+}
+
+OG_DLLAPI void Skeleton_Free(TGr2Skeleton* skeleton)
+{
+	free(skeleton->parents);
+	free((void*)skeleton->names);
+	free(skeleton->localTransforms);
+	free(skeleton->inverseWorld);
+	free(skeleton->sourceIndices);
+	memset(skeleton, 0, sizeof(TGr2Skeleton));
+}
+
+OG_DLLAPI void Skeleton_BuildRestPose(const TGr2Skeleton* skeleton, float* out)
+{
+	Transform_BuildMatrices4x4(skeleton->localTransforms, 0, skeleton->boneCount, out);
+}
+
+OG_DLLAPI void Skeleton_LocalToWorld(const TGr2Skeleton* skeleton, const float* local, float* world, uint32_t instances, const float* roots)
+{
+	const size_t size = (size_t)skeleton->boneCount * 16;
+	const bool inPlace = world == local;
+	float result[16];
+
+	for (uint32_t n = 0; n < instances; n++, local += size, world += size)
+	{
+		const float* root = roots ? roots + (size_t)n * 16 : NULL;
+
+		/* the parents are sorted first, so their world matrix is always ready */
+		for (uint32_t i = 0; i < skeleton->boneCount; i++)
+		{
+			int32_t parent = skeleton->parents[i];
+			/* the product can't be written over the local matrix it reads */
+			float* out = inPlace ? result : world + (size_t)i * 16;
+
+			if (parent >= 0)
+				Transform_Multiply4x4(world + (size_t)parent * 16, local + (size_t)i * 16, out);
+			else if (root)
+				Transform_Multiply4x4(root, local + (size_t)i * 16, out);
+			else if (!inPlace)
+				memcpy(out, local + (size_t)i * 16, sizeof(result));
+
+			if (inPlace && (parent >= 0 || root))
+				memcpy(world + (size_t)i * 16, result, sizeof(result));
+		}
+	}
+}
+
+OG_DLLAPI void Skeleton_BuildComposites(const TGr2Skeleton* skeleton, const float* world, float* out, uint32_t instances)
+{
+	const bool inPlace = out == world;
+	float result[16];
+
+	for (uint32_t n = 0; n < instances; n++)
+	{
+		for (uint32_t i = 0; i < skeleton->boneCount; i++, world += 16, out += 16)
+		{
+			Transform_Multiply4x4(world, skeleton->inverseWorld + (size_t)i * 16, inPlace ? result : out);
+
+			if (inPlace)
+				memcpy(out, result, sizeof(result));
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*!
+	Project: libopengrn
+	File: skeleton.h
+	Flat skeletons and batched pose evaluation
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	A skeleton stored as flat bone arrays, the bones are sorted so
+	every parent comes before it's children
+*/
+typedef struct SGr2Skeleton
+{
+	const char* name; /* name of the skeleton */
+	uint32_t boneCount; /* number of bones */
+	int32_t* parents; /* parent of each bone (sorted index), -1 for the roots */
+	const char** names; /* name of each bone */
+	TTransformation* localTransforms; /* rest transformation of each bone relative to it's parent */
+	float* inverseWorld; /* inverse of the rest world matrix of each bone (16 floats each, see Transform_ToMatrix4x4) */
+	uint32_t* sourceIndices; /* index of each bone inside the file, to remap the bone indices of the file */
+} TGr2Skeleton;
+
+/*!
+	Extracts a skeleton into flat bone arrays
+	@param gr2 The Gr2 structure that contains the skeleton
+	@param elem Element that contains the skeleton (e.g. "Skeletons" or "Models[0].Skeleton")
+	@param index Index of the skeleton inside the element (0 for references)
+	@param skeleton Output skeleton, must be freed with Skeleton_Free
+	@return true if the skeleton was extracted, otherwise false (also when the parents have a cycle)
+	@note The bones are read from the file data, with GR2_LOAD_LAZY they don't need to be expanded
+*/
+extern OG_DLLAPI bool Gr2_GetSkeleton(TGr2* gr2, TElementGeneric* elem, uint32_t index, TGr2Skeleton* skeleton);
+
+/*!
+	Frees the arrays of a skeleton
+	@param skeleton The skeleton to free
+*/
+extern OG_DLLAPI void Skeleton_Free(TGr2Skeleton* skeleton);
+
+/*!
+	Builds the local matrices of the rest pose
+	@param skeleton The skeleton
+	@param out Output matrices (16 floats for each bone)
+*/
+extern OG_DLLAPI void Skeleton_BuildRestPose(const TGr2Skeleton* skeleton, float* out);
+
+/*!
+	Transforms the local matrices of many instances of a skeleton into world matrices
+	@param skeleton The skeleton
+	@param local Local matrices of the instances (16 floats for each bone, bones of an instance are contiguous)
+	@param world Output world matrices, can be the same buffer as local
+	@param instances Number of instances
+	@param roots Matrix applied to the roots of each instance (16 floats each) or NULL
+	@note No memory is allocated, the instances can be split between threads
+*/
+extern OG_DLLAPI void Skeleton_LocalToWorld(const TGr2Skeleton* skeleton, const float* local, float* world, uint32_t instances, const float* roots);
+
+/*!
+	Builds the skinning matrices (world * inverse world) of many instances of a skeleton
+	@param skeleton The skeleton
+	@param world World matrices of the instances (see Skeleton_LocalToWorld)
+	@param out Output matrices, can be the same buffer as world
+	@param instances Number of instances
+*/
+extern OG_DLLAPI void Skeleton_BuildComposites(const TGr2Skeleton* skeleton, const float* world, float* out, uint32_t instances);
+
+#ifdef __cplusplus
+}
+#endif
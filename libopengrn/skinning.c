@@ -0,0 +1,297 @@
+/*!
+	Project: libopengrn
+	File: skinning.c
+	Linear blend skinning of the mesh vertices
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "skinning.h"
+#include "pathindex.h"
+#include "platform.h"
+#include "debug.h"
+
+#include <string.h>
+
+#ifdef OG_X86
+#include <immintrin.h>
+#endif
+
+/*!
+	Number of vertices deformed by each task of Skin_DeformParallel
+*/
+#define SKIN_TASK_VERTICES 4096
+
+/*!
+	Arguments of the tasks of Skin_DeformParallel
+*/
+typedef struct SSkinTask
+{
+	const TGr2SkinMesh* mesh; /* the mesh */
+	const float* matrices; /* skinning matrices */
+	float* positions; /* output positions */
+	float* normals; /* output normals */
+} TSkinTask;
+
+/*!
+	Resolves the bone bindings of a mesh
+	@param gr2 The Gr2 structure
+	@param elem Element that contains the mesh
+	@param index Index of the mesh
+	@param children Output bone bindings
+	@return true if the bindings were resolved, otherwise false
+*/
+static bool Skin_GetBindings(TGr2* gr2, TElementGeneric* elem, uint32_t index, TLayoutChildren* children)
+{
+	const TElementGeneric* bindings = Element_FindChild(gr2, elem, "BoneBindings", index);
+
+	children->count = 0;
+
+	if (!bindings || !bindings->member || !gr2->data)
+		return false;
+
+	return LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, bindings->member, bindings->data, children);
+}
+
+/*!
+	Gets the matrix of an influence
+	@param mesh The mesh
+	@param matrices Skinning matrices
+	@param index Bone index of the influence (as float)
+	@return the matrix, NULL if the index is out of range
+*/
+static const float* Skin_GetMatrix(const TGr2SkinMesh* mesh, const float* matrices, float index)
+{
+	uint32_t bone;
+
+	if (!(index >= 0.0f) || index >= (float)mesh->boneCount)
+		return NULL;
+
+	bone = (uint32_t)index;
+	return matrices + (size_t)(mesh->boneMap ? mesh->boneMap[bone] : bone) * 16;
+}
+
+/*!
+	Deforms a range of vertices with scalar code
+	@param mesh The mesh
+	@param matrices Skinning matrices
+	@param first First vertex
+	@param count Number of vertices
+	@param positions Output positions
+	@param normals Output normals, or NULL
+*/
+static void Skin_DeformScalar(const TGr2SkinMesh* mesh, const float* matrices, uint32_t first, uint32_t count, float* positions, float* normals)
+{
+	for (size_t v = first; v < (size_t)first + count; v++)
+	{
+		const float* weights = mesh->weights + v * mesh->influences;
+		const float* indices = mesh->indices + v * mesh->influences;
+		const float* p = mesh->positions + v * 3;
+		float m[16] = { 0 }, x[3];
+		bool weighted = false;
+
+		/* blend the matrices of the bones */
+		for (uint32_t i = 0; i < mesh->influences; i++)
+		{
+			const float* bone = weights[i] != 0.0f ? Skin_GetMatrix(mesh, matrices, indices[i]) : NULL;
+
+			if (!bone)
+				continue;
+
+			for (uint32_t c = 0; c < 16; c++)
+				m[c] += bone[c] * weights[i];
+
+			weighted = true;
+		}
+
+		if (!weighted)
+		{
+			memmove(positions + v * 3, p, sizeof(float) * 3);
+
+			if (normals && mesh->normals)
+				memmove(normals + v * 3, mesh->normals + v * 3, sizeof(float) * 3);
+			continue;
+		}
+
+		for (uint32_t r = 0; r < 3; r++)
+			x[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+
+		memcpy(positions + v * 3, x, sizeof(x));
+
+		if (normals && mesh->normals)
+		{
+			const float* n = mesh->normals + v * 3;
+
+			for (uint32_t r = 0; r < 3; r++)
+				x[r] = m[r] * n[0] + m[4 + r] * n[1] + m[8 + r] * n[2];
+
+			memcpy(normals + v * 3, x, sizeof(x));
+		}
+	}
+}
+
+#ifdef OG_X86
+/*!
+	Deforms a range of vertices with AVX2 and FMA (see Skin_DeformScalar)
+
+	The two halves of a 4x4 matrix fit in two ymm registers, so the blend is two
+	fused multiply-adds per bone and the transform is one per half
+*/
+OG_TARGET("avx2,fma") static void Skin_DeformAvx2(const TGr2SkinMesh* mesh, const float* matrices, uint32_t first, uint32_t count, float* positions, float* normals)
+{
+	for (size_t v = first; v < (size_t)first + count; v++)
+	{
+		const float* weights = mesh->weights + v * mesh->influences;
+		const float* indices = mesh->indices + v * mesh->influences;
+		const float* p = mesh->positions + v * 3;
+		__m256 axes = _mm256_setzero_ps(), last = _mm256_setzero_ps(), xy, z;
+		__m128 r;
+		float x[4];
+		bool weighted = false;
+
+		for (uint32_t i = 0; i < mesh->influences; i++)
+		{
+			const float* bone = weights[i] != 0.0f ? Skin_GetMatrix(mesh, matrices, indices[i]) : NULL;
+			__m256 w;
+
+			if (!bone)
+				continue;
+
+			w = _mm256_set1_ps(weights[i]);
+			axes = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone), axes);
+			last = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone + 8), last);
+			weighted = true;
+		}
+
+		if (!weighted)
+		{
+			memmove(positions + v * 3, p, sizeof(float) * 3);
+
+			if (normals && mesh->normals)
+				memmove(normals + v * 3, mesh->normals + v * 3, sizeof(float) * 3);
+			continue;
+		}
+
+		/* x * axis0 + y * axis1 in the halves of xy, z * axis2 + translation in the halves of z */
+		xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p[0])), _mm_set1_ps(p[1]), 1);
+		z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p[2])), _mm_set1_ps(1.0f), 1);
+		xy = _mm256_fmadd_ps(axes, xy, _mm256_mul_ps(last, z));
+		r = _mm_add_ps(_mm256_castps256_ps128(xy), _mm256_extractf128_ps(xy, 1));
+
+		_mm_storeu_ps(x, r);
+		memcpy(positions + v * 3, x, sizeof(float) * 3);
+
+		if (normals && mesh->normals)
+		{
+			const float* n = mesh->normals + v * 3;
+
+			xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(n[0])), _mm_set1_ps(n[1]), 1);
+			z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(n[2])), _mm_setzero_ps(), 1);
+			xy = _mm256_fmadd_ps(axes, xy, _mm256_mul_ps(last, z));
+			r = _mm_add_ps(_mm256_castps256_ps128(xy), _mm256_extractf128_ps(xy, 1));
+
+			_mm_storeu_ps(x, r);
+			memcpy(normals + v * 3, x, sizeof(float) * 3);
+		}
+	}
+}
+#endif
+
+OG_DLLAPI uint32_t Gr2_GetBoneBindingCount(TGr2* gr2, TElementGeneric* elem, uint32_t index)
+{
+	TLayoutChildren children;
+
+	if (!Skin_GetBindings(gr2, elem, index, &children))
+		return 0;
+
+	return children.count;
+}
+
+OG_DLLAPI bool Gr2_GetBoneBindingMap(TGr2* gr2, TElementGeneric* elem, uint32_t index, const TGr2Skeleton* skeleton, uint32_t* map)
+{
+	TLayoutChildren children;
+	int32_t nameMember;
+
+	if (!Skin_GetBindings(gr2, elem, index, &children))
+		return false;
+
+	if (!children.count)
+		return true;
+
+	nameMember = Layout_FindMember((TTypeLayout*)children.layout, "BoneName", 8);
+
+	if (nameMember < 0 || children.layout->members[nameMember].info.type != TYPEID_STRING)
+	{
+		dbg_printf("bone bindings without BoneName");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < children.count; i++)
+	{
+		const uint8_t* binding = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &children, i);
+		const char* name = binding ? (const char*)LayoutCache_ReadPtr(&gr2->layouts, &gr2->virtual_ptr, binding + children.layout->members[nameMember].offset) : NULL;
+		uint32_t bone = 0;
+
+		while (name && bone < skeleton->boneCount && (!skeleton->names[bone] || strcmp(skeleton->names[bone], name)))
+			bone++;
+
+		if (!name || bone == skeleton->boneCount)
+		{
+			dbg_printf("bone binding %u (%s) is not in the skeleton", i, name ? name : "(null)");
+			return false;
+		}
+
+		map[i] = bone;
+	}
+
+	return true;
+}
+
+OG_DLLAPI void Skin_Deform(const TGr2SkinMesh* mesh, const float* matrices, uint32_t first, uint32_t count, float* positions, float* normals)
+{
+	if (first >= mesh->vertexCount)
+		return;
+
+	if (count > mesh->vertexCount - first)
+		count = mesh->vertexCount - first;
+
+#ifdef OG_X86
+	if ((Platform_GetCpuFeatures() & (PLATFORM_CPU_AVX2 | PLATFORM_CPU_FMA)) == (PLATFORM_CPU_AVX2 | PLATFORM_CPU_FMA))
+	{
+		Skin_DeformAvx2(mesh, matrices, first, count, positions, normals);
+		return;
+	}
+#endif
+
+	Skin_DeformScalar(mesh, matrices, first, count, positions, normals);
+}
+
+/*!
+	Deforms the vertices of a task
+	@param context The TSkinTask
+	@param index Index of the task
+*/
+static void Skin_RunTask(void* context, uint32_t index)
+{
+	const TSkinTask* task = (const TSkinTask*)context;
+
+	Skin_Deform(task->mesh, task->matrices, index * SKIN_TASK_VERTICES, SKIN_TASK_VERTICES, task->positions, task->normals);
+}
+
+OG_DLLAPI void Skin_DeformParallel(const TGr2SkinMesh* mesh, const float* matrices, float* positions, float* normals, uint32_t threads)
+{
+	TSkinTask task = { mesh, matrices, positions, normals };
+	uint32_t tasks = (mesh->vertexCount + SKIN_TASK_VERTICES - 1) / SKIN_TASK_VERTICES;
+
+	/* detect the cpu features before the threads start */
+	Platform_GetCpuFeatures();
+
+	if (tasks <= 1 || threads == 1)
+	{
+		Skin_Deform(mesh, matrices, 0, mesh->vertexCount, positions, normals);
+		return;
+	}
+
+	Platform_RunParallel(Skin_RunTask, &task, tasks, threads);
+}
@@ -0,0 +1,81 @@
+/*!
+	Project: libopengrn
+	File: skinning.h
+	Linear blend skinning of the mesh vertices
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+#include "skeleton.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Vertex streams of a skinned mesh, as extracted by Gr2_ExtractVertices with packed streams
+*/
+typedef struct SGr2SkinMesh
+{
+	uint32_t vertexCount; /* number of vertices */
+	uint32_t influences; /* number of weights and bone indices of each vertex (e.g. 4) */
+	uint32_t boneCount; /* number of bone bindings, the influences with a bigger index are ignored */
+	const float* positions; /* 3 floats for each vertex ("Position") */
+	const float* normals; /* 3 floats for each vertex ("Normal"), or NULL */
+	const float* weights; /* influences floats for each vertex ("BoneWeights") */
+	const float* indices; /* influences floats for each vertex ("BoneIndices"), index of the bone binding of the mesh */
+	const uint32_t* boneMap; /* matrix of each bone binding (see Gr2_GetBoneBindingMap), or NULL if the indices are the matrices */
+} TGr2SkinMesh;
+
+/*!
+	Gets the number of bone bindings of a mesh
+	@param gr2 The Gr2 structure that contains the mesh
+	@param elem Element that contains the mesh (e.g. "Meshes")
+	@param index Index of the mesh inside the element (0 for references)
+	@return the number of bone bindings
+*/
+extern OG_DLLAPI uint32_t Gr2_GetBoneBindingCount(TGr2* gr2, TElementGeneric* elem, uint32_t index);
+
+/*!
+	Maps the bone bindings of a mesh to the bones of a skeleton by name
+	@param gr2 The Gr2 structure that contains the mesh
+	@param elem Element that contains the mesh (e.g. "Meshes")
+	@param index Index of the mesh inside the element (0 for references)
+	@param skeleton The skeleton the mesh is bound to
+	@param map Output bone of each binding (see Gr2_GetBoneBindingCount), index of the sorted bones of the skeleton
+	@return true if every binding was mapped, false if a bone does not exist in the skeleton
+*/
+extern OG_DLLAPI bool Gr2_GetBoneBindingMap(TGr2* gr2, TElementGeneric* elem, uint32_t index, const TGr2Skeleton* skeleton, uint32_t* map);
+
+/*!
+	Deforms a range of vertices of a mesh
+
+	Every vertex is transformed by the sum of the matrices of it's bones scaled by the weights,
+	with AVX2 and FMA when the cpu supports them and a scalar loop otherwise. Vertices without
+	any weight are copied as they are
+	@param mesh The mesh
+	@param matrices Skinning matrices (16 floats each, see Skeleton_BuildComposites)
+	@param first First vertex of the range
+	@param count Number of vertices of the range
+	@param positions Output positions (3 floats for each vertex of the mesh, the range is written at the same indices)
+	@param normals Output normals (3 floats for each vertex), or NULL; not normalized
+*/
+extern OG_DLLAPI void Skin_Deform(const TGr2SkinMesh* mesh, const float* matrices, uint32_t first, uint32_t count, float* positions, float* normals);
+
+/*!
+	Deforms all the vertices of a mesh splitting the vertex ranges between threads (see Skin_Deform)
+	@param mesh The mesh
+	@param matrices Skinning matrices (16 floats each)
+	@param positions Output positions (3 floats for each vertex)
+	@param normals Output normals (3 floats for each vertex), or NULL
+	@param threads Maximum number of threads, 0 for one per cpu
+*/
+extern OG_DLLAPI void Skin_DeformParallel(const TGr2SkinMesh* mesh, const float* matrices, float* positions, float* normals, uint32_t threads);
+
+#ifdef __cplusplus
+}
+#endif
@@ -158,7 +158,7 @@ typedef struct SNodeTypeInfo
 */
 typedef struct STransformation
 {
-	uint32_t flags; // TODO: discover what flags
+	uint32_t flags; /// Used parts of the transformation (see ETransformFlags)
 	float translation[3]; /// X,Y,Z traslation
 	float rotation[4]; /// X,Y,Z,W rotation
 	float scaleShear[3][3]; /// Scale matrix
@@ -0,0 +1,298 @@
+/*!
+	Project: libopengrn
+	File: transform.c
+	Composition of the transformations into matrices
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "transform.h"
+#include "platform.h"
+
+#ifdef OG_SSE2
+#include <emmintrin.h>
+#endif
+
+/*!
+	Composes a transformation into a 3x3 matrix and a translation
+	@param src Pointer to the transformation, doesn't need to be aligned
+	@param m Output rotation * scale/shear
+	@param t Output translation
+*/
+static void Transform_Compose(const uint8_t* src, float m[3][3], float t[3])
+{
+	TTransformation tr;
+	float r[3][3];
+
+	memcpy(&tr, src, sizeof(tr));
+
+	for (int i = 0; i < 3; i++)
+		t[i] = tr.flags & TRANSFORM_HAS_POSITION ? tr.translation[i] : 0.0f;
+
+	if (tr.flags & TRANSFORM_HAS_ORIENTATION)
+	{
+		float x = tr.rotation[0], y = tr.rotation[1], z = tr.rotation[2], w = tr.rotation[3];
+
+		r[0][0] = 1.0f - 2.0f * (y * y + z * z);
+		r[0][1] = 2.0f * (x * y - z * w);
+		r[0][2] = 2.0f * (x * z + y * w);
+		r[1][0] = 2.0f * (x * y + z * w);
+		r[1][1] = 1.0f - 2.0f * (x * x + z * z);
+		r[1][2] = 2.0f * (y * z - x * w);
+		r[2][0] = 2.0f * (x * z - y * w);
+		r[2][1] = 2.0f * (y * z + x * w);
+		r[2][2] = 1.0f - 2.0f * (x * x + y * y);
+	}
+	else
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				r[i][j] = i == j ? 1.0f : 0.0f;
+	}
+
+	if (!(tr.flags & TRANSFORM_HAS_SCALESHEAR))
+	{
+		memcpy(m, r, sizeof(r));
+		return;
+	}
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			m[i][j] = r[i][0] * tr.scaleShear[0][j] + r[i][1] * tr.scaleShear[1][j] + r[i][2] * tr.scaleShear[2][j];
+}
+
+static void Transform_Store4x4(const float m[3][3], const float t[3], float* out)
+{
+	for (int c = 0; c < 3; c++)
+	{
+		out[c * 4 + 0] = m[0][c];
+		out[c * 4 + 1] = m[1][c];
+		out[c * 4 + 2] = m[2][c];
+		out[c * 4 + 3] = 0.0f;
+	}
+
+	out[12] = t[0];
+	out[13] = t[1];
+	out[14] = t[2];
+	out[15] = 1.0f;
+}
+
+static void Transform_Store3x4(const float m[3][3], const float t[3], float* out)
+{
+	for (int r = 0; r < 3; r++)
+	{
+		out[r * 4 + 0] = m[r][0];
+		out[r * 4 + 1] = m[r][1];
+		out[r * 4 + 2] = m[r][2];
+		out[r * 4 + 3] = t[r];
+	}
+}
+
+#ifdef OG_SSE2
+/*!
+	Selects the lanes of a where mask is set, the other lanes from b
+*/
+static inline __m128 Transform_Select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/*!
+	Composes four transformations in SoA form, same as Transform_Compose
+	@param src Pointers to the transformations, don't need to be aligned
+	@param m Output rotation * scale/shear, one transformation per lane
+	@param t Output translation, one transformation per lane
+*/
+static void Transform_Compose4(const uint8_t* src[4], __m128 m[3][3], __m128 t[3])
+{
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+	__m128 a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3, d0, d1, d2, d3;
+	__m128 hasPosition, hasOrientation, hasScaleShear, r[3][3], s[3][3];
+	__m128 qx, qy, qz, qw;
+	__m128i flags;
+	uint32_t f[4];
+
+	for (int i = 0; i < 4; i++)
+		memcpy(&f[i], src[i], sizeof(uint32_t));
+
+	flags = _mm_setr_epi32((int)f[0], (int)f[1], (int)f[2], (int)f[3]);
+	hasPosition = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, _mm_set1_epi32(TRANSFORM_HAS_POSITION)), _mm_set1_epi32(TRANSFORM_HAS_POSITION)));
+	hasOrientation = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, _mm_set1_epi32(TRANSFORM_HAS_ORIENTATION)), _mm_set1_epi32(TRANSFORM_HAS_ORIENTATION)));
+	hasScaleShear = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, _mm_set1_epi32(TRANSFORM_HAS_SCALESHEAR)), _mm_set1_epi32(TRANSFORM_HAS_SCALESHEAR)));
+
+	/* the 16 floats after the flags are loaded as 4 vectors and transposed into the 16 fields */
+	a0 = _mm_loadu_ps((const float*)(src[0] + 4)); a1 = _mm_loadu_ps((const float*)(src[1] + 4));
+	a2 = _mm_loadu_ps((const float*)(src[2] + 4)); a3 = _mm_loadu_ps((const float*)(src[3] + 4));
+	b0 = _mm_loadu_ps((const float*)(src[0] + 20)); b1 = _mm_loadu_ps((const float*)(src[1] + 20));
+	b2 = _mm_loadu_ps((const float*)(src[2] + 20)); b3 = _mm_loadu_ps((const float*)(src[3] + 20));
+	c0 = _mm_loadu_ps((const float*)(src[0] + 36)); c1 = _mm_loadu_ps((const float*)(src[1] + 36));
+	c2 = _mm_loadu_ps((const float*)(src[2] + 36)); c3 = _mm_loadu_ps((const float*)(src[3] + 36));
+	d0 = _mm_loadu_ps((const float*)(src[0] + 52)); d1 = _mm_loadu_ps((const float*)(src[1] + 52));
+	d2 = _mm_loadu_ps((const float*)(src[2] + 52)); d3 = _mm_loadu_ps((const float*)(src[3] + 52));
+	_MM_TRANSPOSE4_PS(a0, a1, a2, a3); /* tx ty tz qx */
+	_MM_TRANSPOSE4_PS(b0, b1, b2, b3); /* qy qz qw s00 */
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3); /* s01 s02 s10 s11 */
+	_MM_TRANSPOSE4_PS(d0, d1, d2, d3); /* s12 s20 s21 s22 */
+
+	t[0] = _mm_and_ps(hasPosition, a0);
+	t[1] = _mm_and_ps(hasPosition, a1);
+	t[2] = _mm_and_ps(hasPosition, a2);
+
+	qx = _mm_and_ps(hasOrientation, a3);
+	qy = _mm_and_ps(hasOrientation, b0);
+	qz = _mm_and_ps(hasOrientation, b1);
+	qw = Transform_Select(hasOrientation, b2, one);
+
+	r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qy, qy), _mm_mul_ps(qz, qz))));
+	r[0][1] = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, qy), _mm_mul_ps(qz, qw)));
+	r[0][2] = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qx, qz), _mm_mul_ps(qy, qw)));
+	r[1][0] = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qx, qy), _mm_mul_ps(qz, qw)));
+	r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qz, qz))));
+	r[1][2] = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, qz), _mm_mul_ps(qx, qw)));
+	r[2][0] = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, qz), _mm_mul_ps(qy, qw)));
+	r[2][1] = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qy, qz), _mm_mul_ps(qx, qw)));
+	r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy))));
+
+	if (!_mm_movemask_ps(hasScaleShear))
+	{
+		/* no scale/shear in the group (the usual bone), the matrix is the rotation */
+		memcpy(m, r, sizeof(r));
+		return;
+	}
+
+	s[0][0] = Transform_Select(hasScaleShear, b3, one);
+	s[0][1] = _mm_and_ps(hasScaleShear, c0);
+	s[0][2] = _mm_and_ps(hasScaleShear, c1);
+	s[1][0] = _mm_and_ps(hasScaleShear, c2);
+	s[1][1] = Transform_Select(hasScaleShear, c3, one);
+	s[1][2] = _mm_and_ps(hasScaleShear, d0);
+	s[2][0] = _mm_and_ps(hasScaleShear, d1);
+	s[2][1] = _mm_and_ps(hasScaleShear, d2);
+	s[2][2] = Transform_Select(hasScaleShear, d3, one);
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			m[i][j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[i][0], s[0][j]), _mm_mul_ps(r[i][1], s[1][j])), _mm_mul_ps(r[i][2], s[2][j]));
+}
+#endif
+
+OG_DLLAPI void Transform_ToMatrix4x4(const TTransformation* transform, float out[16])
+{
+	float m[3][3], t[3];
+
+	Transform_Compose((const uint8_t*)transform, m, t);
+	Transform_Store4x4(m, t, out);
+}
+
+OG_DLLAPI void Transform_ToMatrix3x4(const TTransformation* transform, float out[12])
+{
+	float m[3][3], t[3];
+
+	Transform_Compose((const uint8_t*)transform, m, t);
+	Transform_Store3x4(m, t, out);
+}
+
+OG_DLLAPI void Transform_BuildMatrices4x4(const TTransformation* transforms, size_t stride, size_t count, float* out)
+{
+	const uint8_t* src = (const uint8_t*)transforms;
+	size_t i = 0;
+	float m[3][3], t[3];
+
+	if (!stride)
+		stride = sizeof(TTransformation);
+
+#ifdef OG_SSE2
+	for (; i + 4 <= count; i += 4, src += stride * 4, out += 64)
+	{
+		const uint8_t* group[4] = { src, src + stride, src + stride * 2, src + stride * 3 };
+		__m128 mv[3][3], tv[3], c0, c1, c2, c3;
+
+		Transform_Compose4(group, mv, tv);
+
+		/* each column is transposed from the lanes into the four matrices */
+		for (int c = 0; c < 3; c++)
+		{
+			c0 = mv[0][c]; c1 = mv[1][c]; c2 = mv[2][c]; c3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_mm_storeu_ps(out + c * 4, c0);
+			_mm_storeu_ps(out + 16 + c * 4, c1);
+			_mm_storeu_ps(out + 32 + c * 4, c2);
+			_mm_storeu_ps(out + 48 + c * 4, c3);
+		}
+
+		c0 = tv[0]; c1 = tv[1]; c2 = tv[2]; c3 = _mm_set1_ps(1.0f);
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		_mm_storeu_ps(out + 12, c0);
+		_mm_storeu_ps(out + 28, c1);
+		_mm_storeu_ps(out + 44, c2);
+		_mm_storeu_ps(out + 60, c3);
+	}
+#endif
+
+	for (; i < count; i++, src += stride, out += 16)
+	{
+		Transform_Compose(src, m, t);
+		Transform_Store4x4(m, t, out);
+	}
+}
+
+OG_DLLAPI void Transform_BuildMatrices3x4(const TTransformation* transforms, size_t stride, size_t count, float* out)
+{
+	const uint8_t* src = (const uint8_t*)transforms;
+	size_t i = 0;
+	float m[3][3], t[3];
+
+	if (!stride)
+		stride = sizeof(TTransformation);
+
+#ifdef OG_SSE2
+	for (; i + 4 <= count; i += 4, src += stride * 4, out += 48)
+	{
+		const uint8_t* group[4] = { src, src + stride, src + stride * 2, src + stride * 3 };
+		__m128 mv[3][3], tv[3], r0, r1, r2, r3;
+
+		Transform_Compose4(group, mv, tv);
+
+		for (int r = 0; r < 3; r++)
+		{
+			r0 = mv[r][0]; r1 = mv[r][1]; r2 = mv[r][2]; r3 = tv[r];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + r * 4, r0);
+			_mm_storeu_ps(out + 12 + r * 4, r1);
+			_mm_storeu_ps(out + 24 + r * 4, r2);
+			_mm_storeu_ps(out + 36 + r * 4, r3);
+		}
+	}
+#endif
+
+	for (; i < count; i++, src += stride, out += 12)
+	{
+		Transform_Compose(src, m, t);
+		Transform_Store3x4(m, t, out);
+	}
+}
+
+OG_DLLAPI void Transform_Multiply4x4(const float* a, const float* b, float* out)
+{
+#ifdef OG_SSE2
+	const __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+
+	/* each column of the result is the left matrix applied to a column of the right one */
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 v = _mm_mul_ps(a0, _mm_set1_ps(b[c * 4 + 0]));
+
+		v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_set1_ps(b[c * 4 + 1])));
+		v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_set1_ps(b[c * 4 + 2])));
+		v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_set1_ps(b[c * 4 + 3])));
+		_mm_storeu_ps(out + c * 4, v);
+	}
+#else
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+			out[c * 4 + r] = a[r] * b[c * 4 + 0] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+	}
+#endif
+}
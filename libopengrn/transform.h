@@ -0,0 +1,77 @@
+/*!
+	Project: libopengrn
+	File: transform.h
+	Composition of the transformations into matrices
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "structures.h"
+#include "dllapi.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Parts of a TTransformation that are used, the parts without a flag are identity
+*/
+enum ETransformFlags
+{
+	TRANSFORM_HAS_POSITION = 1 << 0,
+	TRANSFORM_HAS_ORIENTATION = 1 << 1,
+	TRANSFORM_HAS_SCALESHEAR = 1 << 2,
+};
+
+/*!
+	Composes a transformation into a 4x4 matrix (translation * rotation * scale/shear)
+	@param transform The transformation
+	@param out Output matrix, stored like the InverseWorld4x4 of the bones (axes in 0-2, 4-6, 8-10 and translation in 12-14)
+*/
+extern OG_DLLAPI void Transform_ToMatrix4x4(const TTransformation* transform, float out[16]);
+
+/*!
+	Composes a transformation into a 3x4 matrix (translation * rotation * scale/shear)
+	@param transform The transformation
+	@param out Output matrix, three rows of four floats with the translation in 3, 7 and 11
+*/
+extern OG_DLLAPI void Transform_ToMatrix3x4(const TTransformation* transform, float out[12]);
+
+/*!
+	Composes many transformations into 4x4 matrices (see Transform_ToMatrix4x4)
+
+	The transformations are composed four at a time with SSE2 in SoA form,
+	groups without scale/shear skip the scale/shear product
+	@param transforms First transformation, doesn't need to be aligned
+	@param stride Distance in bytes between two transformations, 0 for packed transformations
+		(e.g. the size of the bone to compose the LocalTransform of a bone array)
+	@param count Number of transformations
+	@param out Output matrices (16 floats each)
+*/
+extern OG_DLLAPI void Transform_BuildMatrices4x4(const TTransformation* transforms, size_t stride, size_t count, float* out);
+
+/*!
+	Composes many transformations into 3x4 matrices (see Transform_ToMatrix3x4 and Transform_BuildMatrices4x4)
+	@param transforms First transformation, doesn't need to be aligned
+	@param stride Distance in bytes between two transformations, 0 for packed transformations
+	@param count Number of transformations
+	@param out Output matrices (12 floats each)
+*/
+extern OG_DLLAPI void Transform_BuildMatrices3x4(const TTransformation* transforms, size_t stride, size_t count, float* out);
+
+/*!
+	Multiplies two 4x4 matrices stored like Transform_ToMatrix4x4 (a * b, b is applied first)
+	@param a Left matrix
+	@param b Right matrix
+	@param out Output matrix, can't be a or b
+*/
+extern OG_DLLAPI void Transform_Multiply4x4(const float* a, const float* b, float* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -39,50 +39,44 @@ OG_DLLAPI TTypeInfo ELEMENT_TYPE_INFO[23] =
 	{ 4, 8, 0, }, // void*
 };
 
-bool TypeInfo_Parse(const uint8_t* data, TNodeTypeInfo* info, bool is64, uint64_t* offset)
-{
-	TNodeTypeInfo ni;
-
-	ni.type = *(uint32_t*)(data + *offset);
-
-	if (ni.type == 0 || ni.type > TYPEID_MAX)
-		return false;
-
-	*offset += 4;
-
-	if (is64)
-	{
-		ni.nameOffset = *(uint64_t*)(data + *offset);
-		*offset += 8;
-		ni.childrenOffset = *(uint64_t*)(data + *offset);
-		*offset += 8;
-	}
-	else
-	{
-		ni.nameOffset = *(uint32_t*)(data + *offset);
-		*offset += 4;
-		ni.childrenOffset = *(uint32_t*)(data + *offset);
-		*offset += 4;
+/*!
+	Defines a type node parser for the specified pointer size
+	@param bits Pointer size in bits
+	@param ptr Unsigned type of a pointer
+*/
+#define TYPEINFO_DEFINE_PARSE(bits, ptr) \
+	bool TypeInfo_Parse##bits(const uint8_t* data, TNodeTypeInfo* info, uint64_t* offset) \
+	{ \
+		TNodeTypeInfo ni; \
+		\
+		ni.type = *(uint32_t*)(data + *offset); \
+		\
+		if (ni.type == 0 || ni.type >= TYPEID_MAX) \
+			return false; \
+		\
+		*offset += 4; \
+		ni.nameOffset = *(ptr*)(data + *offset); \
+		*offset += sizeof(ptr); \
+		ni.childrenOffset = *(ptr*)(data + *offset); \
+		*offset += sizeof(ptr); \
+		ni.arraySize = *(int32_t*)(data + *offset); \
+		*offset += 4; \
+		memcpy(ni.extra, data + *offset, sizeof(ni.extra)); \
+		*offset += sizeof(ni.extra); \
+		ni.extra4 = *(ptr*)(data + *offset); \
+		*offset += sizeof(ptr); \
+		\
+		*info = ni; \
+		return true; \
 	}
 
-	ni.arraySize = *(int32_t*)(data + *offset);
-
-	*offset += 4;
-
-	memcpy(ni.extra, data + *offset, 12);
-	*offset += sizeof(ni.extra);
+TYPEINFO_DEFINE_PARSE(32, uint32_t)
+TYPEINFO_DEFINE_PARSE(64, uint64_t)
 
+bool TypeInfo_Parse(const uint8_t* data, TNodeTypeInfo* info, bool is64, uint64_t* offset)
+{
 	if (is64)
-	{
-		ni.extra4 = *(uint64_t*)(data + *offset);
-		*offset += 8;
-	}
-	else
-	{
-		ni.extra4 = *(uint32_t*)(data + *offset);
-		*offset += 4;
-	}
+		return TypeInfo_Parse64(data, info, offset);
 
-	*info = ni;
-	return true;
+	return TypeInfo_Parse32(data, info, offset);
 }
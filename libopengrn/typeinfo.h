@@ -64,3 +64,20 @@ extern OG_DLLAPI TTypeInfo ELEMENT_TYPE_INFO[23];
 	@return true if the parsing succeeded, otherwise false
 */
 bool TypeInfo_Parse(const uint8_t* data, TNodeTypeInfo* info, bool is64, uint64_t* offset);
+
+/*!
+	Pointer size specialized version of TypeInfo_Parse
+*/
+typedef bool (*TTypeInfoParseFunc)(const uint8_t* data, TNodeTypeInfo* info, uint64_t* offset);
+
+/*!
+	Parses the node information of a 32-bit file
+	@see TypeInfo_Parse
+*/
+bool TypeInfo_Parse32(const uint8_t* data, TNodeTypeInfo* info, uint64_t* offset);
+
+/*!
+	Parses the node information of a 64-bit file
+	@see TypeInfo_Parse
+*/
+bool TypeInfo_Parse64(const uint8_t* data, TNodeTypeInfo* info, uint64_t* offset);
@@ -8,23 +8,57 @@
     file, You can obtain one at https://mozilla.org/MPL/2.0/.
 */
 #include "virtual_ptr.h"
-#include "darray.h"
+#include "debug.h"
 
-uint32_t encode_ptr(TDArray* array, const void *ptr)
+bool encode_ptr(TVirtualPtrTable* table, const void *ptr, uint32_t* out)
 {
-    uint32_t virtual_ptr = array->count + 1;
-    DArray_Add(array, (void*) &ptr);
+    *out = 0;
 
-    return virtual_ptr;
+    if (table->relative)
+    {
+        if (!ptr)
+            return true;
+
+        if ((const uint8_t*)ptr < table->base || (size_t)((const uint8_t*)ptr - table->base) > table->size)
+        {
+            dbg_printf("pointer is outside of the relative data");
+            return false;
+        }
+
+        *out = (uint32_t)((const uint8_t*)ptr - table->base) + 1;
+        return true;
+    }
+
+    if (table->pointers.count >= UINT32_MAX || !DArray_Add(&table->pointers, (void*) &ptr))
+        return false;
+
+    *out = (uint32_t)table->pointers.count;
+    return true;
 }
 
-void* decode_ptr(TDArray* array, uint32_t ptr)
+void* decode_ptr(TVirtualPtrTable* table, uint32_t ptr)
 {
     if(ptr == 0)
         return 0;
 
-    if(ptr > array->count)
+    if (table->relative)
+        return ptr - 1 <= table->size ? (void*)(table->base + ptr - 1) : 0;
+
+    if(ptr > table->pointers.count)
         return 0;
 
-    return *(void**)DArray_Get(array, ptr - 1);
+    return *(void**)DArray_Get(&table->pointers, ptr - 1);
+}
+
+void set_relative_ptr(TVirtualPtrTable* table, const void* base, size_t size)
+{
+    table->pointers.count = 0;
+    table->base = (const uint8_t*)base;
+    table->size = size;
+    table->relative = true;
+}
+
+bool is_relative_ptr(const TVirtualPtrTable* table)
+{
+    return table->relative;
 }
@@ -9,10 +9,52 @@
 */
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "dllapi.h"
-#include "gr2.h"
+#include "darray.h"
 
-extern uint32_t encode_ptr(TDArray* array, const void *ptr);
-extern void* decode_ptr(TDArray* array, uint32_t ptr);
+/*!
+	Virtual pointers of the loaded data, the values stored in place of the pointers
+*/
+typedef struct SVirtualPtrTable
+{
+	TDArray pointers; /* pointer of each virtual pointer at the index of the virtual pointer minus one, empty when relative */
+	const uint8_t* base; /* start of the data the relative pointers point to */
+	size_t size; /* size of the data the relative pointers point to */
+	bool relative; /* the virtual pointers are offsets from base plus one (see set_relative_ptr) */
+} TVirtualPtrTable;
+
+/*!
+	Turns a pointer into a virtual pointer
+	@param table The virtual pointer table
+	@param ptr The pointer
+	@param out Output virtual pointer (0 for NULL)
+	@return true if the pointer was encoded, false if it's outside of the data of a relative table or there is no memory
+*/
+extern bool encode_ptr(TVirtualPtrTable* table, const void* ptr, uint32_t* out);
+
+/*!
+	Turns a virtual pointer into a pointer
+	@param table The virtual pointer table
+	@param ptr The virtual pointer
+	@return the pointer, NULL for 0 and for virtual pointers out of the table
+*/
+extern void* decode_ptr(TVirtualPtrTable* table, uint32_t ptr);
+
+/*!
+	Turns a virtual pointer table into a relative one: the virtual pointers are offsets from
+	a base plus one, nothing is stored and the values are the same in every process
+	@param table The virtual pointer table, the stored pointers are dropped
+	@param base Start of the data the pointers point to
+	@param size Size of the data, at most UINT32_MAX - 1
+*/
+extern void set_relative_ptr(TVirtualPtrTable* table, const void* base, size_t size);
+
+/*!
+	Checks if a virtual pointer table is relative (see set_relative_ptr)
+	@param table The virtual pointer table
+	@return true if the virtual pointers are offsets
+*/
+extern bool is_relative_ptr(const TVirtualPtrTable* table);
@@ -0,0 +1,125 @@
+/*!
+	Project: libopengrn
+	File: visitor.c
+	Streaming visit of the Gr2 data without building elements
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#include "visitor.h"
+#include "debug.h"
+
+/*!
+	A pending list of structures on the visit stack
+*/
+typedef struct SVisitFrame
+{
+	TGr2VisitNode node; /* node that owns the structures */
+	const uint8_t* current; /* structure being visited */
+	uint32_t index; /* structure being visited */
+	uint32_t member; /* next member of the structure to visit */
+} TVisitFrame;
+
+OG_DLLAPI bool Gr2_Visit(TGr2* gr2, const TGr2Visitor* visitor, void* user)
+{
+	TDArray stack;
+	TVisitFrame frame, *top;
+	int result = GR2_VISIT_CONTINUE;
+	bool success = false;
+
+	if (!gr2->data)
+		return false;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.node.children.layout = LayoutCache_Get(&gr2->layouts, &gr2->virtual_ptr, gr2->data + gr2->sectorOffsets[gr2->fileInfo.type.sector] + gr2->fileInfo.type.position);
+	frame.node.children.base = gr2->data + gr2->sectorOffsets[gr2->fileInfo.root.sector] + gr2->fileInfo.root.position;
+	frame.node.children.count = 1;
+	frame.current = frame.node.children.base;
+
+	if (!frame.node.children.layout)
+		return false;
+
+	if (!DArray_Init(&stack, sizeof(TVisitFrame), 16))
+		return false;
+
+	if (!DArray_Add(&stack, &frame))
+		goto end;
+
+	while (stack.count && result != GR2_VISIT_STOP)
+	{
+		TGr2VisitNode node;
+
+		top = (TVisitFrame*)DArray_Get(&stack, stack.count - 1);
+
+		while (top->index < top->node.children.count && (top->member == top->node.children.layout->count || !top->current))
+		{
+			top->member = 0;
+			top->index++;
+			top->current = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &top->node.children, top->index);
+		}
+
+		if (top->index >= top->node.children.count)
+		{
+			/* all the structures are visited */
+			node = top->node;
+			DArray_Pop(&stack);
+
+			if (stack.count && visitor->leave)
+				result = visitor->leave(user, &node);
+
+			continue;
+		}
+
+		node.member = &top->node.children.layout->members[top->member++];
+		node.data = top->current + node.member->offset;
+		node.index = top->index;
+		node.depth = (uint32_t)stack.count - 1;
+
+		if (!node.member->recurse)
+		{
+			memset(&node.children, 0, sizeof(node.children));
+
+			if (visitor->primitive)
+				result = visitor->primitive(user, &node);
+
+			continue;
+		}
+
+		if (!LayoutCache_GetChildren(&gr2->layouts, &gr2->virtual_ptr, node.member, node.data, &node.children))
+			goto end;
+
+		result = visitor->enter ? visitor->enter(user, &node) : GR2_VISIT_CONTINUE;
+
+		if (result == GR2_VISIT_STOP)
+			break;
+
+		if (result == GR2_VISIT_SKIP || !node.children.count)
+		{
+			if (visitor->leave)
+				result = visitor->leave(user, &node);
+
+			continue;
+		}
+
+		if (stack.count >= gr2->maxDepth)
+		{
+			dbg_printf("maximum visit depth %u reached", gr2->maxDepth);
+			goto end;
+		}
+
+		frame.node = node;
+		frame.index = 0;
+		frame.member = 0;
+		frame.current = LayoutCache_GetStructure(&gr2->layouts, &gr2->virtual_ptr, &node.children, 0);
+
+		if (!DArray_Add(&stack, &frame))
+			goto end;
+	}
+
+	success = true;
+
+end:
+	DArray_Free(&stack);
+	return success;
+}
@@ -0,0 +1,79 @@
+/*!
+	Project: libopengrn
+	File: visitor.h
+	Streaming visit of the Gr2 data without building elements
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "gr2.h"
+#include "layout.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+	Result of a visitor callback
+*/
+enum EGr2VisitResults
+{
+	GR2_VISIT_CONTINUE, /* continue the visit */
+	GR2_VISIT_SKIP, /* do not visit the children of the node (enter only) */
+	GR2_VISIT_STOP, /* stop the visit */
+};
+
+/*!
+	A node reported to the visitor
+*/
+typedef struct SGr2VisitNode
+{
+	const TTypeMember* member; /* compiled member (raw info, name, size) */
+	const uint8_t* data; /* pointer to the member inside gr2->data */
+	uint32_t index; /* index of the structure that contains the member inside it's parent */
+	uint32_t depth; /* nesting of the member, the members of the root are 0 */
+	TLayoutChildren children; /* structures referenced by the member (enter and leave only) */
+} TGr2VisitNode;
+
+/*!
+	Callbacks of a visit, any of them can be NULL
+*/
+typedef struct SGr2Visitor
+{
+	/*!
+		Called for members that can contain children (inline, references and arrays)
+		before it's children are visited
+		@return one of EGr2VisitResults
+	*/
+	int (*enter)(void* user, const TGr2VisitNode* node);
+
+	/*!
+		Called after the children of a member were visited (or skipped)
+		@return GR2_VISIT_CONTINUE or GR2_VISIT_STOP
+	*/
+	int (*leave)(void* user, const TGr2VisitNode* node);
+
+	/*!
+		Called for members that have no children (numbers, strings, transforms and empty references)
+		@return GR2_VISIT_CONTINUE or GR2_VISIT_STOP
+	*/
+	int (*primitive)(void* user, const TGr2VisitNode* node);
+} TGr2Visitor;
+
+/*!
+	Walks the type and data trees of a loaded file, calling the visitor for every member
+	@param gr2 The loaded file
+	@param visitor The callbacks
+	@param user User data passed to the callbacks
+	@return true if the visit completed (or was stopped by a callback), otherwise false
+	@note Nothing is allocated per node, so the file can be loaded with GR2_LOAD_DATA
+		when the element tree is not required
+*/
+extern OG_DLLAPI bool Gr2_Visit(TGr2* gr2, const TGr2Visitor* visitor, void* user);
+
+#ifdef __cplusplus
+}
+#endif
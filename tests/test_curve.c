@@ -0,0 +1,415 @@
+/*!
+	Project: tests/libopengrn
+	File: test_curve.c
+	Decoding of the packed curve formats, evaluation of the curves and cursors
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libopengrn/gr2.h"
+#include "../libopengrn/pathindex.h"
+#include "../libopengrn/curve.h"
+
+/*!
+	Number of failed checks
+*/
+static uint32_t failures = 0;
+
+/*!
+	Compares a sampled value with the expected one
+	@param what Name of the check
+	@param value The sampled value
+	@param expected The expected value
+	@param count Number of floats
+	@param tolerance Largest accepted difference of a float
+*/
+static void Test_Check(const char* what, const float* value, const float* expected, uint32_t count, float tolerance)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (fabsf(value[i] - expected[i]) > tolerance)
+		{
+			printf("%s: component %u is %g instead of %g\n", what, i, value[i], expected[i]);
+			failures++;
+			return;
+		}
+	}
+}
+
+/*!
+	Compares a sampled quaternion with the expected one, q and -q are the same rotation
+*/
+static void Test_CheckQuaternion(const char* what, const float* value, const float* expected, float tolerance)
+{
+	float negated[4] = { -expected[0], -expected[1], -expected[2], -expected[3] };
+	float dot = value[0] * expected[0] + value[1] * expected[1] + value[2] * expected[2] + value[3] * expected[3];
+
+	Test_Check(what, value, dot < 0.0f ? negated : expected, 4, tolerance);
+}
+
+/*!
+	Binds a hand made curve
+	@param curve Output curve
+	@param format One of ECurveFormats
+	@param degree Degree of the curve
+	@param dimension Floats of a sampled value
+	@param components Packed values of a control
+	@param count Number of knots and controls
+	@param knots Packed knots, NULL for the control indices
+	@param controls Packed controls
+*/
+static void Test_MakeCurve(TGr2Curve* curve, uint8_t format, uint8_t degree, uint32_t dimension, uint32_t components, uint32_t count, const void* knots, const void* controls)
+{
+	memset(curve, 0, sizeof(TGr2Curve));
+	curve->format = format;
+	curve->degree = degree;
+	curve->dimension = dimension;
+	curve->components = components;
+	curve->knotCount = count;
+	curve->knots = (const uint8_t*)knots;
+	curve->controls = (const uint8_t*)controls;
+	curve->knotScale = 1.0f;
+}
+
+/*!
+	D4n quaternions: the high bits of the second and third values are the index of the rebuilt
+	component and the high bit of the first value its sign (the packing of Granny)
+*/
+static void Test_D4n(void)
+{
+	/* the stored components are 16384/32767 * sqrt(2) - 1/sqrt(2) (almost 0), so the rebuilt one is -1 at index 2 */
+	static const uint16_t knots16[1] = { 0 };
+	static const uint16_t controls16[3] = { 0x8000 | 16384, 0x8000 | 16384, 16384 };
+	static const float expected16[4] = { 0.0f, 0.0f, -1.0f, 0.0f };
+	/* index 1, negative, with 7 bit components */
+	static const uint8_t knots8[1] = { 0 };
+	static const uint8_t controls8[3] = { 0x80 | 64, 64, 0x80 | 64 };
+	static const float expected8[4] = { 0.0f, -1.0f, 0.0f, 0.0f };
+	/* a generic rotation, the largest component (w, index 3) is rebuilt and positive */
+	const float rotation[4] = { 0.1f, -0.5f, 0.3f, 0.80622577f };
+	uint16_t controls[3];
+	TGr2Curve curve;
+	float value[4];
+
+	Test_MakeCurve(&curve, CURVE_D4NK16UC15U, 0, 4, 3, 1, knots16, controls16);
+	Curve_Sample(&curve, 0.0f, value);
+	Test_Check("D4nK16uC15u index 2", value, expected16, 4, 1e-3f);
+
+	Test_MakeCurve(&curve, CURVE_D4NK8UC7U, 0, 4, 3, 1, knots8, controls8);
+	Curve_Sample(&curve, 0.0f, value);
+	Test_Check("D4nK8uC7u index 1", value, expected8, 4, 2e-2f);
+
+	for (uint32_t i = 0; i < 3; i++)
+		controls[i] = (uint16_t)lroundf((rotation[i] + 0.70710677f) / 1.4142135f * 32767.0f);
+
+	controls[1] |= 0x8000;
+	controls[2] |= 0x8000;
+	Test_MakeCurve(&curve, CURVE_D4NK16UC15U, 0, 4, 3, 1, knots16, controls);
+	Curve_Sample(&curve, 0.0f, value);
+	Test_Check("D4nK16uC15u index 3", value, rotation, 4, 1e-3f);
+}
+
+/*!
+	Reference de Boor evaluation in double precision, with Granny's knot convention (see Curve_Evaluate)
+*/
+static double Test_DeBoor(const float* knots, const float* controls, int count, int degree, double time)
+{
+	double points[4];
+	int interval = 0;
+
+	if (time <= knots[0])
+		time = knots[0];
+	else if (time >= knots[count - 1])
+	{
+		time = knots[count - 1];
+		interval = count - 2;
+	}
+	else
+	{
+		while (knots[interval + 1] <= time)
+			interval++;
+	}
+
+	for (int r = 0; r <= degree; r++)
+	{
+		int control = interval + 1 - degree + r;
+
+		points[r] = controls[control < 0 ? 0 : control > count - 1 ? count - 1 : control];
+	}
+
+	for (int s = 1; s <= degree; s++)
+	{
+		for (int r = degree; r >= s; r--)
+		{
+			int i0 = interval + r - degree, i1 = interval + r + 1 - s;
+			double k0 = i0 < 0 ? knots[0] + i0 * (double)(knots[1] - knots[0]) : i0 > count - 1 ? knots[count - 1] + (i0 - count + 1) * (double)(knots[count - 1] - knots[count - 2]) : knots[i0];
+			double k1 = i1 < 0 ? knots[0] + i1 * (double)(knots[1] - knots[0]) : i1 > count - 1 ? knots[count - 1] + (i1 - count + 1) * (double)(knots[count - 1] - knots[count - 2]) : knots[i1];
+			double a = k1 > k0 ? (time - k0) / (k1 - k0) : 0.0;
+
+			points[r] = points[r - 1] + a * (points[r] - points[r - 1]);
+		}
+	}
+
+	return points[degree];
+}
+
+/*!
+	B-splines of degree 0 to 3 against the reference, constant controls stay constant
+*/
+static void Test_BSpline(void)
+{
+	static const float knots[7] = { 0.0f, 0.5f, 1.0f, 1.25f, 2.0f, 3.0f, 3.5f };
+	static const float controls[7] = { 1.0f, 3.0f, -2.0f, 0.5f, 4.0f, 4.0f, -1.0f };
+	static const float constant[7] = { 2.0f, 2.0f, 2.0f, 2.0f, 2.0f, 2.0f, 2.0f };
+	char what[64];
+
+	for (uint8_t degree = 0; degree <= 3; degree++)
+	{
+		TGr2Curve curve, flat;
+
+		Test_MakeCurve(&curve, CURVE_DAK32FC32F, degree, 1, 1, 7, knots, controls);
+		Test_MakeCurve(&flat, CURVE_DAK32FC32F, degree, 1, 1, 7, knots, constant);
+
+		for (int step = -20; step <= 400; step += 5)
+		{
+			float time = (float)step / 100.0f, value, expected = 2.0f;
+
+			snprintf(what, sizeof(what), "degree %u at %g", degree, time);
+			Curve_Sample(&flat, time, &value);
+			Test_Check(what, &value, &expected, 1, 1e-5f);
+
+			/* degree 0 is stepped, the value is the control of the interval */
+			if (degree)
+				expected = (float)Test_DeBoor(knots, controls, 7, degree, time);
+			else
+				expected = controls[time <= 0.0f ? 0 : time >= 3.5f ? 6 : (step >= 300 ? 5 : step >= 200 ? 4 : step >= 125 ? 3 : step >= 100 ? 2 : step >= 50 ? 1 : 0)];
+
+			Curve_Sample(&curve, time, &value);
+			Test_Check(what, &value, &expected, 1, 1e-4f);
+		}
+	}
+}
+
+/*!
+	Cursor sampling against the knot search: small forward steps are walked, going back and
+	jumping ahead search the knot again, both must give the interval and value of Curve_Sample
+*/
+static void Test_Cursor(void)
+{
+	/* forward by one to three knots, jumps ahead, seeks back, times outside the knots and repeated times */
+	static const float times[] = {
+		-1.0f, 0.0f, 0.3f, 1.0f, 1.6f, 2.9f, 3.0f, 3.0f, 4.5f, 6.2f, 6.9f, 20.0f, 21.5f, 5.0f, 4.9f,
+		0.2f, 8.0f, 8.5f, 9.0f, 11.5f, 30.0f, 39.0f, 50.0f, 38.5f, 39.5f, 12.0f, 12.1f, 15.9f, -3.0f, 0.0f,
+	};
+	float knots[40], controls[40 * 3];
+	char what[64];
+
+	/* uneven spacing with a repeated knot */
+	for (uint32_t i = 0; i < 40; i++)
+	{
+		knots[i] = (float)i + (i % 3 ? 0.25f : 0.0f);
+		controls[i * 3] = (float)i;
+		controls[i * 3 + 1] = (float)(i % 5);
+		controls[i * 3 + 2] = (float)(i * i) * 0.1f;
+	}
+
+	knots[8] = knots[7];
+
+	for (uint8_t degree = 0; degree <= 3; degree++)
+	{
+		TGr2Curve curve;
+		uint32_t knot = 0;
+
+		Test_MakeCurve(&curve, CURVE_DAK32FC32F, degree, 3, 3, 40, knots, controls);
+
+		for (uint32_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+		{
+			uint32_t expected = 0;
+			float value[3], reference[3];
+
+			while (expected + 1 < 40 && knots[expected + 1] <= times[i])
+				expected++;
+
+			snprintf(what, sizeof(what), "cursor degree %u at %g", degree, times[i]);
+			Curve_SampleCursor(&curve, &knot, times[i], value);
+			Curve_Sample(&curve, times[i], reference);
+
+			if (knot != expected)
+			{
+				printf("%s: knot %u instead of %u\n", what, knot, expected);
+				failures++;
+			}
+
+			Test_Check(what, value, reference, 3, 0.0f);
+		}
+	}
+}
+
+/*!
+	Track cursor against the sampling of the whole track group, forward and backward
+	@param group The track group
+*/
+static void Test_TrackCursor(const TGr2TrackGroup* group)
+{
+	static const float times[] = { 0.0f, 0.1f, 0.25f, 0.5f, 0.6f, 1.0f, 2.0f, 0.75f, 0.2f, -1.0f, 0.5f, 0.9f };
+	TTransformation* pose = (TTransformation*)calloc(group->trackCount + 1, sizeof(TTransformation));
+	TTransformation* reference = (TTransformation*)calloc(group->trackCount + 1, sizeof(TTransformation));
+	TGr2TrackCursor cursor;
+
+	if (!pose || !reference || !TrackCursor_Init(&cursor, group))
+	{
+		printf("memory allocation fail!!!\n");
+		failures++;
+		free(pose);
+		free(reference);
+		return;
+	}
+
+	for (uint32_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+	{
+		TrackCursor_Sample(&cursor, times[i], pose);
+		TrackGroup_Sample(group, times[i], reference);
+
+		if (memcmp(pose, reference, sizeof(TTransformation) * group->trackCount))
+		{
+			printf("track cursor of %s differs at %g\n", group->name ? group->name : "?", times[i]);
+			failures++;
+		}
+	}
+
+	TrackCursor_Free(&cursor);
+	free(pose);
+	free(reference);
+}
+
+/*!
+	One curve of every format family, bound from the animation of the test file
+	@param path Path of the test file
+*/
+static void Test_Formats(const char* path)
+{
+	static const float quaternion0[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	static const float quaternion1[4] = { 0.0f, 0.47942555f, 0.0f, 0.87758255f };
+	static const float quaternion2[4] = { 0.0f, 0.0f, -0.94898462f, -0.31532236f };
+	static const float linear[3] = { 1.5f, 3.0f, 4.5f };
+	static const float quantized[3] = { 2.0f, 3.0f, 9.0f };
+	static const float scale[9] = { 2.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 2.0f };
+	static const float expanded[3] = { 0.5f, 1.0f, 2.5f };
+	static const float keyframes[3] = { 2.5f, 2.5f, 2.5f };
+	static const float identity[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	FILE* fp = fopen(path, "rb");
+	TGr2TrackGroup groups[2];
+	TElementGeneric* elem;
+	uint8_t* data;
+	long size;
+	float value[9];
+	TGr2 gr2;
+
+	if (!fp)
+	{
+		printf("%s: cannot open the file\n", path);
+		failures++;
+		return;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+
+	if (!data || size <= 0 || fread(data, (size_t)size, 1, fp) != 1)
+	{
+		printf("%s: cannot read the file\n", path);
+		failures++;
+		fclose(fp);
+		free(data);
+		return;
+	}
+
+	fclose(fp);
+	Gr2_Init(&gr2);
+
+	if (!Gr2_Load(data, (size_t)size, &gr2) || !(elem = Gr2_FindByPath(&gr2, "Animations[0].TrackGroups")) ||
+		!Gr2_GetTrackGroup(&gr2, elem, 0, &groups[0]) || !Gr2_GetTrackGroup(&gr2, elem, 1, &groups[1]))
+	{
+		printf("%s: cannot get the track groups\n", path);
+		failures++;
+		Gr2_Free(&gr2);
+		free(data);
+		return;
+	}
+
+	/* DaK32fC32f and D3K8uC8u positions of the same points, D4Constant32f orientation, DaIdentity scale/shear */
+	if (groups[0].tracks[0].position.format != CURVE_DAK32FC32F || groups[0].tracks[1].position.format != CURVE_D3K8UC8U ||
+		groups[0].tracks[0].orientation.format != CURVE_D4CONSTANT32F || groups[0].tracks[0].scaleShear.format != CURVE_DAIDENTITY)
+	{
+		printf("%s: unexpected formats of the first track group\n", path);
+		failures++;
+	}
+
+	Curve_Sample(&groups[0].tracks[0].position, 0.75f, value);
+	Test_Check("DaK32fC32f", value, linear, 3, 1e-5f);
+	Curve_Sample(&groups[0].tracks[1].position, 0.75f, value);
+	Test_Check("D3K8uC8u", value, linear, 3, 1e-5f);
+	Curve_Sample(&groups[0].tracks[0].orientation, 0.75f, value);
+	Test_Check("D4Constant32f", value, quaternion0, 4, 0.0f);
+	Curve_Sample(&groups[0].tracks[0].scaleShear, 0.75f, value);
+	Test_Check("DaIdentity", value, identity, 9, 0.0f);
+
+	/* D4nK16uC15u orientation, DaK16uC16u position, D9I1K8uC8u scale/shear, D3I1K32fC32f and DaKeyframes32f positions */
+	if (groups[1].tracks[0].orientation.format != CURVE_D4NK16UC15U || groups[1].tracks[0].position.format != CURVE_DAK16UC16U ||
+		groups[1].tracks[0].scaleShear.format != CURVE_D9I1K8UC8U || groups[1].tracks[1].position.format != CURVE_D3I1K32FC32F ||
+		groups[1].tracks[2].position.format != CURVE_DAKEYFRAMES32F)
+	{
+		printf("%s: unexpected formats of the second track group\n", path);
+		failures++;
+	}
+
+	Curve_Sample(&groups[1].tracks[0].orientation, 0.0f, value);
+	Test_CheckQuaternion("D4nK16uC15u first", value, quaternion0, 1e-3f);
+	Curve_Sample(&groups[1].tracks[0].orientation, 0.5f, value);
+	Test_CheckQuaternion("D4nK16uC15u second", value, quaternion1, 1e-3f);
+	Curve_Sample(&groups[1].tracks[0].orientation, 1.0f, value);
+	Test_CheckQuaternion("D4nK16uC15u third", value, quaternion2, 1e-3f);
+	Curve_Sample(&groups[1].tracks[0].position, 0.5f, value);
+	Test_Check("DaK16uC16u", value, quantized, 3, 1e-5f);
+	Curve_Sample(&groups[1].tracks[0].scaleShear, 0.75f, value);
+	Test_Check("D9I1K8uC8u", value, scale, 9, 1e-5f);
+	Curve_Sample(&groups[1].tracks[1].position, 0.5f, value);
+	Test_Check("D3I1K32fC32f", value, expanded, 3, 1e-5f);
+	Curve_Sample(&groups[1].tracks[2].position, 0.25f, value);
+	Test_Check("DaKeyframes32f", value, keyframes, 3, 1e-5f);
+
+	Test_TrackCursor(&groups[0]);
+	Test_TrackCursor(&groups[1]);
+
+	TrackGroup_Free(&groups[0]);
+	TrackGroup_Free(&groups[1]);
+	Gr2_Free(&gr2);
+	free(data);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: test_curve <file.gr2>...\n");
+		return 1;
+	}
+
+	Test_D4n();
+	Test_BSpline();
+	Test_Cursor();
+
+	for (int i = 1; i < argc; i++)
+		Test_Formats(argv[i]);
+
+	printf("%u checks failed\n", failures);
+	return failures ? 1 : 0;
+}
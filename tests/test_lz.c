@@ -0,0 +1,159 @@
+/*!
+	Project: tests/libopengrn
+	File: test_lz.c
+	Round trip of the LZ codec of COMPRESSION_TYPE_LZ
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libopengrn/compression.h"
+
+/*!
+	Kinds of generated data
+*/
+enum ETestPatterns
+{
+	PATTERN_RANDOM, /* incompressible bytes */
+	PATTERN_ZERO, /* a single long run */
+	PATTERN_PERIODIC, /* a short period repeated, matches with offsets below 16 */
+	PATTERN_TEXT, /* words from a small dictionary, matches of any length and offset */
+	PATTERN_FLOATS, /* slowly changing 32 bit values, like vertex data */
+	PATTERN_COUNT,
+};
+
+/*!
+	Deterministic pseudo random generator, the data is the same on every run
+*/
+static uint32_t Test_Random(uint32_t* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+/*!
+	Fills a buffer with a pattern
+	@param data The buffer
+	@param length Length of the buffer
+	@param pattern One of ETestPatterns
+	@param seed Seed of the random values
+*/
+static void Test_Fill(uint8_t* data, uint32_t length, uint32_t pattern, uint32_t seed)
+{
+	static const char* words[] = { "Mesh", "Skeleton", "Bones", "Name", "Transform", "Vertices", "TrackGroups", " ", "\0\0\0\0" };
+	uint32_t state = seed, period = 1 + seed % 15;
+
+	for (uint32_t i = 0; i < length;)
+	{
+		switch (pattern)
+		{
+		case PATTERN_RANDOM:
+			data[i++] = (uint8_t)Test_Random(&state);
+			break;
+		case PATTERN_ZERO:
+			data[i++] = 0;
+			break;
+		case PATTERN_PERIODIC:
+			data[i] = i < period ? (uint8_t)Test_Random(&state) : data[i - period];
+			i++;
+			break;
+		case PATTERN_TEXT:
+		{
+			const char* word = words[Test_Random(&state) % (sizeof(words) / sizeof(words[0]))];
+			size_t len = word[0] ? strlen(word) : 4;
+
+			for (size_t c = 0; c < len && i < length; c++)
+				data[i++] = (uint8_t)word[c];
+			break;
+		}
+		default:
+		{
+			float value = (float)(i / 4) * 0.01f;
+			uint8_t bytes[4];
+
+			memcpy(bytes, &value, sizeof(value));
+
+			for (uint32_t c = 0; c < 4 && i < length; c++)
+				data[i++] = bytes[c];
+			break;
+		}
+		}
+	}
+}
+
+/*!
+	Compresses and decompresses a buffer
+	@param data The data
+	@param length Length of the data
+	@return true if the data came back unchanged and the broken streams were rejected
+*/
+static bool Test_RoundTrip(const uint8_t* data, uint32_t length)
+{
+	uint8_t* compressed = NULL, * decompressed = (uint8_t*)malloc(length + 1);
+	uint32_t compressedLength;
+	bool success = false;
+
+	if (!decompressed || !Compression_Lz(data, length, &compressed, &compressedLength))
+	{
+		printf("cannot compress %u bytes\n", length);
+		goto end;
+	}
+
+	if (!Compression_UnLz(compressed, compressedLength, decompressed, length) || memcmp(data, decompressed, length))
+	{
+		printf("%u bytes do not round trip\n", length);
+		goto end;
+	}
+
+	/* the decoder must reject streams that don't fill the output exactly */
+	if (Compression_UnLz(compressed, compressedLength, decompressed, length + 1) ||
+		(length && Compression_UnLz(compressed, compressedLength, decompressed, length - 1)) ||
+		(compressedLength > 1 && Compression_UnLz(compressed, compressedLength - 1, decompressed, length)))
+	{
+		printf("a broken stream of %u bytes was accepted\n", length);
+		goto end;
+	}
+
+	success = true;
+
+end:
+	free(compressed);
+	free(decompressed);
+	return success;
+}
+
+int main(void)
+{
+	static const uint32_t lengths[] = { 0, 1, 4, 5, 12, 13, 16, 17, 64, 255, 256, 1000, 4096, 65535, 65536, 70000, 300000 };
+	uint32_t failures = 0, tests = 0;
+	uint8_t* data = (uint8_t*)malloc(300000);
+
+	if (!data)
+		return 1;
+
+	for (uint32_t pattern = 0; pattern < PATTERN_COUNT; pattern++)
+	{
+		for (uint32_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+		{
+			for (uint32_t seed = 1; seed <= 3; seed++)
+			{
+				Test_Fill(data, lengths[i], pattern, seed * 7919 + i);
+				tests++;
+
+				if (!Test_RoundTrip(data, lengths[i]))
+				{
+					printf("pattern %u, length %u, seed %u failed\n", pattern, lengths[i], seed);
+					failures++;
+				}
+			}
+		}
+	}
+
+	free(data);
+	printf("%u/%u round trips passed\n", tests - failures, tests);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,617 @@
+/*!
+	Project: tests/libopengrn
+	File: test_roundtrip.c
+	Composes a Granny2 file in every supported way, reloads it and compares the output byte for byte
+
+	The reference is the file composed from the loaded input: composing a file written by Gr2_Compose
+	gives it back unchanged, so every path that writes the same data must give the same bytes
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libopengrn/gr2.h"
+#include "../libopengrn/pack.h"
+#include "../libopengrn/compression.h"
+#include "../libopengrn/convert.h"
+
+/*!
+	A file written in memory
+*/
+typedef struct SMemoryFile
+{
+	uint8_t* data; /* content of the file */
+	size_t size; /* size of the file */
+	size_t reserved; /* allocated size of data */
+	size_t position; /* write position */
+} TMemoryFile;
+
+/*!
+	Writes to a memory file at the current position
+*/
+static bool Memory_Write(void* context, const void* data, size_t len)
+{
+	TMemoryFile* file = (TMemoryFile*)context;
+
+	if (file->position + len > file->reserved)
+	{
+		size_t reserved = (file->position + len) * 2;
+		uint8_t* grown = (uint8_t*)realloc(file->data, reserved);
+
+		if (!grown)
+			return false;
+
+		file->data = grown;
+		file->reserved = reserved;
+	}
+
+	memcpy(file->data + file->position, data, len);
+	file->position += len;
+
+	if (file->position > file->size)
+		file->size = file->position;
+
+	return true;
+}
+
+/*!
+	Moves the write position of a memory file
+*/
+static bool Memory_Seek(void* context, uint64_t position)
+{
+	TMemoryFile* file = (TMemoryFile*)context;
+
+	if (position > file->size)
+		return false;
+
+	file->position = (size_t)position;
+	return true;
+}
+
+/*!
+	Gets a stream that writes to an empty memory file
+	@param file The memory file
+	@param seekable false to write the file like a pipe
+	@return the stream
+*/
+static TGr2Stream Memory_Open(TMemoryFile* file, bool seekable)
+{
+	TGr2Stream stream = { file, Memory_Write, seekable ? Memory_Seek : NULL };
+
+	memset(file, 0, sizeof(TMemoryFile));
+	return stream;
+}
+
+/*!
+	Reads a whole file
+	@param path Path of the file
+	@param file Output content
+	@return true if the file was read, otherwise false
+*/
+static bool Test_ReadFile(const char* path, TMemoryFile* file)
+{
+	FILE* fp = fopen(path, "rb");
+	long size;
+	bool success;
+
+	memset(file, 0, sizeof(TMemoryFile));
+
+	if (!fp)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	file->data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+	file->size = file->reserved = size > 0 ? (size_t)size : 0;
+	success = file->data && size > 0 && fread(file->data, file->size, 1, fp) == 1;
+	fclose(fp);
+	return success;
+}
+
+/*!
+	Checks that a written file is the reference
+	@param what Name of the check
+	@param written true if the file was written
+	@param file The file
+	@param reference The expected content
+	@return true if the file matches
+*/
+static bool Test_Compare(const char* what, bool written, const TMemoryFile* file, const TMemoryFile* reference)
+{
+	if (!written)
+	{
+		printf("%s: cannot write the file\n", what);
+		return false;
+	}
+
+	if (file->size != reference->size || memcmp(file->data, reference->data, reference->size))
+	{
+		printf("%s: %zu bytes differ from the %zu bytes of the reference\n", what, file->size, reference->size);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+	Composes a loaded structure and compares it with the reference
+	@param what Name of the check
+	@param gr2 The structure
+	@param loaded true if the structure was loaded
+	@param reference The expected file
+	@return true if the file matches
+*/
+static bool Test_Compose(const char* what, TGr2* gr2, bool loaded, const TMemoryFile* reference)
+{
+	TMemoryFile file;
+	TGr2Stream stream = Memory_Open(&file, true);
+	bool success;
+
+	if (!loaded)
+	{
+		printf("%s: cannot load the file\n", what);
+		return false;
+	}
+
+	success = Test_Compare(what, Gr2_Compose(gr2, &stream), &file, reference);
+	free(file.data);
+	return success;
+}
+
+/*!
+	Gr2_Compose: the reference composes to itself, with threads, compression and without seeking
+*/
+static bool Test_ComposePaths(const TMemoryFile* reference)
+{
+	static const uint32_t compressions[] = { COMPRESSION_TYPE_NONE, COMPRESSION_TYPE_LZ };
+	bool success = true;
+
+	for (uint32_t c = 0; c < 2; c++)
+	{
+		for (uint32_t threads = 1; threads <= 4; threads *= 4)
+		{
+			for (uint32_t seekable = 0; seekable < 2; seekable++)
+			{
+				TMemoryFile file;
+				TGr2Stream stream = Memory_Open(&file, seekable);
+				TGr2 gr2, again;
+
+				Gr2_Init(&gr2);
+				gr2.writeCompression = compressions[c];
+				gr2.writeThreads = threads;
+
+				if (!Gr2_Load(reference->data, reference->size, &gr2) || !Gr2_Compose(&gr2, &stream))
+				{
+					printf("compose (compression %u, %u threads, seek %u): cannot write the file\n", compressions[c], threads, seekable);
+					success = false;
+				}
+				else if (compressions[c] == COMPRESSION_TYPE_NONE)
+					success &= Test_Compare("compose", true, &file, reference);
+				else
+				{
+					/* the compressed file must load to the same data */
+					Gr2_Init(&again);
+					success &= Test_Compose("compose compressed", &again, Gr2_Load(file.data, file.size, &again), reference);
+					Gr2_Free(&again);
+				}
+
+				Gr2_Free(&gr2);
+				free(file.data);
+			}
+		}
+	}
+
+	return success;
+}
+
+/*!
+	Checks that two loaded structures have the same elements, whatever the layout of their files
+	@param what Name of the check
+	@param gr2 The first structure
+	@param other The second structure
+	@return true if the names, types, values and strings of the elements are the same
+*/
+static bool Test_SameData(const char* what, TGr2* gr2, TGr2* other)
+{
+	if (gr2->elements.count != other->elements.count)
+	{
+		printf("%s: %zu elements instead of %zu\n", what, other->elements.count, gr2->elements.count);
+		return false;
+	}
+
+	for (size_t i = 0; i < gr2->elements.count; i++)
+	{
+		const TElementGeneric* a = *(TElementGeneric**)DArray_Get(&gr2->elements, i);
+		const TElementGeneric* b = *(TElementGeneric**)DArray_Get(&other->elements, i);
+		uint32_t type = a->rawInfo.type;
+		bool same = type == b->rawInfo.type && a->size == b->size && (!a->name || !b->name ? a->name == b->name : !strcmp(a->name, b->name));
+
+		/* the pointers differ, only the values and the strings are compared */
+		if (same && type == TYPEID_STRING)
+		{
+			const char* sa = ((const TElementString*)a)->value;
+			const char* sb = ((const TElementString*)b)->value;
+
+			same = !sa || !sb ? sa == sb : !strcmp(sa, sb);
+		}
+		else if (same && (type == TYPEID_TRANSFORM || (type >= TYPEID_REAL32 && type <= TYPEID_REAL16)) && a->member && b->member)
+			same = a->member->size == b->member->size && !memcmp(a->data, b->data, a->member->size);
+
+		if (!same)
+		{
+			printf("%s: element %zu (%s) differs\n", what, i, a->name ? a->name : "?");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+	Gr2_Compose with writeDeduplicate and GR2_WRITE_LAYOUT_CLUSTER: the file must load to the data
+	of the reference, and composing it again with the same settings must give it back unchanged
+*/
+static bool Test_LayoutPaths(const TMemoryFile* reference)
+{
+	static const bool deduplicate[] = { true, false, true };
+	static const uint32_t layouts[] = { GR2_WRITE_LAYOUT_KEEP, GR2_WRITE_LAYOUT_CLUSTER, GR2_WRITE_LAYOUT_CLUSTER };
+	bool success = true;
+
+	for (uint32_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+	{
+		TMemoryFile file;
+		TGr2Stream stream = Memory_Open(&file, true);
+		char what[64];
+		TGr2 gr2, again;
+
+		snprintf(what, sizeof(what), "compose (deduplicate %u, layout %u)", deduplicate[i], layouts[i]);
+		Gr2_Init(&gr2);
+		Gr2_Init(&again);
+
+		if (!Gr2_Load(reference->data, reference->size, &gr2))
+		{
+			printf("%s: cannot load the reference\n", what);
+			success = false;
+		}
+		else
+		{
+			gr2.writeDeduplicate = deduplicate[i];
+			gr2.writeLayout = layouts[i];
+
+			if (!Gr2_Compose(&gr2, &stream) || !Gr2_Load(file.data, file.size, &again))
+			{
+				printf("%s: cannot write the file\n", what);
+				success = false;
+			}
+			else if (deduplicate[i] && file.size > reference->size)
+			{
+				printf("%s: %zu bytes instead of at most %zu\n", what, file.size, reference->size);
+				success = false;
+			}
+			else
+			{
+				again.writeDeduplicate = deduplicate[i];
+				again.writeLayout = layouts[i];
+				success &= Test_SameData(what, &gr2, &again);
+				success &= Test_Compose(what, &again, true, &file);
+			}
+		}
+
+		Gr2_Free(&gr2);
+		Gr2_Free(&again);
+		free(file.data);
+	}
+
+	return success;
+}
+
+/*!
+	Gr2_ComposeIncremental after a setter of the library: the setter marks the sector it writes,
+	so the incremental save must match a full compose without any Gr2_MarkDirty of the program
+*/
+static bool Test_IncrementalSetter(const TMemoryFile* reference)
+{
+	TElementGeneric* edited = NULL;
+	TMemoryFile file, composed;
+	TGr2Stream stream, composedStream;
+	float values[16];
+	bool success = true;
+	TGr2 gr2;
+
+	Gr2_Init(&gr2);
+
+	if (!Gr2_Load(reference->data, reference->size, &gr2))
+	{
+		printf("incremental setter: cannot load the file\n");
+		Gr2_Free(&gr2);
+		return false;
+	}
+
+	for (size_t i = 0; i < gr2.elements.count && !edited; i++)
+	{
+		TElementGeneric* elem = *(TElementGeneric**)DArray_Get(&gr2.elements, i);
+		size_t count = Element_GetReal16Count(&gr2, elem);
+
+		if (elem->rawInfo.type == TYPEID_REAL16 && count && count <= sizeof(values) / sizeof(values[0]))
+			edited = elem;
+	}
+
+	if (!edited)
+	{
+		Gr2_Free(&gr2);
+		return true;
+	}
+
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		values[i] = 0.25f + (float)i;
+
+	stream = Memory_Open(&file, true);
+	composedStream = Memory_Open(&composed, true);
+
+	if (!Element_SetReal16Array(&gr2, edited, values) || !Gr2_Compose(&gr2, &composedStream))
+	{
+		printf("incremental setter: cannot compose the file\n");
+		success = false;
+	}
+	else
+		success = Test_Compare("incremental setter", Gr2_ComposeIncremental(&gr2, reference->data, reference->size, &stream), &file, &composed);
+
+	free(file.data);
+	free(composed.data);
+	Gr2_Free(&gr2);
+	return success;
+}
+
+/*!
+	Gr2_ComposeIncremental: a clean save, a save of every sector and a save of an edited value
+*/
+static bool Test_IncrementalPaths(const TMemoryFile* reference)
+{
+	TMemoryFile file;
+	TGr2Stream stream;
+	TGr2 gr2;
+	char* edited = NULL;
+	bool success;
+
+	Gr2_Init(&gr2);
+
+	if (!Gr2_Load(reference->data, reference->size, &gr2))
+	{
+		printf("incremental: cannot load the file\n");
+		Gr2_Free(&gr2);
+		return false;
+	}
+
+	stream = Memory_Open(&file, true);
+	success = Test_Compare("incremental clean", Gr2_ComposeIncremental(&gr2, reference->data, reference->size, &stream), &file, reference);
+	free(file.data);
+
+	Gr2_MarkDirty(&gr2, gr2.data, gr2.dataSize);
+	stream = Memory_Open(&file, true);
+	success &= Test_Compare("incremental dirty", Gr2_ComposeIncremental(&gr2, reference->data, reference->size, &stream), &file, reference);
+	free(file.data);
+
+	/* the first string of the data is edited in place, both writers must agree on the result */
+	for (size_t i = 0; i < gr2.elements.count && !edited; i++)
+	{
+		TElementGeneric* elem = *(TElementGeneric**)DArray_Get(&gr2.elements, i);
+
+		if (elem->rawInfo.type == TYPEID_STRING && ((TElementString*)elem)->value && ((TElementString*)elem)->value[0])
+			edited = (char*)((TElementString*)elem)->value;
+	}
+
+	if (edited)
+	{
+		TMemoryFile composed;
+		TGr2Stream composedStream = Memory_Open(&composed, true);
+
+		edited[0] ^= 0x20;
+		Gr2_MarkDirty(&gr2, edited, 1);
+		stream = Memory_Open(&file, true);
+
+		if (!Gr2_Compose(&gr2, &composedStream))
+		{
+			printf("incremental edited: cannot compose the file\n");
+			success = false;
+		}
+		else
+			success &= Test_Compare("incremental edited", Gr2_ComposeIncremental(&gr2, reference->data, reference->size, &stream), &file, &composed);
+
+		free(file.data);
+		free(composed.data);
+	}
+
+	Gr2_Free(&gr2);
+	return success && Test_IncrementalSetter(reference);
+}
+
+/*!
+	Gr2_Transcode: stored sectors to LZ and back give files that load to the same data
+*/
+static bool Test_TranscodePaths(const TMemoryFile* reference)
+{
+	TMemoryFile lz, stored;
+	TGr2Stream stream;
+	TGr2 gr2, loaded;
+	bool success;
+
+	Gr2_Init(&gr2);
+
+	if (!Gr2_Load(reference->data, reference->size, &gr2))
+	{
+		printf("transcode: cannot load the file\n");
+		Gr2_Free(&gr2);
+		return false;
+	}
+
+	stream = Memory_Open(&lz, true);
+	success = Gr2_Transcode(&gr2, reference->data, reference->size, COMPRESSION_TYPE_NONE, COMPRESSION_TYPE_LZ, &stream);
+	Gr2_Free(&gr2);
+
+	if (!success)
+	{
+		printf("transcode to lz: cannot write the file\n");
+		free(lz.data);
+		return false;
+	}
+
+	Gr2_Init(&loaded);
+	success = Test_Compose("transcode to lz", &loaded, Gr2_Load(lz.data, lz.size, &loaded), reference);
+
+	stream = Memory_Open(&stored, true);
+
+	if (!Gr2_Transcode(&loaded, lz.data, lz.size, COMPRESSION_TYPE_LZ, COMPRESSION_TYPE_NONE, &stream))
+	{
+		printf("transcode to stored: cannot write the file\n");
+		success = false;
+	}
+	else
+	{
+		Gr2_Init(&gr2);
+		success &= Test_Compose("transcode to stored", &gr2, Gr2_Load(stored.data, stored.size, &gr2), reference);
+		Gr2_Free(&gr2);
+	}
+
+	Gr2_Free(&loaded);
+	free(lz.data);
+	free(stored.data);
+	return success;
+}
+
+/*!
+	Gr2_ComposeImage: images with relocations and with relative pointers load to the same data
+*/
+static bool Test_ImagePaths(const TMemoryFile* reference)
+{
+	bool success = true;
+
+	for (uint32_t relative = 0; relative < 2; relative++)
+	{
+		TMemoryFile image;
+		TGr2Stream stream = Memory_Open(&image, true);
+		TGr2 gr2, loaded;
+
+		Gr2_Init(&gr2);
+		gr2.relativePointers = relative;
+
+		if (!Gr2_Load(reference->data, reference->size, &gr2) || !Gr2_ComposeImage(&gr2, &stream))
+		{
+			printf("image (relative %u): cannot write the image\n", relative);
+			success = false;
+		}
+		else
+		{
+			Gr2_Init(&loaded);
+			success &= Test_Compose(relative ? "image relative" : "image", &loaded, Gr2_LoadImage(image.data, image.size, &loaded), reference);
+			Gr2_Free(&loaded);
+		}
+
+		Gr2_Free(&gr2);
+		free(image.data);
+	}
+
+	return success;
+}
+
+/*!
+	Gr2PackWriter: the stored file comes back unchanged and the stored image loads to the same data
+*/
+static bool Test_PackPaths(const TMemoryFile* reference)
+{
+	TGr2PackWriter writer;
+	TMemoryFile file;
+	TGr2Stream stream = Memory_Open(&file, true);
+	TGr2Pack pack;
+	const TGr2PackEntry* entry;
+	TGr2 gr2;
+	bool success;
+
+	if (!Gr2PackWriter_Init(&writer) || !Gr2PackWriter_Add(&writer, "file.gr2", reference->data, reference->size, GR2_PACK_FILE) ||
+		!Gr2PackWriter_Add(&writer, "image.gr2", reference->data, reference->size, GR2_PACK_IMAGE) || !Gr2PackWriter_Write(&writer, &stream))
+	{
+		printf("pack: cannot write the pack\n");
+		Gr2PackWriter_Free(&writer);
+		free(file.data);
+		return false;
+	}
+
+	Gr2PackWriter_Free(&writer);
+
+	if (!Gr2Pack_OpenMemory(&pack, file.data, file.size))
+	{
+		printf("pack: cannot open the pack\n");
+		free(file.data);
+		return false;
+	}
+
+	entry = Gr2Pack_Find(&pack, "file.gr2");
+	success = entry && entry->size == reference->size && !memcmp(Gr2Pack_GetData(&pack, entry), reference->data, reference->size);
+
+	if (!success)
+		printf("pack file: the stored file differs from the reference\n");
+
+	Gr2_Init(&gr2);
+	success &= Test_Compose("pack file", &gr2, Gr2Pack_Load(&pack, "file.gr2", &gr2), reference);
+	Gr2_Free(&gr2);
+
+	Gr2_Init(&gr2);
+	success &= Test_Compose("pack image", &gr2, Gr2Pack_Load(&pack, "image.gr2", &gr2), reference);
+	Gr2_Free(&gr2);
+
+	Gr2Pack_Close(&pack);
+	free(file.data);
+	return success;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t failures = 0;
+
+	if (argc < 2)
+	{
+		printf("usage: test_roundtrip <file.gr2>...\n");
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		TMemoryFile input, reference;
+		TGr2Stream stream = Memory_Open(&reference, true);
+		TGr2 gr2;
+		bool success;
+
+		Gr2_Init(&gr2);
+
+		if (!Test_ReadFile(argv[i], &input) || !Gr2_Load(input.data, input.size, &gr2) || !Gr2_Compose(&gr2, &stream))
+		{
+			printf("%s: cannot build the reference\n", argv[i]);
+			Gr2_Free(&gr2);
+			free(input.data);
+			free(reference.data);
+			failures++;
+			continue;
+		}
+
+		Gr2_Free(&gr2);
+		free(input.data);
+
+		success = Test_ComposePaths(&reference);
+		success &= Test_LayoutPaths(&reference);
+		success &= Test_IncrementalPaths(&reference);
+		success &= Test_TranscodePaths(&reference);
+		success &= Test_ImagePaths(&reference);
+		success &= Test_PackPaths(&reference);
+
+		printf("%s: %s\n", argv[i], success ? "ok" : "failed");
+		failures += success ? 0 : 1;
+		free(reference.data);
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/*!
+	Project: tests/libopengrn
+	File: test_skinning.c
+	AVX2 and scalar skinning of the same vertices, in one range and split between threads
+
+	This Source Code Form is subject to the terms of the Mozilla Public
+	License, v. 2.0. If a copy of the MPL was not distributed with this
+	file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libopengrn/skinning.h"
+#include "../libopengrn/platform.h"
+
+/*!
+	Number of bone bindings of the generated meshes
+*/
+#define TEST_BONES 8
+
+/*!
+	Number of weights and bone indices of each vertex
+*/
+#define TEST_INFLUENCES 4
+
+/*!
+	Streams of a generated mesh
+*/
+typedef struct STestMesh
+{
+	TGr2SkinMesh mesh; /* the mesh, pointing to the streams below */
+	float* positions; /* source positions */
+	float* normals; /* source normals */
+	float* weights; /* bone weights */
+	float* indices; /* bone indices */
+} TTestMesh;
+
+/*!
+	Deterministic pseudo random generator, the data is the same on every run
+*/
+static uint32_t Test_Random(uint32_t* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+/*!
+	Gets a pseudo random float
+	@param state The generator state
+	@return a value between -1 and 1
+*/
+static float Test_RandomFloat(uint32_t* state)
+{
+	return (float)(Test_Random(state) % 20001) / 10000.0f - 1.0f;
+}
+
+/*!
+	Generates a mesh with zero weights, indices out of range and vertices without weights
+	@param test Output mesh, must be freed with Test_FreeMesh
+	@param count Number of vertices
+	@param boneMap Matrix of each bone binding, or NULL
+	@return true if the mesh was allocated, otherwise false
+*/
+static bool Test_MakeMesh(TTestMesh* test, uint32_t count, const uint32_t* boneMap)
+{
+	uint32_t state = count;
+
+	memset(test, 0, sizeof(TTestMesh));
+	test->positions = (float*)malloc(sizeof(float) * 3 * count);
+	test->normals = (float*)malloc(sizeof(float) * 3 * count);
+	test->weights = (float*)malloc(sizeof(float) * TEST_INFLUENCES * count);
+	test->indices = (float*)malloc(sizeof(float) * TEST_INFLUENCES * count);
+
+	if (!test->positions || !test->normals || !test->weights || !test->indices)
+		return false;
+
+	for (uint32_t v = 0; v < count; v++)
+	{
+		float* weights = test->weights + (size_t)v * TEST_INFLUENCES;
+		float* indices = test->indices + (size_t)v * TEST_INFLUENCES;
+		float sum = 0.0f;
+
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			test->positions[(size_t)v * 3 + c] = Test_RandomFloat(&state) * 100.0f;
+			test->normals[(size_t)v * 3 + c] = Test_RandomFloat(&state);
+		}
+
+		for (uint32_t i = 0; i < TEST_INFLUENCES; i++)
+		{
+			uint32_t kind = Test_Random(&state) % 8;
+
+			/* mostly valid influences, some without weight and some with a bone outside of the bindings */
+			weights[i] = kind == 0 ? 0.0f : (float)(1 + Test_Random(&state) % 100);
+			indices[i] = kind == 1 ? (float)TEST_BONES : kind == 2 ? -1.0f : (float)(Test_Random(&state) % TEST_BONES);
+			sum += weights[i];
+		}
+
+		for (uint32_t i = 0; i < TEST_INFLUENCES; i++)
+			weights[i] = v % 17 == 0 || sum == 0.0f ? 0.0f : weights[i] / sum;
+	}
+
+	test->mesh.vertexCount = count;
+	test->mesh.influences = TEST_INFLUENCES;
+	test->mesh.boneCount = TEST_BONES;
+	test->mesh.positions = test->positions;
+	test->mesh.normals = test->normals;
+	test->mesh.weights = test->weights;
+	test->mesh.indices = test->indices;
+	test->mesh.boneMap = boneMap;
+	return true;
+}
+
+/*!
+	Frees a generated mesh
+	@param test The mesh
+*/
+static void Test_FreeMesh(TTestMesh* test)
+{
+	free(test->positions);
+	free(test->normals);
+	free(test->weights);
+	free(test->indices);
+	memset(test, 0, sizeof(TTestMesh));
+}
+
+/*!
+	Compares two deformed streams
+	@param what Name of the check
+	@param value The deformed values
+	@param expected The expected values
+	@param count Number of floats
+	@param tolerance Largest accepted difference
+	@return true if the streams match
+*/
+static bool Test_Compare(const char* what, const float* value, const float* expected, size_t count, float tolerance)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!(fabsf(value[i] - expected[i]) <= tolerance))
+		{
+			printf("%s: float %zu is %g instead of %g\n", what, i, value[i], expected[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+	Skins a mesh with and without AVX2, in one range and with many threads
+	@param count Number of vertices
+	@param matrices Skinning matrices
+	@param boneMap Matrix of each bone binding, or NULL
+	@return true if all the results match
+*/
+static bool Test_Skin(uint32_t count, const float* matrices, const uint32_t* boneMap)
+{
+	float* scalar = (float*)malloc(sizeof(float) * 6 * count);
+	float* fast = (float*)malloc(sizeof(float) * 6 * count);
+	float* parallel = (float*)malloc(sizeof(float) * 6 * count);
+	bool success = false;
+	TTestMesh test;
+
+	memset(&test, 0, sizeof(TTestMesh));
+
+	if (!scalar || !fast || !parallel || !Test_MakeMesh(&test, count, boneMap))
+	{
+		printf("memory allocation fail!!!\n");
+		goto end;
+	}
+
+	Platform_DisableCpuFeatures(PLATFORM_CPU_AVX2 | PLATFORM_CPU_FMA);
+	Skin_Deform(&test.mesh, matrices, 0, count, scalar, scalar + (size_t)3 * count);
+	Skin_DeformParallel(&test.mesh, matrices, parallel, parallel + (size_t)3 * count, 4);
+	success = Test_Compare("parallel scalar skinning", parallel, scalar, (size_t)6 * count, 0.0f);
+
+	Platform_DisableCpuFeatures(0);
+	Skin_Deform(&test.mesh, matrices, 0, count, fast, fast + (size_t)3 * count);
+	Skin_DeformParallel(&test.mesh, matrices, parallel, parallel + (size_t)3 * count, 4);
+
+	/* fused multiply-adds round once instead of twice, the positions are up to 100 and the normals up to 1 */
+	success = Test_Compare("vector positions", fast, scalar, (size_t)3 * count, 1e-3f) && success;
+	success = Test_Compare("vector normals", fast + (size_t)3 * count, scalar + (size_t)3 * count, (size_t)3 * count, 1e-5f) && success;
+	success = Test_Compare("parallel vector skinning", parallel, fast, (size_t)6 * count, 0.0f) && success;
+
+	/* the vertices without any weight are copied */
+	for (uint32_t v = 0; v < count; v += 17)
+	{
+		success = Test_Compare("unweighted position", fast + (size_t)v * 3, test.positions + (size_t)v * 3, 3, 0.0f) && success;
+		success = Test_Compare("unweighted normal", fast + (size_t)(count + v) * 3, test.normals + (size_t)v * 3, 3, 0.0f) && success;
+	}
+
+end:
+	Test_FreeMesh(&test);
+	free(scalar);
+	free(fast);
+	free(parallel);
+	return success;
+}
+
+int main(void)
+{
+	/* the last bindings share the matrices of the first ones */
+	static const uint32_t boneMap[TEST_BONES] = { 9, 8, 7, 6, 5, 4, 0, 1 };
+	static const uint32_t counts[] = { 1, 300, 4096 * 3 + 100 };
+	float matrices[16 * 10];
+	uint32_t state = 1, failures = 0;
+
+	/* affine matrices, the translation in the last column */
+	for (uint32_t m = 0; m < 10; m++)
+	{
+		for (uint32_t c = 0; c < 16; c++)
+			matrices[m * 16 + c] = c % 4 == 3 ? (c == 15 ? 1.0f : 0.0f) : c >= 12 ? Test_RandomFloat(&state) * 10.0f : Test_RandomFloat(&state);
+	}
+
+	if ((Platform_GetCpuFeatures() & (PLATFORM_CPU_AVX2 | PLATFORM_CPU_FMA)) != (PLATFORM_CPU_AVX2 | PLATFORM_CPU_FMA))
+		printf("the cpu doesn't support AVX2 and FMA, only the scalar skinning is tested\n");
+
+	for (uint32_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+	{
+		if (!Test_Skin(counts[i], matrices, NULL) || !Test_Skin(counts[i], matrices, boneMap))
+		{
+			printf("skinning of %u vertices failed\n", counts[i]);
+			failures++;
+		}
+	}
+
+	return failures ? 1 : 0;
+}